@@ -0,0 +1,438 @@
+// db_bench-style throughput and latency benchmark.
+//
+//   lsm_bench --benchmarks=fillseq,readrandom --num=100000 --value_size=100
+//             --threads=4 --distribution=zipfian --json
+//
+// KVStore is not thread-safe, so with --threads > 1 every operation is
+// serialized on one store mutex; the latency figures then include the
+// time spent waiting for it.
+
+#include <kvstore.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct Flags {
+    std::string benchmarks = "fillseq,fillrandom,overwrite,readrandom,readmissing,seekrandom,deleterandom,readrandomwriterandom";
+    std::string db = "/tmp/lsm_bench";
+    std::string conf = "../conf/default.conf";
+    std::string distribution = "uniform";
+    uint64_t num = 100000;
+    uint64_t reads = 0;
+    size_t value_size = 100;
+    size_t threads = 1;
+    size_t scan_length = 100;
+    int readwritepercent = 90;
+    double zipf_theta = 0.99;
+    bool use_existing_db = false;
+    bool json = false;
+    uint64_t seed = 301;
+};
+
+/**
+ * Log-linear latency histogram in nanoseconds: 16 linear sub-buckets for
+ * every power of two, good to about 6% anywhere in the range.
+ */
+class Histogram {
+private:
+    static const int SUB_BITS = 4;
+    static const int NR_BUCKETS = 64 << SUB_BITS;
+    std::vector<uint64_t> buckets;
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t minn = UINT64_MAX;
+    uint64_t maxx = 0;
+
+    static int bucket(uint64_t v) {
+        if (v < (1u << SUB_BITS))
+            return v;
+        int msb = 63 - __builtin_clzll(v);
+        int shift = msb - SUB_BITS;
+        return ((shift + 1) << SUB_BITS) + ((v >> shift) & ((1u << SUB_BITS) - 1));
+    }
+
+    static uint64_t upper(int b) {
+        if (b < (1 << SUB_BITS))
+            return b;
+        int shift = (b >> SUB_BITS) - 1;
+        uint64_t sub = b & ((1 << SUB_BITS) - 1);
+        return (((1ull << SUB_BITS) + sub + 1) << shift) - 1;
+    }
+
+public:
+    Histogram() : buckets(NR_BUCKETS, 0) {}
+
+    void add(uint64_t ns) {
+        this->buckets[bucket(ns)]++;
+        this->count++;
+        this->sum += ns;
+        this->minn = std::min(this->minn, ns);
+        this->maxx = std::max(this->maxx, ns);
+    }
+
+    void merge(const Histogram &other) {
+        for (int i = 0; i < NR_BUCKETS; i++)
+            this->buckets[i] += other.buckets[i];
+        this->count += other.count;
+        this->sum += other.sum;
+        this->minn = std::min(this->minn, other.minn);
+        this->maxx = std::max(this->maxx, other.maxx);
+    }
+
+    uint64_t percentile(double p) const {
+        if (this->count == 0)
+            return 0;
+        uint64_t target = std::ceil(this->count * p / 100.0);
+        uint64_t seen = 0;
+        for (int i = 0; i < NR_BUCKETS; i++) {
+            seen += this->buckets[i];
+            if (seen >= target)
+                return std::min(upper(i), this->maxx);
+        }
+        return this->maxx;
+    }
+
+    uint64_t size() const { return this->count; }
+    double mean() const { return this->count ? (double)this->sum / this->count : 0; }
+    uint64_t min() const { return this->count ? this->minn : 0; }
+    uint64_t max() const { return this->maxx; }
+};
+
+/**
+ * Zipfian over [0, n) after Gray et al., "Quickly Generating
+ * Billion-Record Synthetic Databases", as used by YCSB.
+ */
+class Zipfian {
+private:
+    uint64_t n;
+    double theta, alpha, zetan, eta;
+
+    static double zeta(uint64_t n, double theta) {
+        double sum = 0;
+        for (uint64_t i = 1; i <= n; i++)
+            sum += 1.0 / std::pow((double)i, theta);
+        return sum;
+    }
+
+public:
+    Zipfian(uint64_t n, double theta) : n(std::max<uint64_t>(n, 1)), theta(theta) {
+        this->alpha = 1.0 / (1.0 - theta);
+        this->zetan = zeta(this->n, theta);
+        double zeta2 = zeta(2, theta);
+        this->eta = (1 - std::pow(2.0 / this->n, 1 - theta)) / (1 - zeta2 / this->zetan);
+    }
+
+    uint64_t next(double u) const {
+        double uz = u * this->zetan;
+        if (uz < 1.0)
+            return 0;
+        if (uz < 1.0 + std::pow(0.5, this->theta))
+            return 1;
+        uint64_t ret = this->n * std::pow(this->eta * u - this->eta + 1, this->alpha);
+        return std::min(ret, this->n - 1);
+    }
+};
+
+class KeyGenerator {
+private:
+    enum Kind { UNIFORM, ZIPFIAN, LATEST } kind;
+    uint64_t range;
+    std::mt19937_64 rng;
+    std::uniform_real_distribution<double> unit{0.0, 1.0};
+    const Zipfian *zipf;
+    const std::atomic<uint64_t> *inserted;
+
+public:
+    KeyGenerator(const std::string &dist, uint64_t range, uint64_t seed,
+                 const Zipfian *zipf, const std::atomic<uint64_t> *inserted)
+        : range(std::max<uint64_t>(range, 1)), rng(seed), zipf(zipf), inserted(inserted) {
+        this->kind = dist == "zipfian" ? ZIPFIAN : dist == "latest" ? LATEST : UNIFORM;
+    }
+
+    uint64_t next() {
+        switch (this->kind) {
+        case ZIPFIAN:
+            // Scatter the hot keys over the key space instead of key 0, 1, ...
+            return (this->zipf->next(this->unit(this->rng)) * 0x9E3779B97F4A7C15ull) % this->range;
+        case LATEST: {
+            uint64_t top = std::min(this->inserted->load(std::memory_order_relaxed), this->range);
+            if (top == 0)
+                top = this->range;
+            uint64_t back = this->zipf->next(this->unit(this->rng)) % top;
+            return top - 1 - back;
+        }
+        default:
+            return this->rng() % this->range;
+        }
+    }
+};
+
+struct Result {
+    std::string name;
+    uint64_t ops = 0;
+    uint64_t found = 0;
+    uint64_t bytes = 0;
+    double seconds = 0;
+    Histogram hist;
+};
+
+class Benchmark {
+private:
+    Flags flags;
+    kvstore::KVStore store;
+    std::mutex mutex;
+    std::string value_source;
+    std::atomic<uint64_t> inserted{0};
+    std::unique_ptr<Zipfian> zipf;
+    // Benchmarks run so far. Each one seeds its own keys, so a phase does
+    // not replay the keys an earlier one wrote or deleted.
+    uint64_t phase = 0;
+
+    std::string value(std::mt19937_64 &rng) {
+        size_t offset = rng() % (this->value_source.size() - this->flags.value_size);
+        return this->value_source.substr(offset, this->flags.value_size);
+    }
+
+    template <typename Op>
+    void timed(Result &r, Op op) {
+        auto start = std::chrono::steady_clock::now();
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            op();
+        }
+        auto end = std::chrono::steady_clock::now();
+        r.hist.add(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+        r.ops++;
+    }
+
+    void worker(const std::string &name, size_t tid, uint64_t ops, Result &r) {
+        uint64_t seed = this->flags.seed ^ this->phase * 0x9e3779b97f4a7c15ull;
+        std::mt19937_64 rng(seed + tid * 7919);
+        KeyGenerator keys(this->flags.distribution, this->flags.num, seed + tid,
+                          this->zipf.get(), &this->inserted);
+        uint64_t base = tid * ops;
+
+        for (uint64_t i = 0; i < ops; i++) {
+            if (name == "fillseq") {
+                uint64_t key = base + i;
+                auto v = this->value(rng);
+                this->timed(r, [&] { this->store.put(key, v); });
+                r.bytes += v.size() + sizeof(key);
+                this->inserted.fetch_add(1, std::memory_order_relaxed);
+            } else if (name == "fillrandom" || name == "overwrite") {
+                uint64_t key = name == "fillrandom" ? rng() % this->flags.num : keys.next();
+                auto v = this->value(rng);
+                this->timed(r, [&] { this->store.put(key, v); });
+                r.bytes += v.size() + sizeof(key);
+                this->inserted.fetch_add(1, std::memory_order_relaxed);
+            } else if (name == "readrandom" || name == "readmissing") {
+                uint64_t key = keys.next();
+                if (name == "readmissing")
+                    key += this->flags.num;
+                std::string v;
+                this->timed(r, [&] { v = this->store.get(key); });
+                r.found += !v.empty();
+                r.bytes += v.size();
+            } else if (name == "seekrandom") {
+                uint64_t key = keys.next();
+                std::list<std::pair<uint64_t, std::string>> list;
+                this->timed(r, [&] { this->store.scan(key, key + this->flags.scan_length - 1, list); });
+                r.found += !list.empty();
+                for (auto &kv : list)
+                    r.bytes += kv.second.size() + sizeof(kv.first);
+            } else if (name == "deleterandom") {
+                uint64_t key = keys.next();
+                bool ok = false;
+                this->timed(r, [&] { ok = this->store.del(key); });
+                r.found += ok;
+            } else if (name == "readrandomwriterandom") {
+                uint64_t key = keys.next();
+                if ((int)(rng() % 100) < this->flags.readwritepercent) {
+                    std::string v;
+                    this->timed(r, [&] { v = this->store.get(key); });
+                    r.found += !v.empty();
+                    r.bytes += v.size();
+                } else {
+                    auto v = this->value(rng);
+                    this->timed(r, [&] { this->store.put(key, v); });
+                    r.bytes += v.size() + sizeof(key);
+                }
+            }
+        }
+    }
+
+public:
+    Benchmark(const Flags &flags) : flags(flags), store(flags.db, flags.conf) {
+        std::mt19937_64 rng(flags.seed);
+        this->value_source.resize(std::max<size_t>(flags.value_size * 4, 1 << 20));
+        for (auto &c : this->value_source)
+            c = 'a' + rng() % 26;
+        this->zipf = std::make_unique<Zipfian>(flags.num, flags.zipf_theta);
+        if (!flags.use_existing_db)
+            this->store.reset();
+    }
+
+    Result run(const std::string &name) {
+        bool is_fill = name == "fillseq" || name == "fillrandom" || name == "overwrite" ||
+                       name == "deleterandom";
+        uint64_t total = is_fill || this->flags.reads == 0 ? this->flags.num : this->flags.reads;
+        uint64_t per_thread = std::max<uint64_t>(total / this->flags.threads, 1);
+
+        if (name == "fillseq" || name == "fillrandom")
+            this->inserted = 0;
+
+        std::vector<Result> partial(this->flags.threads);
+        std::vector<std::thread> workers;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t t = 0; t < this->flags.threads; t++)
+            workers.emplace_back([this, &name, t, per_thread, &partial] {
+                this->worker(name, t, per_thread, partial[t]);
+            });
+        for (auto &w : workers)
+            w.join();
+        auto end = std::chrono::steady_clock::now();
+        this->phase++;
+
+        Result ret;
+        ret.name = name;
+        ret.seconds = std::chrono::duration<double>(end - start).count();
+        for (auto &p : partial) {
+            ret.ops += p.ops;
+            ret.found += p.found;
+            ret.bytes += p.bytes;
+            ret.hist.merge(p.hist);
+        }
+        return ret;
+    }
+};
+
+void report(const Flags &flags, const Result &r) {
+    double ops_per_sec = r.seconds > 0 ? r.ops / r.seconds : 0;
+    double mb_per_sec = r.seconds > 0 ? r.bytes / r.seconds / 1048576.0 : 0;
+    if (flags.json) {
+        std::cout << "{\"benchmark\":\"" << r.name << "\""
+                  << ",\"ops\":" << r.ops
+                  << ",\"found\":" << r.found
+                  << ",\"threads\":" << flags.threads
+                  << ",\"value_size\":" << flags.value_size
+                  << ",\"distribution\":\"" << flags.distribution << "\""
+                  << ",\"seconds\":" << r.seconds
+                  << ",\"ops_per_sec\":" << ops_per_sec
+                  << ",\"mb_per_sec\":" << mb_per_sec
+                  << ",\"latency_ns\":{\"mean\":" << r.hist.mean()
+                  << ",\"min\":" << r.hist.min()
+                  << ",\"p50\":" << r.hist.percentile(50)
+                  << ",\"p99\":" << r.hist.percentile(99)
+                  << ",\"p999\":" << r.hist.percentile(99.9)
+                  << ",\"max\":" << r.hist.max() << "}}" << std::endl;
+        return;
+    }
+    std::cout << std::left << std::setw(22) << r.name << std::right << std::fixed
+              << std::setprecision(3) << std::setw(12) << (r.ops ? r.seconds * 1e6 / r.ops : 0)
+              << " micros/op " << std::setprecision(0) << std::setw(10) << ops_per_sec << " ops/sec "
+              << std::setprecision(1) << std::setw(8) << mb_per_sec << " MB/s";
+    if (r.name.find("read") != std::string::npos || r.name == "seekrandom" || r.name == "deleterandom")
+        std::cout << " (" << r.found << " of " << r.ops << " found)";
+    std::cout << std::endl;
+    std::cout << std::setw(22) << "" << "p50 " << r.hist.percentile(50) / 1000.0
+              << "us  p99 " << r.hist.percentile(99) / 1000.0
+              << "us  p999 " << r.hist.percentile(99.9) / 1000.0
+              << "us  max " << r.hist.max() / 1000.0 << "us" << std::endl;
+}
+
+bool parse(int argc, char *argv[], Flags &flags) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto eq = arg.find('=');
+        std::string name = arg.substr(0, eq);
+        std::string value = eq == std::string::npos ? "1" : arg.substr(eq + 1);
+
+        if (name == "--benchmarks")
+            flags.benchmarks = value;
+        else if (name == "--db")
+            flags.db = value;
+        else if (name == "--conf")
+            flags.conf = value;
+        else if (name == "--distribution")
+            flags.distribution = value;
+        else if (name == "--num")
+            flags.num = std::stoull(value);
+        else if (name == "--reads")
+            flags.reads = std::stoull(value);
+        else if (name == "--value_size")
+            flags.value_size = std::stoul(value);
+        else if (name == "--threads")
+            flags.threads = std::max<size_t>(std::stoul(value), 1);
+        else if (name == "--scan_length")
+            flags.scan_length = std::max<size_t>(std::stoul(value), 1);
+        else if (name == "--readwritepercent")
+            flags.readwritepercent = std::stoi(value);
+        else if (name == "--zipf_theta")
+            flags.zipf_theta = std::stod(value);
+        else if (name == "--use_existing_db")
+            flags.use_existing_db = value != "0";
+        else if (name == "--json")
+            flags.json = value != "0";
+        else if (name == "--seed")
+            flags.seed = std::stoull(value);
+        else {
+            std::cerr << "Unknown flag " << arg << std::endl;
+            return false;
+        }
+    }
+    if (flags.distribution != "uniform" && flags.distribution != "zipfian" &&
+        flags.distribution != "latest") {
+        std::cerr << "Unknown distribution " << flags.distribution << std::endl;
+        return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+    Flags flags;
+    if (!parse(argc, argv, flags)) {
+        std::cerr << "Usage: " << argv[0] << " [--benchmarks=a,b,...] [--num=N] [--reads=N]"
+                  << " [--value_size=B] [--threads=T] [--distribution=uniform|zipfian|latest]"
+                  << " [--scan_length=N] [--readwritepercent=P] [--db=DIR] [--conf=FILE]"
+                  << " [--use_existing_db] [--json]" << std::endl;
+        return 1;
+    }
+
+    if (!flags.json)
+        std::cout << "Keys: 8 bytes, values: " << flags.value_size << " bytes, entries: "
+                  << flags.num << ", threads: " << flags.threads << ", distribution: "
+                  << flags.distribution << std::endl
+                  << std::string(78, '-') << std::endl;
+
+    Benchmark bench(flags);
+    std::stringstream ss(flags.benchmarks);
+    std::string name;
+    while (std::getline(ss, name, ',')) {
+        if (name.empty())
+            continue;
+        if (name != "fillseq" && name != "fillrandom" && name != "overwrite" &&
+            name != "readrandom" && name != "readmissing" && name != "seekrandom" &&
+            name != "deleterandom" && name != "readrandomwriterandom") {
+            std::cerr << "Unknown benchmark " << name << std::endl;
+            continue;
+        }
+        report(flags, bench.run(name));
+    }
+    return 0;
+}
@@ -7,34 +7,249 @@
 #include <memtable/memtable.h>
 #include <sstable/sstable.h>
 
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <string>
+#include <thread>
+#include <vector>
 namespace kvstore {
     const std::string deleted = "~DELETED~";
-    const size_t MAX_CAPACITY = 2 * 1024 * 1024 - sstable::SSBLOCK_RESERVED_SIZE;
+    const size_t MAX_CAPACITY = sstable::DEFAULT_WRITE_BUFFER_SIZE;
+    using sstable::Options;
+    using memory::PinnableSlice;
+    using memory::Slice;
 
-    class KVStore : KVStoreAPI {
+    /**
+     * The store over any key type the engine is instantiated for:
+     * uint64_t and std::string. Byte-string keys are ordered by the
+     * keys::KeyComparator passed in, bytewise by default.
+     */
+    template <typename Key, typename Compare = typename keys::KeyTraits<Key>::Compare>
+    class BasicKVStore : public BasicKVStoreAPI<Key> {
     private:
-        std::unique_ptr<memtable::MemTable> mtable;
-        std::unique_ptr<sstable::SSTable> stable;
+        using Table = memtable::MemTable<Key, Compare>;
+        using Block = sstable::SSBlock<Key, Compare>;
+
+        /**
+         * A full memtable waiting for a flusher. `taken` once a flusher
+         * has picked it, `written` once its entries are in a block, which
+         * the oldest memtable of a batch holds until it is committed.
+         */
+        struct Immutable {
+            uint64_t seq;
+            std::shared_ptr<Table> table;
+            size_t charged;
+            bool taken;
+            bool written;
+            std::unique_ptr<Block> block;
+        };
+
+        Compare cmp;
+        std::unique_ptr<Table> mtable;
+        std::unique_ptr<sstable::SSTable<Key, Compare>> stable;
+        statistics::Statistics *stats;
+        uint64_t default_ttl;
+        memtable::MemTable_Backend_Type memtable_type;
+        size_t write_buffer_size;
+        size_t max_immutables;
+        std::shared_ptr<merge::MergeOperator> merge_operator;
+        std::shared_ptr<memory::MemoryBudget> budget;
+        // Memtable bytes charged to the budget so far.
+        size_t charged = 0;
+
+        // Sealed memtables, oldest first, and the flushers draining them.
+        // Blocks are written in parallel but reach level 0 in sequence
+        // order, one committer at a time, so newer data always lands on
+        // top. Readers of the sstable share `stable_mutex` with committers.
+        std::deque<Immutable> immutables;
+        uint64_t next_seq = 0;
+        bool committing = false;
+        bool stopping = false;
+        mutable std::mutex mutex;
+        std::condition_variable changed;
+        mutable std::shared_timed_mutex stable_mutex;
+        std::vector<std::thread> flushers;
+        // With background compaction, woken when the sstable has work.
+        std::thread compactor;
+        bool compaction_wanted = false;
+        std::condition_variable compaction_requested;
+
+        std::string fold(const std::string &operands, const std::string &base) const;
+        /**
+         * `operands` applied to `older`, both as a memtable stores them.
+         * `flags` are older's on the way in and the result's on the way out.
+         */
+        std::string stack(const std::string &older, uint8_t &flags, const std::string &operands) const;
+        /** Charge the last write and flush if the memtable or budget is full. */
+        void make_room();
+        void release_memtable();
+        /** Sealed memtables still to be read, newest first. */
+        std::vector<std::shared_ptr<Table>> sealed() const;
+        /**
+         * Look `key` up in the memtables, newest first. Returns true if
+         * one settles it, with the value in `ret`; otherwise `ret` holds
+         * the operands found on the way, if any, to fold into the
+         * sstable's value.
+         */
+        bool search_memtables(const Key &key, const std::vector<std::shared_ptr<Table>> &tables,
+                              std::string &ret, uint64_t now) const;
+        /** Queue the memtable for the flushers, waiting for room first. */
+        void seal();
+        void flush_loop();
+        /** Write `tables`, oldest first, as one block, newest value winning. */
+        std::unique_ptr<Block> write_block(const std::vector<std::shared_ptr<Table>> &tables);
+        /** Commit written blocks in order; called with `mutex` held. */
+        void commit_written(std::unique_lock<std::mutex> &lock);
+        void wait_for_flushes();
+        /** Wake the compactor if there is work; call with `stable_mutex` held. */
+        void schedule_compaction();
+        void compact_loop();
         
     public:
-        KVStore(const std::string &dir,const std::string &conf = "../conf/default.conf"): KVStoreAPI(dir){
-            this->mtable = std::make_unique<memtable::RBTree>();
-            this->stable = std::make_unique<sstable::SSTable>(dir,conf);
+        BasicKVStore(const std::string &dir,const std::string &conf = "../conf/default.conf",
+                     const Compare &cmp = Compare()): BasicKVStore(dir, Options::fromFile(conf), cmp){}
+        BasicKVStore(const std::string &dir, const Options &options,
+                     const Compare &cmp = Compare()): BasicKVStoreAPI<Key>(dir), cmp(cmp){
+            this->mtable = memtable::make<Key, Compare>(options.memtable, cmp);
+            this->stable = std::make_unique<sstable::SSTable<Key, Compare>>(dir,options,cmp);
+            this->stats = this->stable->getStatistics();
+            this->default_ttl = options.default_ttl;
+            this->memtable_type = options.memtable;
+            this->write_buffer_size = options.write_buffer_size;
+            this->max_immutables = options.max_immutable_memtables;
+            this->budget = this->stable->getMemoryBudget();
+            if(this->max_immutables != 0){
+                for(size_t i = 0; i < std::max<size_t>(options.flush_threads, 1); i++)
+                    this->flushers.emplace_back(&BasicKVStore::flush_loop, this);
+            }
+            if(options.background_compaction){
+                this->compaction_wanted = true;
+                this->compactor = std::thread(&BasicKVStore::compact_loop, this);
+            }
         }
-        ~KVStore(){
+        ~BasicKVStore(){
+            // Memtables already sealed are written out; the active one is
+            // dropped, as it always has been.
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                this->stopping = true;
+            }
+            this->changed.notify_all();
+            this->compaction_requested.notify_all();
+            for(auto &flusher : this->flushers)
+                flusher.join();
+            if(this->compactor.joinable())
+                this->compactor.join();
+            this->release_memtable();
             this->mtable.reset();
             this->stable.reset();
         }
 
-        void put(const uint64_t key, const std::string &s) override;
-        std::string get(const uint64_t key) override;
-        bool del(const uint64_t key) override;
+        /** Writes expire after the conf file's `default_ttl`, if set. */
+        void put(const Key &key, const std::string &s) override;
+        /**
+         * Write a value that reads as deleted `ttl` seconds from now; 0
+         * means it never expires. Compaction drops it once expired
+         * without writing a tombstone.
+         */
+        void put(const Key &key, const std::string &s, uint64_t ttl);
+        std::string get(const Key &key) override;
+        /**
+         * Like get(), without copying the value where it can be avoided:
+         * `value` views it in the memtable or the value cache, pinning it
+         * there until `value` is reset or destroyed, or takes over the
+         * buffer it was read into. Returns false, with `value` empty, if
+         * the key is not found.
+         */
+        bool get_pinned(const Key &key, PinnableSlice &value);
+        bool del(const Key &key) override;
+        /**
+         * Record `operand` against the key for the merge operator to fold
+         * in later, on reads and compactions, so an update needs no read
+         * first. Returns false if no merge operator is set.
+         */
+        bool merge(const Key &key, const std::string &operand);
+        /**
+         * Set before the first merge(), and again with the same operator
+         * each time a store that holds operands is opened.
+         */
+        void set_merge_operator(std::shared_ptr<merge::MergeOperator> op);
+        /**
+         * Move block files built by sstable::SSTableWriter into the store
+         * without going through the memtable or compaction. Each lands on
+         * the deepest level that nothing above it overlaps, and reads as
+         * newer than everything written before. The files are renamed, so
+         * they must be on the store's filesystem. Returns false if one is
+         * not a block or they overlap each other.
+         */
+        bool ingest_files(const std::vector<std::string> &paths);
+        /**
+         * Flush the memtable and make `dir` a copy of the store as it is
+         * then, from hard links to its files, so it takes about the same
+         * time however much data there is. Open the copy as a store of
+         * its own with `KVStore(dir, dir + "/CONF")`; its `MANIFEST`
+         * lists the files with their sizes, and as files are never
+         * rewritten, a backup of a later checkpoint need only copy those
+         * not listed before. `dir` must not exist and must be on the
+         * store's filesystem. Returns false if the checkpoint could not
+         * be made.
+         */
+        bool checkpoint(const std::string &dir);
         void reset() override;
-        void scan(const uint64_t key1, const uint64_t key2, std::list<std::pair<uint64_t, std::string>> &list) override;
+        void scan(const Key &key1, const Key &key2, std::list<std::pair<Key, std::string>> &list) override;
+        /**
+         * Look up several keys at once. Keys missing from the memtable
+         * have their block reads issued together through the configured
+         * I/O backend. An empty string indicates not found.
+         */
+        std::vector<std::string> multi_get(const std::vector<Key> &keys);
+        /**
+         * Cap the bytes per second written by flushes and compactions;
+         * 0 lifts the limit. With auto_tune the cap becomes a ceiling and
+         * the actual rate follows the level-0 backlog.
+         */
+        void set_rate_limit(uint64_t bytes_per_sec, bool auto_tune = false);
+        /**
+         * Share one memory limit with other stores. The memtable, the
+         * value cache and every block's filter and index are charged to
+         * `budget` from now on; when it is exceeded the cache shrinks
+         * first, then the memtable is flushed early. Each store starts
+         * with its own budget, limited by the conf file's `memory_limit`.
+         */
+        void set_memory_budget(std::shared_ptr<memory::MemoryBudget> budget);
+        std::shared_ptr<memory::MemoryBudget> get_memory_budget() const;
+        /**
+         * Engine counters and latency histograms, or nullptr when the
+         * conf file turns statistics off. Per-operation breakdowns live
+         * in statistics::get_perf_context().
+         */
+        statistics::Statistics *get_statistics() const;
+        std::string dump_statistics(bool json = false) const;
+        /**
+         * Current value of a named property, e.g. "minilsm.keys-at-level2"
+         * or "minilsm.write-amplification"; an empty string for unknown
+         * names. Values are kept up to date as blocks are written and
+         * removed, so polling is cheap. README.md lists the names.
+         */
+        std::string get_property(const std::string &name) const;
+        /**
+         * Write the memtable out, along with any waiting for a flusher,
+         * and return once they are all on level 0.
+         */
         void flush();
     };
+
+    // A class rather than an alias so `class KVStore` declarations still work.
+    class KVStore : public BasicKVStore<uint64_t> {
+    public:
+        using BasicKVStore<uint64_t>::BasicKVStore;
+    };
+
+    using StringKVStore = BasicKVStore<std::string>;
 };
 
 #endif
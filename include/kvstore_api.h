@@ -5,7 +5,12 @@
 #include <string>
 
 namespace kvstore {
-    class KVStoreAPI {
+    /**
+     * Keys are uint64_t for KVStoreAPI; other key types go through
+     * BasicKVStoreAPI directly.
+     */
+    template <typename Key>
+    class BasicKVStoreAPI {
     public:
         /**
          * You should put all sstables under `dir`.
@@ -13,26 +18,27 @@ namespace kvstore {
          * there. Please refer to the c++ filesystem library
          * (https://en.cppreference.com/w/cpp/filesystem).
          */
-        KVStoreAPI(const std::string &dir) {(void) dir;}
-        KVStoreAPI() = delete;
+        BasicKVStoreAPI(const std::string &dir) {(void) dir;}
+        BasicKVStoreAPI() = delete;
+        virtual ~BasicKVStoreAPI() {}
 
         /**
          * Insert/Update the key-value pair.
          * No return values for simplicity.
          */
-        virtual void put(const uint64_t key, const std::string &s) = 0;
+        virtual void put(const Key &key, const std::string &s) = 0;
 
         /**
          * Returns the (string) value of the given key.
          * An empty string indicates not found.
          */
-        virtual std::string get(const uint64_t key) = 0;
+        virtual std::string get(const Key &key) = 0;
 
         /**
          * Delete the given key-value pair if it exists.
          * Returns false iff the key is not found.
          */
-        virtual bool del(const uint64_t key) = 0;
+        virtual bool del(const Key &key) = 0;
 
         /**
          * This resets the kvstore. All key-value pairs should be removed,
@@ -45,6 +51,8 @@ namespace kvstore {
          * keys in the list should be in an ascending order.
          * An empty string indicates not found.
          */
-        virtual void scan(const uint64_t key1, const uint64_t key2, std::list<std::pair<uint64_t, std::string> > &list) = 0;
+        virtual void scan(const Key &key1, const Key &key2, std::list<std::pair<Key, std::string> > &list) = 0;
     };
+
+    using KVStoreAPI = BasicKVStoreAPI<uint64_t>;
 };
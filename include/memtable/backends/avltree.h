@@ -10,15 +10,16 @@
 
 namespace avl {
 
-    class AVLTree : public memtable_generic::MemTable{
+    template <typename Key, typename Compare = typename keys::KeyTraits<Key>::Compare>
+    class AVLTree : public memtable_generic::MemTable<Key, Compare>{
     private:
         struct AVLNode {
-            std::pair<uint64_t,std::string> elem;
+            std::pair<Key,memory::InlineSlice> elem;
             uint64_t height;
             AVLNode *left;
             AVLNode *right;
 
-            AVLNode(const uint64_t &key, const std::string &value) {
+            AVLNode(const Key &key, const memory::InlineSlice &value) {
                 left = nullptr;
                 right = nullptr;
                 elem = std::make_pair(key, value);
@@ -35,8 +36,8 @@ namespace avl {
             if (root != nullptr)
                 root->height = std::max(height(root->left), height(root->right)) + 1;
         }
-        uint64_t balance(const AVLNode *root) noexcept {
-            return height(root->left) - height(root->right);
+        int64_t balance(const AVLNode *root) noexcept {
+            return (int64_t)height(root->left) - (int64_t)height(root->right);
         }
 
         AVLNode *left_rotation(AVLNode *root) noexcept {
@@ -74,49 +75,54 @@ namespace avl {
             return left_rotation(root);
         }
 
-        AVLNode *insertUtil(AVLNode *root, const uint64_t &key, const std::string &value) noexcept {
+        AVLNode *insertUtil(AVLNode *root, const Key &key, const std::string &value, uint8_t flags) noexcept {
 
-            if (root == nullptr) {
-                this->nr_size += sizeof(uint64_t) +sizeof(size_t) + value.size();
-                return new AVLNode(key, value);
-            }
+            if (root == nullptr)
+                return new AVLNode(key, this->admit(key, value, flags));
 
-            if (key == root->elem.first){
-                uint64_t prev_size = root->elem.second.size();
-                uint64_t cur_size = value.size();
-                this->nr_size += (cur_size - prev_size);
-                root->elem.second = value;
-            }
+            if (this->equal(key, root->elem.first))
+                this->assign(root->elem.second, value, flags);
 
-            else if (key < root->elem.first)
-                root->left = insertUtil(root->left, key, value);
+            else if (this->cmp(key, root->elem.first))
+                root->left = insertUtil(root->left, key, value, flags);
             else
-                root->right = insertUtil(root->right, key, value);
+                root->right = insertUtil(root->right, key, value, flags);
             update_height(root);
             return adjust(root);
         }
 
-        const AVLNode *searchUtil(const AVLNode *root, const uint64_t &key) const noexcept {
-            if (root == nullptr || root->elem.first == key)
+        const AVLNode *searchUtil(const AVLNode *root, const Key &key) const noexcept {
+            if (root == nullptr || this->equal(root->elem.first, key))
                 return root;
-            else if (key < root->elem.first)
+            else if (this->cmp(key, root->elem.first))
                 return searchUtil(root->left, key);
             else
                 return searchUtil(root->right, key);
         }
 
-        void dumpUtil(const AVLNode *root, std::vector<std::pair<uint64_t,std::string>> &block) noexcept {
+        void dumpUtil(const AVLNode *root, std::vector<std::pair<Key,std::string>> &block) noexcept {
             if (root == nullptr)
                 return;
             dumpUtil(root->left, block);
-            block.push_back(root->elem);
+            block.emplace_back(root->elem.first, root->elem.second.toString());
             dumpUtil(root->right, block);
             delete root;
         }
 
+        void scanUtil(const AVLNode *root, const Key &key1, const Key &key2, std::vector<typename memtable_generic::MemTable<Key, Compare>::Entry> &ret) const noexcept {
+            if (root == nullptr)
+                return;
+            if (this->cmp(key1, root->elem.first))
+                scanUtil(root->left, key1, key2, ret);
+            if (!this->cmp(root->elem.first, key1) && !this->cmp(key2, root->elem.first))
+                ret.push_back(root->elem);
+            if (this->cmp(root->elem.first, key2))
+                scanUtil(root->right, key1, key2, ret);
+        }
+
         AVLNode *adjust(AVLNode *root) noexcept {
             if (balance(root) >= 2) {
-                if (balance(root->left) > 0)
+                if (balance(root->left) >= 0)
                     return LLUtil(root);
                 else
                     return LRUtil(root);
@@ -139,7 +145,7 @@ namespace avl {
         }
 
     public:
-        AVLTree() {
+        AVLTree(const Compare &cmp = Compare()) : memtable_generic::MemTable<Key, Compare>(cmp) {
             this->root = nullptr;
         }
 
@@ -147,30 +153,39 @@ namespace avl {
             this->reset();
         }
 
-        void remove(const uint64_t &key) noexcept {
-            this->root = insertUtil(this->root, key, memtable_generic::deleted);
+        void remove(const Key &key) noexcept {
+            this->root = insertUtil(this->root, key, memtable_generic::deleted, memtable_generic::PLAIN);
         }
 
-        void insert(const uint64_t &key, const std::string &value) noexcept {
-            this->root = insertUtil(this->root, key, value);
+        void insert(const Key &key, const std::string &value, uint8_t flags = memtable_generic::PLAIN) noexcept {
+            this->root = insertUtil(this->root, key, value, flags);
         }
 
-        std::string search(const uint64_t &key) const noexcept {
+        bool find(const Key &key, memory::InlineSlice &value) const noexcept {
             const AVLNode *node = searchUtil(this->root, key);
             if (node == nullptr)
-                return "";
-            else
-                return node->elem.second;
+                return false;
+            value = node->elem.second;
+            return true;
         }
 
-        std::vector<std::pair<uint64_t,std::string>> dump() noexcept {
-            auto ret = std::vector<std::pair<uint64_t,std::string>>();
+        std::vector<std::pair<Key,std::string>> dump() noexcept {
+            auto ret = std::vector<std::pair<Key,std::string>>();
             dumpUtil(this->root, ret);
             this->nr_size = 0;
             this->root = nullptr;
+            this->release_values();
             return ret;
         }
 
+        std::unique_ptr<typename memtable_generic::MemTable<Key, Compare>::Cursor> cursor() const noexcept {
+            return std::make_unique<memtable_generic::TreeCursor<Key, AVLNode, Compare>>(this->root);
+        }
+
+        void scanEntries(const Key &key1, const Key &key2, std::vector<typename memtable_generic::MemTable<Key, Compare>::Entry> &ret) const noexcept {
+            scanUtil(this->root, key1, key2, ret);
+        }
+
         size_t size() const noexcept {
             return this->nr_size;
         }
@@ -179,6 +194,7 @@ namespace avl {
             deleteUtil(this->root);
             this->root = nullptr;
             this->nr_size = 0;
+            this->release_values();
         }
     };
 };
@@ -0,0 +1,314 @@
+#ifndef __BPTREE_H
+#define __BPTREE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "engine.h"
+
+namespace bpt {
+    /**
+     * Where `key` goes among the sorted `keys[0, n)`: the first slot not
+     * less than it. The generic version is a binary search.
+     */
+    template <typename Key, typename Compare>
+    struct NodeSearch {
+        static size_t lowerBound(const Key *keys, size_t n, size_t, const Key &key,
+                                 const Compare &cmp) noexcept {
+            return std::lower_bound(keys, keys + n, key, cmp) - keys;
+        }
+        static void pad(Key *, size_t, size_t) noexcept {}
+    };
+
+    /**
+     * Integer keys in their natural order fill unused slots with the
+     * largest key, so every search counts across the whole node with no
+     * branches or early exit; the compiler turns that loop into vector
+     * compares.
+     */
+    template <>
+    struct NodeSearch<uint64_t, std::less<uint64_t>> {
+        static size_t lowerBound(const uint64_t *keys, size_t, size_t width,
+                                 const uint64_t &key, const std::less<uint64_t> &) noexcept {
+            size_t ret = 0;
+            for (size_t i = 0; i < width; i++)
+                ret += keys[i] < key;
+            return ret;
+        }
+        static void pad(uint64_t *keys, size_t n, size_t width) noexcept {
+            std::fill(keys + n, keys + width, std::numeric_limits<uint64_t>::max());
+        }
+    };
+
+    /**
+     * B+-tree with nodes of FANOUT keys held in one dense array, so a
+     * lookup touches a couple of cache lines per level instead of one
+     * node per comparison. Inner nodes hold the largest key of each
+     * child but the last; leaves are chained in key order for cursors
+     * and scans.
+     */
+    template <typename Key, typename Compare = typename keys::KeyTraits<Key>::Compare>
+    class BPlusTree : public memtable_generic::MemTable<Key, Compare> {
+    private:
+        static const size_t FANOUT = 16;
+        using Search = NodeSearch<Key, Compare>;
+
+        struct Node {
+            bool leaf;
+            size_t n = 0;
+            Key keys[FANOUT];
+            Node(bool leaf) : leaf(leaf) { Search::pad(this->keys, 0, FANOUT); }
+        };
+
+        struct Inner : Node {
+            Node *children[FANOUT + 1];
+            Inner() : Node(false) {}
+        };
+
+        // `keys` repeats the keys of `elems` so searches stay within it.
+        struct Leaf : Node {
+            std::pair<Key, memory::InlineSlice> elems[FANOUT];
+            Leaf *next = nullptr;
+            Leaf() : Node(true) {}
+        };
+
+        class Cursor : public memtable_generic::MemTable<Key, Compare>::Cursor {
+        private:
+            const Leaf *leaf;
+            size_t pos;
+        public:
+            Cursor(const Leaf *leaf, size_t pos) : leaf(leaf), pos(pos) {
+                this->skip();
+            }
+            void skip() noexcept {
+                while (this->leaf != nullptr && this->pos >= this->leaf->n) {
+                    this->leaf = this->leaf->next;
+                    this->pos = 0;
+                }
+            }
+            bool valid() const noexcept override { return this->leaf != nullptr; }
+            const typename memtable_generic::MemTable<Key, Compare>::Entry &entry() const noexcept override {
+                return this->leaf->elems[this->pos];
+            }
+            void next() noexcept override {
+                this->pos++;
+                this->skip();
+            }
+        };
+
+        Node *root = nullptr;
+
+        size_t position(const Node *node, const Key &key) const noexcept {
+            return Search::lowerBound(node->keys, node->n, FANOUT, key, this->cmp);
+        }
+
+        const Leaf *findLeaf(const Key &key, size_t &pos) const noexcept {
+            const Node *node = this->root;
+            if (node == nullptr)
+                return nullptr;
+            while (!node->leaf)
+                node = static_cast<const Inner *>(node)->children[this->position(node, key)];
+            pos = this->position(node, key);
+            return static_cast<const Leaf *>(node);
+        }
+
+        /**
+         * Insert into the subtree under `node`. If it splits, the new right
+         * sibling is returned and `sep` is set to the largest key left
+         * behind.
+         */
+        Node *insertUtil(Node *node, const Key &key, const std::string &value, uint8_t flags, Key &sep) {
+            size_t pos = this->position(node, key);
+            if (node->leaf) {
+                auto leaf = static_cast<Leaf *>(node);
+                if (pos < leaf->n && this->equal(leaf->keys[pos], key)) {
+                    this->assign(leaf->elems[pos].second, value, flags);
+                    return nullptr;
+                }
+                return this->insertLeaf(leaf, pos, key, this->admit(key, value, flags), sep);
+            }
+
+            auto inner = static_cast<Inner *>(node);
+            Key child_sep;
+            Node *split = this->insertUtil(inner->children[pos], key, value, flags, child_sep);
+            if (split == nullptr)
+                return nullptr;
+            return this->insertInner(inner, pos, child_sep, split, sep);
+        }
+
+        Node *insertLeaf(Leaf *leaf, size_t pos, const Key &key, const memory::InlineSlice &value, Key &sep) {
+            if (leaf->n < FANOUT) {
+                for (size_t i = leaf->n; i > pos; i--) {
+                    leaf->keys[i] = std::move(leaf->keys[i - 1]);
+                    leaf->elems[i] = std::move(leaf->elems[i - 1]);
+                }
+                leaf->keys[pos] = key;
+                leaf->elems[pos] = std::make_pair(key, value);
+                leaf->n++;
+                return nullptr;
+            }
+
+            // Full: the lower half stays, the upper half moves right, and
+            // the new entry joins whichever half its slot falls in.
+            auto right = new Leaf();
+            size_t half = FANOUT / 2;
+            bool goes_left = pos <= half;
+            size_t keep = goes_left ? half : half + 1;
+            for (size_t i = keep; i < FANOUT; i++) {
+                right->keys[i - keep] = std::move(leaf->keys[i]);
+                right->elems[i - keep] = std::move(leaf->elems[i]);
+            }
+            right->n = FANOUT - keep;
+            leaf->n = keep;
+            Search::pad(leaf->keys, leaf->n, FANOUT);
+            Search::pad(right->keys, right->n, FANOUT);
+            right->next = leaf->next;
+            leaf->next = right;
+
+            Key unused;
+            if (goes_left)
+                this->insertLeaf(leaf, pos, key, value, unused);
+            else
+                this->insertLeaf(right, pos - keep, key, value, unused);
+            sep = leaf->keys[leaf->n - 1];
+            return right;
+        }
+
+        Node *insertInner(Inner *inner, size_t pos, const Key &child_sep, Node *split, Key &sep) {
+            if (inner->n < FANOUT) {
+                for (size_t i = inner->n; i > pos; i--) {
+                    inner->keys[i] = std::move(inner->keys[i - 1]);
+                    inner->children[i + 1] = inner->children[i];
+                }
+                inner->keys[pos] = child_sep;
+                inner->children[pos + 1] = split;
+                inner->n++;
+                return nullptr;
+            }
+
+            Key keys[FANOUT + 1];
+            Node *children[FANOUT + 2];
+            for (size_t i = 0, j = 0; i <= FANOUT; i++) {
+                if (i == pos)
+                    keys[i] = child_sep;
+                else
+                    keys[i] = std::move(inner->keys[j++]);
+            }
+            for (size_t i = 0, j = 0; i <= FANOUT + 1; i++) {
+                if (i == pos + 1)
+                    children[i] = split;
+                else
+                    children[i] = inner->children[j++];
+            }
+
+            // The middle key moves up; each side keeps the children around it.
+            size_t mid = (FANOUT + 1) / 2;
+            auto right = new Inner();
+            inner->n = mid;
+            for (size_t i = 0; i < mid; i++) {
+                inner->keys[i] = std::move(keys[i]);
+                inner->children[i] = children[i];
+            }
+            inner->children[mid] = children[mid];
+            right->n = FANOUT - mid;
+            for (size_t i = 0; i < right->n; i++) {
+                right->keys[i] = std::move(keys[mid + 1 + i]);
+                right->children[i] = children[mid + 1 + i];
+            }
+            right->children[right->n] = children[FANOUT + 1];
+            Search::pad(inner->keys, inner->n, FANOUT);
+            Search::pad(right->keys, right->n, FANOUT);
+            sep = std::move(keys[mid]);
+            return right;
+        }
+
+        void deleteUtil(Node *node) noexcept {
+            if (node == nullptr)
+                return;
+            if (node->leaf) {
+                delete static_cast<Leaf *>(node);
+                return;
+            }
+            auto inner = static_cast<Inner *>(node);
+            for (size_t i = 0; i <= inner->n; i++)
+                deleteUtil(inner->children[i]);
+            delete inner;
+        }
+
+    public:
+        BPlusTree(const Compare &cmp = Compare()) : memtable_generic::MemTable<Key, Compare>(cmp) {}
+
+        ~BPlusTree() {
+            this->reset();
+        }
+
+        void insert(const Key &key, const std::string &value, uint8_t flags = memtable_generic::PLAIN) noexcept {
+            if (this->root == nullptr)
+                this->root = new Leaf();
+            Key sep;
+            Node *split = this->insertUtil(this->root, key, value, flags, sep);
+            if (split == nullptr)
+                return;
+            auto root = new Inner();
+            root->keys[0] = std::move(sep);
+            root->n = 1;
+            Search::pad(root->keys, root->n, FANOUT);
+            root->children[0] = this->root;
+            root->children[1] = split;
+            this->root = root;
+        }
+
+        void remove(const Key &key) noexcept {
+            this->insert(key, memtable_generic::deleted);
+        }
+
+        bool find(const Key &key, memory::InlineSlice &value) const noexcept {
+            size_t pos = 0;
+            const Leaf *leaf = this->findLeaf(key, pos);
+            if (leaf == nullptr || pos >= leaf->n || !this->equal(leaf->keys[pos], key))
+                return false;
+            value = leaf->elems[pos].second;
+            return true;
+        }
+
+        std::vector<std::pair<Key,std::string>> dump() noexcept {
+            std::vector<std::pair<Key,std::string>> ret;
+            for (auto cursor = this->cursor(); cursor->valid(); cursor->next())
+                ret.emplace_back(cursor->entry().first, cursor->entry().second.toString());
+            this->reset();
+            return ret;
+        }
+
+        std::unique_ptr<typename memtable_generic::MemTable<Key, Compare>::Cursor> cursor() const noexcept {
+            const Node *node = this->root;
+            while (node != nullptr && !node->leaf)
+                node = static_cast<const Inner *>(node)->children[0];
+            return std::make_unique<Cursor>(static_cast<const Leaf *>(node), 0);
+        }
+
+        void scanEntries(const Key &key1, const Key &key2, std::vector<typename memtable_generic::MemTable<Key, Compare>::Entry> &ret) const noexcept {
+            size_t pos = 0;
+            const Leaf *leaf = this->findLeaf(key1, pos);
+            Cursor cursor(leaf, pos);
+            for (; cursor.valid() && !this->cmp(key2, cursor.entry().first); cursor.next())
+                ret.push_back(cursor.entry());
+        }
+
+        size_t size() const noexcept {
+            return this->nr_size;
+        }
+
+        void reset() noexcept {
+            this->deleteUtil(this->root);
+            this->root = nullptr;
+            this->nr_size = 0;
+            this->release_values();
+        }
+    };
+};
+
+#endif
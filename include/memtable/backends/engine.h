@@ -1,22 +1,183 @@
 #ifndef __KVMEM_H
 #define __KVMEM_H
 
+#include <utils/arena.h>
+#include <utils/keys.h>
+#include <utils/slice.h>
+
+#include <cstring>
+#include <memory>
 #include <optional>
+#include <string>
 #include <vector>
 
 namespace memtable_generic {
     const std::string deleted = "~DELETED~";
+
+    /**
+     * What a value's bytes hold besides the plain value. Flags are kept
+     * in the entry beside the bytes, so no value a user writes can pass
+     * for one of these.
+     */
+    enum ValueFlags : uint8_t {
+        PLAIN = 0,
+        /** An expiry, as expiry::wrap() puts it, ahead of the value. */
+        EXPIRES = 1,
+        /** Merge operands, as merge::encodeOperands() lists them. */
+        OPERANDS = 2,
+    };
+
+    template <typename Key, typename Compare = typename keys::KeyTraits<Key>::Compare>
     class MemTable {
+    public:
+      /**
+       * Values of up to 15 bytes live in the entry; longer ones in the
+       * memtable's arena, which the entry points into.
+       */
+      using Entry = std::pair<Key, memory::InlineSlice>;
+
     protected:
       size_t nr_size = 0;
+      Compare cmp;
+      // Shared with the slices pinned into it, which keep it alive.
+      std::shared_ptr<memory::Arena> arena = std::make_shared<memory::Arena>();
+
+      bool equal(const Key &a, const Key &b) const noexcept {
+          return keys::equal(this->cmp, a, b);
+      }
+      // What one entry adds to the flushed block besides its value.
+      static size_t entry_size(const Key &key) noexcept {
+          return keys::KeyTraits<Key>::size(key) + sizeof(size_t);
+      }
+      // Tombstones are written as a flag, so their marker costs nothing.
+      static size_t value_size(const memory::Slice &value) noexcept {
+          return value == deleted ? 0 : value.size();
+      }
+
+      // Keep `value` inline if it fits, else copy it into the arena.
+      memory::InlineSlice store(const std::string &value, uint8_t flags) noexcept {
+          if (memory::InlineSlice::fits(value.size()))
+              return memory::InlineSlice(value, flags);
+          char *data = this->arena->allocate(value.size());
+          memcpy(data, value.data(), value.size());
+          return memory::InlineSlice(memory::Slice(data, value.size()), flags);
+      }
+
+      /** Store `value` of a new entry and count it. */
+      memory::InlineSlice admit(const Key &key, const std::string &value, uint8_t flags) noexcept {
+          this->nr_size += entry_size(key) + value_size(value);
+          return this->store(value, flags);
+      }
+
+      /**
+       * Overwrite the value of an entry. A value too long to be inline
+       * but no longer than the old one reuses the old bytes in the arena
+       * unless a reader has pinned it; else it is copied anew and the old
+       * bytes stay behind until the arena is reset.
+       */
+      void assign(memory::InlineSlice &slot, const std::string &value, uint8_t flags) noexcept {
+          this->nr_size = this->nr_size - value_size(slot) + value_size(value);
+          if (!slot.isInline() && !memory::InlineSlice::fits(value.size()) &&
+              value.size() <= slot.size() && this->arena.use_count() == 1) {
+              memcpy(const_cast<char *>(slot.data()), value.data(), value.size());
+              slot = memory::InlineSlice(memory::Slice(slot.data(), value.size()), flags);
+              return;
+          }
+          slot = this->store(value, flags);
+      }
+
+      /** Drop every value; pinned readers keep the old arena to themselves. */
+      void release_values() noexcept {
+          if (this->arena.use_count() == 1)
+              this->arena->reset();
+          else
+              this->arena = std::make_shared<memory::Arena>();
+      }
     public:
+        /**
+         * Walks the entries in key order without copying them. Any
+         * change to the memtable invalidates it.
+         */
+        class Cursor {
+        public:
+            virtual ~Cursor(){}
+            virtual bool valid() const noexcept = 0;
+            virtual const Entry &entry() const noexcept = 0;
+            virtual void next() noexcept = 0;
+        };
+
+        MemTable(const Compare &cmp = Compare()) : cmp(cmp) {}
         virtual ~MemTable(){}
         virtual size_t size() const noexcept = 0;
-        virtual void remove(const uint64_t &key) noexcept = 0;
-        virtual void insert(const uint64_t &key, const std::string &value) noexcept = 0;
-        virtual std::string search(const uint64_t &key) const noexcept = 0;
-        virtual std::vector<std::pair<uint64_t,std::string>> dump() noexcept = 0;
+        virtual void remove(const Key &key) noexcept = 0;
+        /** Store `value` for `key`, with `flags` from ValueFlags. */
+        virtual void insert(const Key &key, const std::string &value, uint8_t flags = PLAIN) noexcept = 0;
+        /** Copy out the stored value of `key`, flags included; false if absent. */
+        virtual bool find(const Key &key, memory::InlineSlice &value) const noexcept = 0;
+        virtual std::vector<std::pair<Key,std::string>> dump() noexcept = 0;
+        virtual std::unique_ptr<Cursor> cursor() const noexcept = 0;
+        /**
+         * The entries from `key1` to `key2` with their flags. Their values
+         * are only good until the memtable changes.
+         */
+        virtual void scanEntries(const Key &key1, const Key &key2, std::vector<Entry> &ret) const noexcept = 0;
         virtual void reset() noexcept = 0;
+
+        /** The values from `key1` to `key2`, copied out. */
+        void scan(const Key &key1, const Key &key2, std::vector<std::pair<Key,std::string>> &ret) const noexcept {
+            std::vector<Entry> entries;
+            this->scanEntries(key1, key2, entries);
+            for (const auto &entry : entries)
+                ret.emplace_back(entry.first, entry.second.toString());
+        }
+
+        /** The stored value of `key`, or an empty string if absent. */
+        std::string search(const Key &key) const noexcept {
+            memory::InlineSlice value;
+            return this->find(key, value) ? value.toString() : "";
+        }
+
+        /**
+         * Pin a value found in this memtable: it stays readable through
+         * `pinned` across later writes, flushes and resets. Inline values
+         * are short enough to be copied instead.
+         */
+        void pin(const memory::InlineSlice &value, memory::PinnableSlice &pinned) const {
+            if (value.isInline()) {
+                pinned.pinSelf(value.toString());
+                return;
+            }
+            auto arena = this->arena;
+            pinned.pin(value, [arena] {});
+        }
+
+        /** Bytes of the value arena, overwritten values included. */
+        size_t allocated() const noexcept {
+            return this->arena->memoryUsage();
+        }
+    };
+
+    /** In-order cursor over a binary tree of nodes with `elem`, `left` and `right`. */
+    template <typename Key, typename Node, typename Compare>
+    class TreeCursor : public MemTable<Key, Compare>::Cursor {
+    private:
+        std::vector<const Node *> path;
+
+        void descend(const Node *node) noexcept {
+            for(; node != nullptr; node = node->left)
+                this->path.push_back(node);
+        }
+    public:
+        TreeCursor(const Node *root) { this->descend(root); }
+        bool valid() const noexcept override { return !this->path.empty(); }
+        const typename MemTable<Key, Compare>::Entry &entry() const noexcept override {
+            return this->path.back()->elem;
+        }
+        void next() noexcept override {
+            const Node *node = this->path.back();
+            this->path.pop_back();
+            this->descend(node->right);
+        }
     };
 };
 
@@ -0,0 +1,55 @@
+#ifndef __HASHSKIPLIST_H
+#define __HASHSKIPLIST_H
+
+#include <functional>
+#include <unordered_map>
+
+#include "skiplist.h"
+
+namespace skl {
+    /**
+     * A skip list with a hash index from each key to its node. Point
+     * lookups and overwrites of keys already present go through the
+     * index in O(1); only new keys walk the list, which keeps the order
+     * flush and scan need. Keys are hashed with std::hash, so keys the
+     * comparator treats as equal must be bytewise equal, as
+     * keys::KeyComparator already requires.
+     */
+    template <typename Key, typename Compare = typename keys::KeyTraits<Key>::Compare>
+    class HashSkipList : public SkipList<Key, Compare> {
+    private:
+        using SkipNode = typename SkipList<Key, Compare>::SkipNode;
+        std::unordered_map<Key, SkipNode *, std::hash<Key>> index;
+
+    public:
+        HashSkipList(const uint64_t maxlevels = 20, const double p = 0.5, const Compare &cmp = Compare())
+            : SkipList<Key, Compare>(maxlevels, p, cmp) {}
+
+        void remove(const Key &key) noexcept {
+            this->insert(key, memtable_generic::deleted);
+        }
+
+        void insert(const Key &key, const std::string &value, uint8_t flags = memtable_generic::PLAIN) noexcept {
+            auto it = this->index.find(key);
+            if (it != this->index.end())
+                this->assign(it->second->elem.second, value, flags);
+            else
+                this->index.emplace(key, this->insertUtil(key, value, flags));
+        }
+
+        bool find(const Key &key, memory::InlineSlice &value) const noexcept {
+            auto it = this->index.find(key);
+            if (it == this->index.end())
+                return false;
+            value = it->second->elem.second;
+            return true;
+        }
+
+        void reset() noexcept {
+            SkipList<Key, Compare>::reset();
+            this->index.clear();
+        }
+    };
+};
+
+#endif
@@ -1,4 +1,5 @@
 #ifndef __RBTREE_H
+#define __RBTREE_H
 
 #include <cassert>
 #include <optional>
@@ -9,7 +10,8 @@
 
 namespace rb
 {
-    class RBTree : public memtable_generic::MemTable
+    template <typename Key, typename Compare = typename keys::KeyTraits<Key>::Compare>
+    class RBTree : public memtable_generic::MemTable<Key, Compare>
     {
     private:
         enum RBColor
@@ -21,11 +23,11 @@ namespace rb
         struct RBNode
         {
             enum RBColor color;
-            std::pair<uint64_t, std::string> elem;
+            std::pair<Key, memory::InlineSlice> elem;
             uint64_t height;
             RBNode *left, *right;
 
-            RBNode(const uint64_t &key, const std::string &value, enum RBColor color) noexcept
+            RBNode(const Key &key, const memory::InlineSlice &value, enum RBColor color) noexcept
             {
                 this->elem = std::make_pair(key, value);
                 this->color = color;
@@ -110,11 +112,11 @@ namespace rb
             return root;
         }
 
-        const RBNode *searchUtil(const RBNode *root, const uint64_t &key) const noexcept
+        const RBNode *searchUtil(const RBNode *root, const Key &key) const noexcept
         {
-            if (root == nullptr || root->elem.first == key)
+            if (root == nullptr || this->equal(root->elem.first, key))
                 return root;
-            else if (key < root->elem.first)
+            else if (this->cmp(key, root->elem.first))
                 return searchUtil(root->left, key);
             else
                 return searchUtil(root->right, key);
@@ -153,7 +155,7 @@ namespace rb
             return root;
         }
 
-        RBNode *insertUtil(RBNode *root, const uint64_t &key, const std::string &value)
+        RBNode *insertUtil(RBNode *root, const Key &key, const std::string &value, uint8_t flags)
         {
 
             if (root == nullptr)
@@ -163,41 +165,42 @@ namespace rb
                 if (this->nr_size == 0)
                     color = BLACK;
 
-                this->nr_size += (sizeof(uint64_t) + sizeof(size_t));
-                if (value != memtable_generic::deleted)
-                {
-                    this->nr_size += value.size();
-                }
-
-                return new RBNode(key, value, color);
+                return new RBNode(key, this->admit(key, value, flags), color);
             }
 
-            if (key == root->elem.first)
-            {
-                uint64_t prev_size = root->elem.second.size();
-                uint64_t cur_size = value.size();
-                this->nr_size += (cur_size - prev_size);
-                root->elem.second = value;
-            }
+            if (this->equal(key, root->elem.first))
+                this->assign(root->elem.second, value, flags);
 
-            else if (key < root->elem.first)
-                root->left = insertUtil(root->left, key, value);
+            else if (this->cmp(key, root->elem.first))
+                root->left = insertUtil(root->left, key, value, flags);
             else
-                root->right = insertUtil(root->right, key, value);
+                root->right = insertUtil(root->right, key, value, flags);
             update_height(root);
             return adjust(root);
         }
 
-        void dumpUtil(const RBNode *root, std::vector<std::pair<uint64_t, std::string>> &block) noexcept
+        void dumpUtil(const RBNode *root, std::vector<std::pair<Key, std::string>> &block) noexcept
         {
             if (root == nullptr)
                 return;
             dumpUtil(root->left, block);
-            block.push_back(root->elem);
+            block.emplace_back(root->elem.first, root->elem.second.toString());
             dumpUtil(root->right, block);
             delete root;
         }
 
+        void scanUtil(const RBNode *root, const Key &key1, const Key &key2, std::vector<typename memtable_generic::MemTable<Key, Compare>::Entry> &ret) const noexcept
+        {
+            if (root == nullptr)
+                return;
+            if (this->cmp(key1, root->elem.first))
+                scanUtil(root->left, key1, key2, ret);
+            if (!this->cmp(root->elem.first, key1) && !this->cmp(key2, root->elem.first))
+                ret.push_back(root->elem);
+            if (this->cmp(root->elem.first, key2))
+                scanUtil(root->right, key1, key2, ret);
+        }
+
         void deleteUtil(const RBNode *root)
         {
             if (root == nullptr)
@@ -208,7 +211,7 @@ namespace rb
         }
 
     public:
-        RBTree()
+        RBTree(const Compare &cmp = Compare()) : memtable_generic::MemTable<Key, Compare>(cmp)
         {
             this->root = nullptr;
             this->nr_size = 0;
@@ -219,34 +222,45 @@ namespace rb
             this->reset();
         }
 
-        void insert(const uint64_t &key, const std::string &value) noexcept
+        void insert(const Key &key, const std::string &value, uint8_t flags = memtable_generic::PLAIN) noexcept
         {
-            this->root = insertUtil(this->root, key, value);
+            this->root = insertUtil(this->root, key, value, flags);
         }
 
-        void remove(const uint64_t &key) noexcept
+        void remove(const Key &key) noexcept
         {
-            this->root = insertUtil(this->root, key, memtable_generic::deleted);
+            this->root = insertUtil(this->root, key, memtable_generic::deleted, memtable_generic::PLAIN);
         }
 
-        std::string search(const uint64_t &key) const noexcept
+        bool find(const Key &key, memory::InlineSlice &value) const noexcept
         {
             const RBNode *node = this->searchUtil(this->root, key);
             if (node == nullptr)
-                return "";
-            else
-                return node->elem.second;
+                return false;
+            value = node->elem.second;
+            return true;
         }
 
-        std::vector<std::pair<uint64_t,std::string>> dump() noexcept
+        std::vector<std::pair<Key,std::string>> dump() noexcept
         {
-            auto ret = std::vector<std::pair<uint64_t,std::string>>();
+            auto ret = std::vector<std::pair<Key,std::string>>();
             dumpUtil(this->root, ret);
             this->nr_size = 0;
             this->root = nullptr;
+            this->release_values();
             return ret;
         }
 
+        std::unique_ptr<typename memtable_generic::MemTable<Key, Compare>::Cursor> cursor() const noexcept
+        {
+            return std::make_unique<memtable_generic::TreeCursor<Key, RBNode, Compare>>(this->root);
+        }
+
+        void scanEntries(const Key &key1, const Key &key2, std::vector<typename memtable_generic::MemTable<Key, Compare>::Entry> &ret) const noexcept
+        {
+            scanUtil(this->root, key1, key2, ret);
+        }
+
         size_t size() const noexcept
         {
             return this->nr_size;
@@ -257,6 +271,7 @@ namespace rb
             deleteUtil(this->root);
             this->root = nullptr;
             this->nr_size = 0;
+            this->release_values();
         }
     };
 };
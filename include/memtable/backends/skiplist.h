@@ -1,16 +1,18 @@
 #ifndef __SKIPLIST_H
+#define __SKIPLIST_H
 
 #include <random>
 
 #include "engine.h"
 
 namespace skl {
-    class SkipList : public memtable_generic::MemTable {
-    private:
+    template <typename Key, typename Compare = typename keys::KeyTraits<Key>::Compare>
+    class SkipList : public memtable_generic::MemTable<Key, Compare> {
+    protected:
         struct SkipNode {
-            std::pair<uint64_t,std::string> elem;
+            std::pair<Key,memory::InlineSlice> elem;
             std::vector<SkipNode *> forward;
-            SkipNode(const uint64_t &key, const std::string &value, uint64_t maxlevels) {
+            SkipNode(const Key &key, const memory::InlineSlice &value, uint64_t maxlevels) {
                 this->elem = std::make_pair(key, value);
                 this->forward = decltype(this->forward)(maxlevels, nullptr);
             }
@@ -20,6 +22,17 @@ namespace skl {
             }
         };
 
+        class Cursor : public memtable_generic::MemTable<Key, Compare>::Cursor {
+        private:
+            const SkipNode *node;
+        public:
+            Cursor(const SkipNode *node) : node(node) {}
+            bool valid() const noexcept override { return this->node != nullptr; }
+            const typename memtable_generic::MemTable<Key, Compare>::Entry &entry() const noexcept override { return this->node->elem; }
+            void next() noexcept override { this->node = this->node->forward[0]; }
+        };
+
+    private:
         const uint64_t maxlevels;
         uint64_t levels = 0;
         SkipNode *header;
@@ -39,62 +52,54 @@ namespace skl {
             return next_level;
         }
 
-        void insertUtil(const uint64_t &key, const std::string &value) {
+    protected:
+        /** Insert or overwrite `key`, returning the node that holds it. */
+        SkipNode *insertUtil(const Key &key, const std::string &value, uint8_t flags) {
             auto target = roll_dice();
             auto updates = decltype(header->forward)(this->maxlevels, nullptr);
             auto current = this->header;
 
-            for (uint64_t i = this->levels - 1; i >= 0; i--) {
-                while (current->forward[i] != nullptr && current->forward[i]->elem.first < key)
+            for (uint64_t i = this->levels; i-- > 0;) {
+                while (current->forward[i] != nullptr && this->cmp(current->forward[i]->elem.first, key))
                     current = current->forward[i];
                 updates[i] = current;
             }
 
             current = current->forward[0];
 
-            if (current == nullptr || current->elem.first != key) {
+            if (current == nullptr || !this->equal(current->elem.first, key)) {
                 if (target > this->levels) {
                     for (uint64_t i = this->levels; i < target; i++)
                         updates[i] = header;
                     this->levels = target;
                 }
 
-                auto node = new SkipNode(key, value, this->maxlevels);
-                this->nr_size += (sizeof(uint64_t) + sizeof(size_t));
-                if (value != memtable_generic::deleted) {
-                    this->nr_size += value.size();
-                }
+                auto node = new SkipNode(key, this->admit(key, value, flags), this->maxlevels);
 
                 for (uint64_t i = 0; i < target; i++) {
                     node->forward[i] = updates[i]->forward[i];
                     updates[i]->forward[i] = node;
                 }
-
-            } else {
-                uint64_t prev_size = current->elem.second.size();
-                uint64_t cur_size = value.size();
-                this->nr_size += (cur_size - prev_size);
-                current->elem.second = value;
+                return node;
             }
+            this->assign(current->elem.second, value, flags);
+            return current;
         }
 
-        void dumpUtil(const SkipNode *node, std::vector<std::pair<uint64_t,std::string>> &block) {
-            if (node == nullptr)
-                return;
-            dumpUtil(node->forward[0], block);
-            block.push_back(node->elem);
-            delete node;
-        }
-
+    private:
+        // Iterative: a list of a few hundred thousand nodes would
+        // overflow the stack if walked recursively.
         void deleteUtil(const SkipNode *node) {
-            if (node == nullptr)
-                return;
-            deleteUtil(node->forward[0]);
-            delete node;
+            while (node != nullptr) {
+                const SkipNode *next = node->forward[0];
+                delete node;
+                node = next;
+            }
         }
 
     public:
-        SkipList(const uint64_t maxlevels, const double p) : maxlevels(maxlevels) {
+        SkipList(const uint64_t maxlevels = 20, const double p = 0.5, const Compare &cmp = Compare())
+            : memtable_generic::MemTable<Key, Compare>(cmp), maxlevels(maxlevels) {
             this->gen = std::mt19937_64(rd());
             this->header = new SkipNode(maxlevels);
             this->exp = std::bernoulli_distribution(p);
@@ -105,34 +110,48 @@ namespace skl {
             delete this->header;
         }
 
-        void remove(const uint64_t &key) noexcept {
-            this->insertUtil(key, memtable_generic::deleted);
+        void remove(const Key &key) noexcept {
+            this->insertUtil(key, memtable_generic::deleted, memtable_generic::PLAIN);
         }
 
-        void insert(const uint64_t &key, const std::string &value) noexcept {
-            this->insertUtil(key, value);
+        void insert(const Key &key, const std::string &value, uint8_t flags = memtable_generic::PLAIN) noexcept {
+            this->insertUtil(key, value, flags);
         }
 
-        std::string search(const uint64_t &key) const noexcept {
+        bool find(const Key &key, memory::InlineSlice &value) const noexcept {
             auto current = this->header;
-            for (uint64_t i = this->levels - 1; i >= 0; i--) {
+            for (uint64_t i = this->levels; i-- > 0;) {
                 while (current->forward[i] != nullptr &&
-                       current->forward[i]->elem.first <= key) {
+                       !this->cmp(key, current->forward[i]->elem.first)) {
                     current = current->forward[i];
                 }
-                if (current->elem.first == key)
-                    return current->elem.second;
+                if (current != this->header && this->equal(current->elem.first, key)) {
+                    value = current->elem.second;
+                    return true;
+                }
             }
-            return "";
+            return false;
         }
 
-        std::vector<std::pair<uint64_t, std::string>> dump() noexcept {
-            auto ret = std::vector<std::pair<uint64_t, std::string>>();
-            dumpUtil(this->header->forward[0], ret);
-            this->nr_size = 0;
+        std::vector<std::pair<Key, std::string>> dump() noexcept {
+            auto ret = std::vector<std::pair<Key, std::string>>();
+            for (auto node = this->header->forward[0]; node != nullptr; node = node->forward[0])
+                ret.emplace_back(node->elem.first, node->elem.second.toString());
+            this->reset();
             return ret;
         }
 
+        std::unique_ptr<typename memtable_generic::MemTable<Key, Compare>::Cursor> cursor() const noexcept {
+            return std::make_unique<Cursor>(this->header->forward[0]);
+        }
+
+        void scanEntries(const Key &key1, const Key &key2, std::vector<typename memtable_generic::MemTable<Key, Compare>::Entry> &ret) const noexcept {
+            for (auto node = this->header->forward[0]; node != nullptr && !this->cmp(key2, node->elem.first); node = node->forward[0]) {
+                if (!this->cmp(node->elem.first, key1))
+                    ret.push_back(node->elem);
+            }
+        }
+
         size_t size() const noexcept {
             return this->nr_size;
         }
@@ -141,7 +160,9 @@ namespace skl {
             deleteUtil(this->header->forward[0]);
             delete this->header;
             this->header = new SkipNode(maxlevels);
+            this->levels = 0;
             this->nr_size = 0;
+            this->release_values();
         }
     };
 };
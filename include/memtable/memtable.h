@@ -1,7 +1,10 @@
 #ifndef __MEMTABLE_H
+#define __MEMTABLE_H
 
 #include "backends/avltree.h"
+#include "backends/bptree.h"
 #include "backends/engine.h"
+#include "backends/hashskiplist.h"
 #include "backends/rbtree.h"
 #include "backends/skiplist.h"
 
@@ -9,12 +12,32 @@ namespace memtable{
     enum MemTable_Backend_Type{
         MEMTABLE_USE_AVLTREE = 0,
         MEMTABLE_USE_RBTREE,
-        MEMTABLE_USE_SKIPLIST
+        MEMTABLE_USE_SKIPLIST,
+        MEMTABLE_USE_BPTREE,
+        MEMTABLE_USE_HASH_SKIPLIST
     };
     using memtable_generic::MemTable;
     using avl::AVLTree;
+    using bpt::BPlusTree;
     using rb::RBTree;
+    using skl::HashSkipList;
     using skl::SkipList;
+
+    template <typename Key, typename Compare = typename keys::KeyTraits<Key>::Compare>
+    std::unique_ptr<MemTable<Key, Compare>> make(MemTable_Backend_Type type, const Compare &cmp = Compare()){
+        switch(type){
+        case MEMTABLE_USE_AVLTREE:
+            return std::make_unique<AVLTree<Key, Compare>>(cmp);
+        case MEMTABLE_USE_SKIPLIST:
+            return std::make_unique<SkipList<Key, Compare>>(20, 0.5, cmp);
+        case MEMTABLE_USE_BPTREE:
+            return std::make_unique<BPlusTree<Key, Compare>>(cmp);
+        case MEMTABLE_USE_HASH_SKIPLIST:
+            return std::make_unique<HashSkipList<Key, Compare>>(20, 0.5, cmp);
+        default:
+            return std::make_unique<RBTree<Key, Compare>>(cmp);
+        }
+    }
 };
 
 #endif
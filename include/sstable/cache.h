@@ -0,0 +1,79 @@
+#ifndef __SSTABLE_CACHE_H
+#define __SSTABLE_CACHE_H
+
+#include <utils/budget.h>
+#include <utils/slice.h>
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace sstable {
+/**
+ * LRU cache of values read from blocks, keyed by block and offset.
+ * Point lookups fill it; scans and compactions read past it. Everything
+ * it holds is charged to the memory budget, and it evicts to stay under
+ * both its own capacity and what the budget has left. An entry pinned by
+ * a reader outlives its eviction until the reader lets go, and a pinned
+ * cache outlives whoever dropped it: each pin holds a reference, so the
+ * cache must be owned by a shared_ptr.
+ */
+class ValueCache : public std::enable_shared_from_this<ValueCache> {
+private:
+  /**
+   * One cached value. Its bytes follow the header in the same
+   * allocation, and the header links it into the LRU list, so an entry
+   * costs one allocation besides its map slot.
+   */
+  struct Entry {
+    Entry *prev;
+    Entry *next;
+    uint64_t block;
+    uint64_t offset;
+    size_t size;
+    size_t pins;
+    bool cached;
+    char *data() { return reinterpret_cast<char *>(this + 1); }
+  };
+  struct Hash {
+    size_t operator()(const std::pair<uint64_t, uint64_t> &k) const {
+      return std::hash<uint64_t>()(k.first * 0x9e3779b97f4a7c15ull ^ k.second);
+    }
+  };
+
+  std::mutex mutex;
+  // Most recently used first; the list is circular through `lru`.
+  Entry lru;
+  std::unordered_map<std::pair<uint64_t, uint64_t>, Entry *, Hash> map;
+  uint64_t capacity;
+  uint64_t used;
+  std::shared_ptr<memory::MemoryBudget> budget;
+
+  static uint64_t charge(const Entry *e);
+  void unlink(Entry *e);
+  void pushFront(Entry *e);
+  void evict(uint64_t room);
+  void unpin(Entry *e);
+
+public:
+  /** Bookkeeping charged per entry on top of its value. */
+  static const uint64_t ENTRY_OVERHEAD = 64;
+
+  ValueCache(uint64_t capacity, std::shared_ptr<memory::MemoryBudget> budget);
+  ~ValueCache();
+  bool lookup(uint64_t block, uint64_t offset, std::string &value);
+  /** Like lookup(), but `value` views the entry instead of copying it. */
+  bool lookup(uint64_t block, uint64_t offset, memory::PinnableSlice &value);
+  void insert(uint64_t block, uint64_t offset, const std::string &value);
+  /** Evict until the budget is no longer exceeded, or the cache is empty. */
+  void shrink();
+  void setBudget(std::shared_ptr<memory::MemoryBudget> budget);
+  uint64_t usage();
+  uint64_t getCapacity() const { return this->capacity; }
+};
+}; // namespace sstable
+
+#endif
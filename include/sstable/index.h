@@ -0,0 +1,370 @@
+#ifndef __SSTABLE_INDEX_H
+#define __SSTABLE_INDEX_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace sstable {
+/**
+ * Fixed part of a block file. It is followed by `filter_size` bytes of
+ * bloom filter, then `index_size` bytes of BlockIndex, then the values.
+ * The key range is taken from the index rather than stored twice.
+ * `max_expiry` is the latest expiry of any entry, expiry::NEVER if one
+ * has no TTL.
+ */
+struct SSBlockHeader {
+  uint64_t timestamp;
+  uint64_t nr_keys;
+  uint64_t nr_tombstones;
+  uint64_t index_size;
+  uint64_t max_expiry;
+  uint64_t filter_size;
+};
+
+namespace coding {
+inline void putFixed32(std::string &out, uint32_t v) {
+  out.append(reinterpret_cast<const char *>(&v), sizeof(v));
+}
+
+inline void putFixed64(std::string &out, uint64_t v) {
+  out.append(reinterpret_cast<const char *>(&v), sizeof(v));
+}
+
+inline uint32_t getFixed32(const char *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline uint64_t getFixed64(const char *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline void putVarint(std::string &out, uint64_t v) {
+  while (v >= 0x80) {
+    out.push_back(static_cast<char>(v | 0x80));
+    v >>= 7;
+  }
+  out.push_back(static_cast<char>(v));
+}
+
+inline uint64_t getVarint(const char *&p) {
+  uint64_t v = 0;
+  for (int shift = 0;; shift += 7) {
+    uint8_t byte = static_cast<uint8_t>(*p++);
+    v |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0)
+      return v;
+  }
+}
+
+/**
+ * getVarint() for untrusted input: returns false, with `p` unspecified,
+ * if the varint runs past `end` or over 64 bits.
+ */
+inline bool getVarint(const char *&p, const char *end, uint64_t &v) {
+  v = 0;
+  for (int shift = 0; shift < 64 && p < end; shift += 7) {
+    uint8_t byte = static_cast<uint8_t>(*p++);
+    v |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0)
+      return true;
+  }
+  return false;
+}
+}; // namespace coding
+
+const uint64_t INDEX_RESTART_INTERVAL = 16;
+
+/**
+ * What a block stores for a key, as flags: the value itself, or a
+ * ValuePointer into the value log, either one preceded by a fixed64
+ * expiry when VALUE_EXPIRES is set. VALUE_MERGE entries hold a list of
+ * merge operands instead and carry no other flag.
+ */
+enum ValueKind {
+  VALUE_INLINE = 0,
+  VALUE_POINTER = 1,
+  VALUE_EXPIRES = 2,
+  VALUE_MERGE = 4
+};
+const unsigned VALUE_KIND_BITS = 3;
+
+/**
+ * Sorted map from the keys of one block to where their values sit,
+ * relative to the start of the value region. Byte-string keys are
+ * prefix-compressed: each entry stores only what differs from the key
+ * before it, and every INDEX_RESTART_INTERVAL-th entry stores its key
+ * whole so lookups can binary search those restart points and decode
+ * at most one interval.
+ *
+ * Entry:   varint shared | varint unshared | varint (value size << 3 | kind)
+ *          | varint value offset (restart entries only) | key suffix
+ * Trailer: fixed32 restart positions... | fixed32 nr_restarts
+ *          | fixed64 nr_entries
+ */
+template <typename Key, typename Compare> class BlockIndex {
+  static_assert(std::is_same<Key, std::string>::value,
+                "only byte-string keys are prefix-compressed");
+
+private:
+  Compare cmp;
+  std::string data;
+  std::vector<uint32_t> restarts;
+  uint64_t count;
+  uint64_t end;
+  Key last_key;
+
+  Key restartKey(size_t r) const {
+    const char *p = this->data.data() + this->restarts[r];
+    coding::getVarint(p);
+    uint64_t unshared = coding::getVarint(p);
+    coding::getVarint(p);
+    coding::getVarint(p);
+    return Key(p, unshared);
+  }
+
+public:
+  class Iterator {
+  private:
+    const BlockIndex *index;
+    size_t pos;
+    uint64_t nr;
+    bool is_valid;
+    Key cur_key;
+    uint64_t cur_offset;
+    uint64_t cur_size;
+    ValueKind cur_kind;
+
+    friend class BlockIndex;
+    Iterator(const BlockIndex *index, size_t pos, uint64_t nr)
+        : index(index), pos(pos), nr(nr), is_valid(false), cur_offset(0),
+          cur_size(0), cur_kind(VALUE_INLINE) {
+      this->next();
+    }
+
+  public:
+    Iterator() : index(nullptr), pos(0), nr(0), is_valid(false) {}
+    bool valid() const { return this->is_valid; }
+    const Key &key() const { return this->cur_key; }
+    uint64_t offset() const { return this->cur_offset; }
+    uint64_t size() const { return this->cur_size; }
+    ValueKind kind() const { return this->cur_kind; }
+
+    void next() {
+      if (this->nr >= this->index->count) {
+        this->is_valid = false;
+        return;
+      }
+      const char *p = this->index->data.data() + this->pos;
+      uint64_t shared = coding::getVarint(p);
+      uint64_t unshared = coding::getVarint(p);
+      uint64_t size = coding::getVarint(p);
+      if (this->nr % INDEX_RESTART_INTERVAL == 0)
+        this->cur_offset = coding::getVarint(p);
+      else
+        this->cur_offset += this->cur_size;
+      this->cur_size = size >> VALUE_KIND_BITS;
+      this->cur_kind =
+          static_cast<ValueKind>(size & ((1u << VALUE_KIND_BITS) - 1));
+      this->cur_key.resize(shared);
+      this->cur_key.append(p, unshared);
+      this->pos = p + unshared - this->index->data.data();
+      this->nr++;
+      this->is_valid = true;
+    }
+  };
+
+  BlockIndex(const Compare &cmp) : cmp(cmp), count(0), end(0) {}
+
+  /** Append the next key in order, whose value takes `size` bytes. */
+  void add(const Key &key, uint64_t size, ValueKind kind) {
+    size_t shared = 0;
+    if (this->count % INDEX_RESTART_INTERVAL == 0) {
+      this->restarts.push_back(this->data.size());
+    } else {
+      size_t limit = std::min(key.size(), this->last_key.size());
+      while (shared < limit && key[shared] == this->last_key[shared])
+        shared++;
+    }
+    coding::putVarint(this->data, shared);
+    coding::putVarint(this->data, key.size() - shared);
+    coding::putVarint(this->data, size << VALUE_KIND_BITS | kind);
+    if (this->count % INDEX_RESTART_INTERVAL == 0)
+      coding::putVarint(this->data, this->end);
+    this->data.append(key, shared, std::string::npos);
+    this->last_key = key;
+    this->end += size;
+    this->count++;
+  }
+
+  std::string encode() const {
+    std::string ret = this->data;
+    for (auto r : this->restarts)
+      coding::putFixed32(ret, r);
+    coding::putFixed32(ret, this->restarts.size());
+    coding::putFixed64(ret, this->count);
+    return ret;
+  }
+
+  void decode(const std::string &bytes) {
+    const char *tail = bytes.data() + bytes.size();
+    this->count = coding::getFixed64(tail - sizeof(uint64_t));
+    uint32_t nr_restarts =
+        coding::getFixed32(tail - sizeof(uint64_t) - sizeof(uint32_t));
+    size_t entries_len = bytes.size() - (nr_restarts + 1) * sizeof(uint32_t) -
+                         sizeof(uint64_t);
+    this->restarts.resize(nr_restarts);
+    for (uint32_t r = 0; r < nr_restarts; r++)
+      this->restarts[r] = coding::getFixed32(bytes.data() + entries_len +
+                                             r * sizeof(uint32_t));
+    this->data = bytes.substr(0, entries_len);
+
+    Iterator it = this->begin();
+    if (!this->restarts.empty())
+      it = Iterator(this, this->restarts.back(),
+                    (this->restarts.size() - 1) * INDEX_RESTART_INTERVAL);
+    for (; it.valid(); it.next()) {
+      this->last_key = it.key();
+      this->end = it.offset() + it.size();
+    }
+  }
+
+  uint64_t size() const { return this->count; }
+  /** Bytes held in memory, for the memory budget. */
+  size_t memoryUsage() const {
+    return this->data.capacity() + this->restarts.capacity() * sizeof(uint32_t) +
+           this->last_key.capacity();
+  }
+  Key first() const { return this->begin().key(); }
+  const Key &last() const { return this->last_key; }
+
+  Iterator begin() const { return Iterator(this, 0, 0); }
+
+  /** First entry whose key is not less than `key`. */
+  Iterator seek(const Key &key) const {
+    size_t lo = 0, hi = this->restarts.size();
+    while (hi - lo > 1) {
+      size_t mid = (lo + hi) / 2;
+      if (this->cmp(this->restartKey(mid), key))
+        lo = mid;
+      else
+        hi = mid;
+    }
+    if (this->restarts.empty())
+      return this->begin();
+    Iterator it(this, this->restarts[lo], lo * INDEX_RESTART_INTERVAL);
+    while (it.valid() && this->cmp(it.key(), key))
+      it.next();
+    return it;
+  }
+};
+
+/**
+ * Integer keys keep a flat array of (key, offset) pairs, so a lookup is
+ * a plain binary search with no decoding.
+ *
+ * Layout: (fixed64 key, fixed64 offset)... | fixed64 end of values.
+ * The top three bits of an offset hold the ValueKind flags.
+ */
+template <typename Compare> class BlockIndex<uint64_t, Compare> {
+private:
+  Compare cmp;
+  std::vector<std::pair<uint64_t, uint64_t>> entries;
+  uint64_t end;
+
+  static const unsigned KIND_SHIFT = 64 - VALUE_KIND_BITS;
+  static const uint64_t KIND_MASK = ~0ull << KIND_SHIFT;
+
+public:
+  class Iterator {
+  private:
+    const BlockIndex *index;
+    size_t i;
+
+    friend class BlockIndex;
+    Iterator(const BlockIndex *index, size_t i) : index(index), i(i) {}
+
+  public:
+    Iterator() : index(nullptr), i(0) {}
+    bool valid() const {
+      return this->index != nullptr && this->i < this->index->entries.size();
+    }
+    const uint64_t &key() const { return this->index->entries[this->i].first; }
+    uint64_t offset() const {
+      return this->index->entries[this->i].second & ~KIND_MASK;
+    }
+    uint64_t size() const {
+      return (this->i + 1 < this->index->entries.size()
+                  ? this->index->entries[this->i + 1].second & ~KIND_MASK
+                  : this->index->end) -
+             this->offset();
+    }
+    ValueKind kind() const {
+      return static_cast<ValueKind>(this->index->entries[this->i].second >>
+                                    KIND_SHIFT);
+    }
+    void next() { this->i++; }
+  };
+
+  BlockIndex(const Compare &cmp) : cmp(cmp), end(0) {}
+
+  void add(const uint64_t &key, uint64_t size, ValueKind kind) {
+    this->entries.emplace_back(key,
+                               this->end | (uint64_t)kind << KIND_SHIFT);
+    this->end += size;
+  }
+
+  std::string encode() const {
+    // Sized once and filled in place; appending entry by entry costs
+    // more than the copying itself.
+    std::string ret((2 * this->entries.size() + 1) * sizeof(uint64_t), '\0');
+    char *p = &ret[0];
+    for (const auto &e : this->entries) {
+      memcpy(p, &e.first, sizeof(uint64_t));
+      memcpy(p + sizeof(uint64_t), &e.second, sizeof(uint64_t));
+      p += 2 * sizeof(uint64_t);
+    }
+    memcpy(p, &this->end, sizeof(uint64_t));
+    return ret;
+  }
+
+  void decode(const std::string &bytes) {
+    size_t n = (bytes.size() - sizeof(uint64_t)) / (2 * sizeof(uint64_t));
+    const char *p = bytes.data();
+    this->entries.resize(n);
+    for (size_t i = 0; i < n; i++, p += 2 * sizeof(uint64_t))
+      this->entries[i] = std::make_pair(coding::getFixed64(p),
+                                        coding::getFixed64(p + sizeof(uint64_t)));
+    this->end = coding::getFixed64(p);
+  }
+
+  uint64_t size() const { return this->entries.size(); }
+  size_t memoryUsage() const {
+    return this->entries.capacity() * sizeof(this->entries[0]);
+  }
+  uint64_t first() const { return this->entries.front().first; }
+  const uint64_t &last() const { return this->entries.back().first; }
+
+  Iterator begin() const { return Iterator(this, 0); }
+
+  Iterator seek(const uint64_t &key) const {
+    auto cmp = this->cmp;
+    auto it = std::lower_bound(
+        this->entries.begin(), this->entries.end(), key,
+        [&cmp](const std::pair<uint64_t, uint64_t> &e, const uint64_t &k) {
+          return cmp(e.first, k);
+        });
+    return Iterator(this, it - this->entries.begin());
+  }
+};
+}; // namespace sstable
+
+#endif
@@ -0,0 +1,132 @@
+#ifndef __SSTABLE_IO_H
+#define __SSTABLE_IO_H
+
+#include <sstable/ratelimiter.h>
+#include <utils/threadpool.h>
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace sstable {
+namespace io {
+enum Backend { SYNC = 0, PREAD_POOL = 1, IO_URING = 2 };
+
+const size_t DIRECT_IO_ALIGNMENT = 4096;
+const size_t WRITE_BUFFER_SIZE = 1024 * 1024;
+
+/**
+ * One positional read. `size` bytes starting at `offset` of `fd` are
+ * stored into `result`; `ok` is false if the read came back short.
+ * `cache_id` names the block read from for the value cache; 0 keeps the
+ * result out of it.
+ */
+struct ReadRequest {
+  int fd;
+  uint64_t offset;
+  size_t size;
+  std::string result;
+  bool ok;
+  uint64_t cache_id = 0;
+};
+
+/**
+ * Sequential writer used for block files. In direct mode the data is
+ * staged in an aligned buffer and written with O_DIRECT, so freshly
+ * written blocks (mostly compaction output) bypass the page cache.
+ * Every buffer drained to disk is first charged to the rate limiter.
+ */
+class WritableFile {
+private:
+  int fd;
+  bool direct;
+  RateLimiter *limiter;
+  IOPriority pri;
+  char *buffer;
+  size_t used;
+  uint64_t written;
+  uint64_t delayed;
+
+  bool drain(size_t size);
+
+public:
+  WritableFile(const std::string &filename, bool direct, RateLimiter *limiter,
+               IOPriority pri);
+  ~WritableFile();
+  bool append(const char *data, size_t size);
+  bool close();
+  /** Microseconds this file spent waiting on the rate limiter. */
+  uint64_t delayedMicros() const { return this->delayed; }
+};
+
+/**
+ * Opens and reads block files. `direct` applies to the files it creates;
+ * reads go through the page cache unless direct reads are asked for too.
+ */
+class IOBackend {
+protected:
+  bool direct;
+  bool direct_reads = false;
+  std::shared_ptr<RateLimiter> limiter;
+
+  void readAll(ReadRequest &req) const;
+
+public:
+  IOBackend(bool direct) : direct(direct) {}
+  virtual ~IOBackend() {}
+
+  bool isDirect() const { return this->direct; }
+  void setDirectReads(bool direct_reads) { this->direct_reads = direct_reads; }
+  void setRateLimiter(std::shared_ptr<RateLimiter> limiter) {
+    this->limiter = limiter;
+  }
+  int open(const std::string &filename) const;
+  void close(int fd) const;
+  uint64_t fileSize(int fd) const;
+  std::unique_ptr<WritableFile> create(const std::string &filename,
+                                       IOPriority pri) const;
+
+  std::string read(int fd, uint64_t offset, size_t size);
+  /**
+   * Complete every request in `reqs`. Backends are free to issue them
+   * concurrently; the call returns only when all of them are done.
+   */
+  virtual void submit(std::vector<ReadRequest> &reqs);
+};
+
+class ThreadPoolIO : public IOBackend {
+private:
+  threadpool::ThreadPool pool;
+
+public:
+  ThreadPoolIO(bool direct, size_t nr_threads);
+  void submit(std::vector<ReadRequest> &reqs) override;
+};
+
+#if defined(__linux__)
+class UringIO : public IOBackend {
+private:
+  struct Ring;
+  std::unique_ptr<Ring> ring;
+  std::mutex mutex;
+
+public:
+  UringIO(bool direct, unsigned entries);
+  ~UringIO();
+  bool valid() const;
+  void submit(std::vector<ReadRequest> &reqs) override;
+};
+#endif
+
+/**
+ * Build the backend asked for, falling back to the pread thread pool
+ * when io_uring is unavailable on this kernel or platform.
+ */
+std::shared_ptr<IOBackend> make_backend(Backend backend, bool direct,
+                                        size_t nr_threads);
+}; // namespace io
+}; // namespace sstable
+
+#endif
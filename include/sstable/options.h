@@ -0,0 +1,104 @@
+#ifndef __SSTABLE_OPTIONS_H
+#define __SSTABLE_OPTIONS_H
+
+#include <memtable/memtable.h>
+#include <sstable/index.h>
+#include <sstable/io.h>
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace sstable {
+enum Policy { TIERING = 0, LEVELING = 1, UNIVERSAL = 2 };
+
+/**
+ * Run picking for Universal levels. Percentages follow RocksDB's
+ * universal compaction: a run joins the merge while it is at most
+ * `size_ratio` percent bigger than the runs picked so far, and all runs
+ * are merged once the newer ones add up to `max_size_amplification`
+ * percent of the oldest.
+ */
+struct UniversalOptions {
+  unsigned size_ratio = 1;
+  size_t min_merge_width = 2;
+  unsigned max_size_amplification = 200;
+};
+
+/** Bytes of bloom filter a block gets unless told otherwise. */
+const uint64_t BLOOMFILTER_SIZE = 10240;
+/** Bytes ahead of the index in a block with the default filter. */
+const int SSBLOCK_RESERVED_SIZE = sizeof(SSBlockHeader) + BLOOMFILTER_SIZE;
+/**
+ * Memtable size that triggers a flush unless told otherwise, so that a
+ * flushed block with the default filter stays within 2 MiB.
+ */
+const size_t DEFAULT_WRITE_BUFFER_SIZE = 2 * 1024 * 1024 - SSBLOCK_RESERVED_SIZE;
+
+/**
+ * Everything a store can be tuned with, read from a conf file by
+ * fromFile() or filled in by hand. README.md describes the conf file
+ * setting behind each field.
+ */
+struct Options {
+  /** Policy and limit of each level, top first. */
+  std::vector<std::pair<Policy, size_t>> levels = {
+      {TIERING, 100}, {LEVELING, 200}, {LEVELING, 400}, {LEVELING, 800}};
+  /**
+   * Size leveled levels from the last one instead of by their limits,
+   * and add levels below it as it grows. See README.md.
+   */
+  bool dynamic_levels = false;
+  size_t level_fanout = 10;
+  /** Leave compaction to compactOnce() calls from a background thread. */
+  bool background_compaction = false;
+  /**
+   * Lookups a block may pass its filter for without holding the key
+   * before it is merged into the level below; 0 never.
+   */
+  uint64_t seek_miss_limit = 0;
+  /**
+   * Share of tombstones at which a block is compacted on its own, so
+   * deletes reach the last level and go; 0 never.
+   */
+  double tombstone_compaction_ratio = 0;
+  memtable::MemTable_Backend_Type memtable = memtable::MEMTABLE_USE_RBTREE;
+  /** Memtable bytes that trigger a flush, and the size blocks are cut at. */
+  size_t write_buffer_size = DEFAULT_WRITE_BUFFER_SIZE;
+  /**
+   * Full memtables that may wait for a flusher thread before writes
+   * stall; 0 flushes on the writing thread.
+   */
+  size_t max_immutable_memtables = 0;
+  size_t flush_threads = 1;
+  uint64_t block_cache_size = 0;
+  uint64_t memory_limit = 0;
+  /** Bytes of filter written with each new block; old blocks keep theirs. */
+  size_t bloom_filter_size = BLOOMFILTER_SIZE;
+  io::Backend io_backend = io::SYNC;
+  bool direct_io = false;
+  bool direct_reads = false;
+  size_t io_threads = 4;
+  uint64_t rate_limit = 0;
+  bool rate_limit_auto = false;
+  bool statistics = true;
+  uint64_t vlog_threshold = 0;
+  double vlog_gc_ratio = 0.5;
+  uint64_t default_ttl = 0;
+  UniversalOptions universal;
+
+  /**
+   * The options set by the conf file at `path`, defaults for the rest.
+   * A file that cannot be read gives the defaults.
+   */
+  static Options fromFile(const std::string &path);
+  /**
+   * Write a conf file that fromFile() reads back as these options.
+   * Returns false if it cannot be written.
+   */
+  bool toFile(const std::string &path) const;
+};
+}; // namespace sstable
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef __SSTABLE_RATELIMITER_H
+#define __SSTABLE_RATELIMITER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+
+namespace sstable {
+/**
+ * Who is asking for write bandwidth. Flushes must never queue behind
+ * compaction, and compaction into deep levels can wait the longest.
+ */
+enum IOPriority { IO_FLUSH = 0, IO_COMPACT_SHALLOW = 1, IO_COMPACT_DEEP = 2 };
+const int NR_IO_PRIORITIES = 3;
+
+/**
+ * Token bucket shared by flush and compaction writes. Tokens are bytes
+ * and accrue continuously at `rate` up to one refill period's worth.
+ * Compaction also draws on a second bucket that accrues at
+ * `compaction_rate`, which auto-tuning moves with the backlog; flushes
+ * only ever wait on the first. Waiters are served strictly by priority,
+ * FIFO within one priority. A rate of 0 means unlimited.
+ */
+class RateLimiter {
+private:
+  using clock = std::chrono::steady_clock;
+  /** A piece of a request; `bytes` counts down as it is served. */
+  struct Request {
+    uint64_t bytes;
+    bool granted;
+  };
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::deque<Request *> queues[NR_IO_PRIORITIES];
+  uint64_t rate;
+  uint64_t compaction_rate;
+  uint64_t min_rate;
+  bool auto_tune;
+  double tokens;
+  double compaction_tokens;
+  clock::time_point last_refill;
+  uint64_t total_bytes[NR_IO_PRIORITIES];
+
+  static uint64_t burst(uint64_t rate);
+  uint64_t rateOf(int pri) const;
+  void refill();
+  void grant();
+
+public:
+  static const uint64_t REFILL_PERIOD_US = 100 * 1000;
+  static const uint64_t AUTO_TUNE_FLOOR_DIV = 20;
+
+  RateLimiter(uint64_t bytes_per_sec, bool auto_tune);
+  /**
+   * Block until `bytes` may be written at priority `pri`. Requests larger
+   * than one burst are granted in burst-sized pieces. Returns the
+   * microseconds spent waiting.
+   */
+  uint64_t request(uint64_t bytes, IOPriority pri);
+  void setRate(uint64_t bytes_per_sec, bool auto_tune);
+  uint64_t getRate();
+  /** The rate compaction is held to, below getRate() when tuned down. */
+  uint64_t getCompactionRate();
+  uint64_t getTotalBytes(IOPriority pri);
+  /**
+   * Feed the level-0 backlog (blocks over the level limit, 0 = empty,
+   * 1 = at the compaction trigger). With auto-tuning on, the compaction
+   * rate moves between rate/AUTO_TUNE_FLOOR_DIV and rate along with the
+   * backlog, so compaction only takes the full bandwidth when it is
+   * falling behind. Flushes keep the full rate throughout.
+   */
+  void tune(double backlog);
+};
+}; // namespace sstable
+
+#endif
@@ -1,105 +1,498 @@
 #ifndef __SSTABLE_H
 #define __SSTABLE_H
 
+#include <sstable/cache.h>
+#include <sstable/index.h>
+#include <sstable/io.h>
+#include <sstable/options.h>
+#include <sstable/vlog.h>
+#include <statistics.h>
 #include <utils/bloomfilter.h>
+#include <utils/budget.h>
+#include <utils/expiry.h>
+#include <utils/keys.h>
+#include <utils/merge.h>
+#include <utils/slice.h>
 
 #include <algorithm>
+#include <atomic>
+#include <functional>
+#include <map>
 #include <queue>
 #include <memory>
 #include <optional>
+#include <set>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace sstable {
 const std::string deleted = "~DELETED~";
-enum Policy { TIERING = 0, LEVELING = 1 };
 enum Order { PREV = 0, NEXT = 1 };
-struct SSBlockHeader {
-  uint64_t timestamp;
-  uint64_t nr_keys;
-  uint64_t minn;
-  uint64_t maxx;
-  bool checkBound(uint64_t key){
-    return key >= minn && key <= maxx;
-  }
+/**
+ * Services shared by every level and block of one SSTable.
+ */
+struct SSContext {
+  std::shared_ptr<io::IOBackend> io;
+  std::shared_ptr<RateLimiter> limiter;
+  std::shared_ptr<statistics::Statistics> stats;
+  std::shared_ptr<ValueLog> vlog;
+  std::shared_ptr<merge::MergeOperator> merge_operator;
+  UniversalOptions universal;
+  /** Bytes of bloom filter given to blocks written from now on. */
+  size_t filter_size = BLOOMFILTER_SIZE;
+  /** Charged for every open block's filter and index; may be null. */
+  std::shared_ptr<memory::MemoryBudget> budget;
+  /** Values found by point lookups; null if caching is off. */
+  std::shared_ptr<ValueCache> cache;
+  /** Seek misses that make a block a compaction candidate; 0 for none. */
+  uint64_t seek_miss_limit = 0;
+  /** Set when a block reaches the limit, cleared once none is left. */
+  std::atomic<bool> seek_pending{false};
 };
 
-const uint64_t BLOOMFILTER_SIZE = 10240;
-const int SSBLOCK_RESERVED_SIZE = sizeof(SSBlockHeader) + BLOOMFILTER_SIZE;
+/**
+ * A value as a block holds it, before any value log pointer is followed.
+ */
+struct StoredValue {
+  std::string data;
+  ValueKind kind;
+};
+
+/**
+ * Strip the expiry off a stored value of kind `kind` and return it, or
+ * expiry::NEVER if the entry has none.
+ */
+inline uint64_t takeExpiry(std::string &stored, ValueKind kind) {
+  if (!(kind & VALUE_EXPIRES) || stored.size() < sizeof(uint64_t))
+    return expiry::NEVER;
+  uint64_t when = coding::getFixed64(stored.data());
+  stored.erase(0, sizeof(uint64_t));
+  return when;
+}
+
+/**
+ * The entries of one block by reference, in key order. A flush points
+ * into the memtable's nodes and arena, so nothing is copied before the
+ * block is written.
+ */
+template <typename Key>
+using EntryRefs = std::vector<std::pair<const Key *, memory::Slice>>;
 
+template <typename Key>
+EntryRefs<Key> refsTo(const std::vector<std::pair<Key, std::string>> &entries) {
+  EntryRefs<Key> ret;
+  ret.reserve(entries.size());
+  for (const auto &entry : entries)
+    ret.emplace_back(&entry.first, entry.second);
+  return ret;
+}
+
+/** Blocks with at least this many keys build their filter concurrently. */
+const size_t PARALLEL_FILTER_KEYS = 4096;
+
+/**
+ * The sstable classes are templates over the key type and its ordering.
+ * Their definitions live in the .cc files and are instantiated there for
+ * uint64_t and std::string keys with the default comparators.
+ */
+template <typename Key, typename Compare = typename keys::KeyTraits<Key>::Compare>
 class SSBlock {
 private:
+  using Index = BlockIndex<Key, Compare>;
+
   SSBlockHeader header;
-  std::unique_ptr<bloomfilter::BloomFilter<uint64_t>> filter;
-  std::deque<std::pair<uint64_t, uint64_t>> index;
-  const std::string filename;
+  std::unique_ptr<bloomfilter::BloomFilter<Key>> filter;
+  Index index;
+  typename Index::Iterator cursor;
+  uint64_t consumed;
+  Key minn;
+  Key maxx;
+  Compare cmp;
+  std::string filename;
+  std::shared_ptr<SSContext> ctx;
+  int fd;
+  uint64_t file_size;
   bool is_prepared;
+  uint64_t id;
+  uint64_t meta_charge;
+  std::atomic<uint64_t> seek_misses{0};
 
   void prepare_from_block(
-      const std::vector<std::pair<uint64_t, std::string>>
-          &block);
+      const EntryRefs<Key> &block,
+      const std::vector<memory::Slice> &stored,
+      const std::vector<ValueKind> &kinds);
   void prepare_from_file();
+  void prepare_keys();
+  void chargeMeta();
+  uint64_t dataOffset() const;
+  int handle();
   std::string read(uint64_t offset, size_t size);
 
 public:
-  SSBlock(const std::string &filename);
+  SSBlock(const std::string &filename, std::shared_ptr<SSContext> ctx,
+          const Compare &cmp);
   ~SSBlock();
-  void flush(const std::vector<std::pair<uint64_t, std::string>>
-                 &block);
+  /**
+   * Write `block` out. `kinds` says how each value is stored: entries
+   * may hold an expiry, merge operands or a value log pointer already;
+   * any other value big enough for the value log is moved there now. An
+   * empty `kinds` means every value is inline. Returns
+   * false if a write fails, with the file and any value log file it
+   * started removed; the block must then be dropped.
+   */
+  bool flush(const EntryRefs<Key> &block, IOPriority pri,
+             const std::vector<ValueKind> &kinds = {});
+  bool flush(const std::vector<std::pair<Key, std::string>>
+                 &block, IOPriority pri,
+             const std::vector<ValueKind> &kinds = {});
+  /** Put the compaction cursor back on the first key. */
+  void rewind();
   uint64_t timestamp() const;
-  uint64_t min() const;
-  uint64_t max() const;
-  uint64_t top_key() const;
-  std::pair<uint64_t,std::string> top();
+  const Key &min() const;
+  const Key &max() const;
+  const Key &top_key() const;
+  std::pair<Key,std::string> top();
+  ValueKind top_kind() const;
   uint64_t size() const;
+  uint64_t keys() const;
+  uint64_t tombstones() const;
+  uint64_t maxExpiry() const;
+  uint64_t fileSize() const;
+  /** Bytes of filter and index this block keeps in memory. */
+  uint64_t memoryUsage() const;
+  /** Lookups that passed the filter but found no key. */
+  uint64_t seekMisses() const;
+  /** Value log pointers held by the block, read without the values. */
+  std::vector<ValuePointer> pointers();
   void pop();
   const std::string &getFilename() const;
-  std::string search(const uint64_t key);
+  /** Move the file to `filename`; an open handle stays valid. */
+  bool rename(const std::string &filename);
+  /** Rewrite the creation time, which orders blocks when a level is loaded. */
+  bool stamp(uint64_t timestamp);
+  bool covers(const Key &key) const;
+  /** In range and passing the bloom filter; nothing is read. */
+  bool mayContain(const Key &key) const;
+  bool anyKey(const std::function<bool(const Key &)> &pred) const;
+  bool locate(const Key &key, io::ReadRequest &req, ValueKind &kind);
+  void scan(const Key &key1, const Key &key2,
+            std::map<Key, StoredValue, Compare> &ret);
 };
 
+/**
+ * Running totals for one level. They are adjusted as blocks enter and
+ * leave the level, so reading them never touches the blocks and is safe
+ * from any thread. Compaction figures count whole input and output files
+ * of compactions whose output landed on this level.
+ */
+struct LevelStats {
+  std::atomic<uint64_t> nr_files{0};
+  std::atomic<uint64_t> bytes{0};
+  std::atomic<uint64_t> keys{0};
+  std::atomic<uint64_t> tombstones{0};
+  std::atomic<uint64_t> flush_bytes{0};
+  std::atomic<uint64_t> nr_compactions{0};
+  std::atomic<uint64_t> compact_read_upper_bytes{0};
+  std::atomic<uint64_t> compact_read_lower_bytes{0};
+  std::atomic<uint64_t> compact_write_bytes{0};
+  std::atomic<uint64_t> moved_bytes{0};
+  /** Filter and index bytes the level's blocks keep in memory. */
+  std::atomic<uint64_t> meta_bytes{0};
+};
+
+template <typename Key, typename Compare = typename keys::KeyTraits<Key>::Compare>
 class SSLevel {
 private:
+  using Block = SSBlock<Key, Compare>;
+
   std::string base;
-  std::deque<std::unique_ptr<SSBlock>> blocks;
+  std::deque<std::unique_ptr<Block>> blocks;
   Policy policy;
   size_t limit;
+  std::shared_ptr<SSContext> ctx;
+  Compare cmp;
+  LevelStats stats;
+  // Tombstone share of each block that has any, so the densest is known
+  // without visiting the blocks.
+  std::multiset<double> densities;
+
+  /** Consecutive blocks [begin, end) whose key ranges do not overlap. */
+  struct Run {
+    size_t begin;
+    size_t end;
+    uint64_t bytes;
+  };
+
+  void account(const Block &block, bool adding);
+  std::vector<Run> runs() const;
+  size_t pickUniversal(const std::vector<Run> &runs) const;
 
 public:
-  SSLevel(const std::string &base, const Policy &policy, const size_t &limit);
-  void
-  insertBlock(const std::vector<std::pair<uint64_t, std::string>>
-                  &block);
-  void insertBlocks(const std::vector<std::unique_ptr<SSBlock>> &blocks);
+  SSLevel(const std::string &base, const Policy &policy, const size_t &limit,
+          std::shared_ptr<SSContext> ctx, const Compare &cmp);
+  /**
+   * Write `block` as the newest block of the level. Returns false, with
+   * the level unchanged, if the file could not be written.
+   */
+  bool insertBlock(const EntryRefs<Key> &block, IOPriority pri,
+                   const std::vector<ValueKind> &kinds = {});
+  bool
+  insertBlock(const std::vector<std::pair<Key, std::string>>
+                  &block, IOPriority pri,
+              const std::vector<ValueKind> &kinds = {});
   std::string nextFile() const;
   size_t getLimit() const;
+  void setLimit(size_t limit);
+  Policy getPolicy() const;
   size_t size() const;
-  std::vector<std::unique_ptr<SSBlock>> select(Order order, uint64_t minn,
-                                               uint64_t maxx);
-  std::string search(const uint64_t key);
+  /** Number of sorted runs, the unit a Universal level's limit counts. */
+  size_t sortedRuns() const;
+  bool needsCompaction() const;
+  /**
+   * Remove and return the block `weight` rates highest, if that is at
+   * least `least`.
+   */
+  std::unique_ptr<Block> takeHeaviest(const std::function<double(const Block &)> &weight,
+                                      double least);
+  const LevelStats &getStats() const;
+  /** The highest share of tombstones among the level's blocks. */
+  double densest() const;
+  void recordCompaction(uint64_t upper_bytes, uint64_t lower_bytes);
+  void recordFlush(uint64_t bytes);
+  /** Whether one of the first `end` blocks, oldest first, may hold `key`. */
+  bool mayContain(const Key &key, size_t end = SIZE_MAX) const;
+  /**
+   * Delete blocks whose every entry has expired, unless an older version
+   * of one of their keys may survive them: in an older block of this
+   * level, or wherever `below` says. Returns how many were deleted.
+   */
+  size_t dropExpired(uint64_t now,
+                     const std::function<bool(const Key &)> &below);
+  std::string describeFiles() const;
+  /** Path and size of each block file, oldest first. */
+  std::vector<std::pair<std::string, uint64_t>> files() const;
+  /** Whether a block's key range intersects [minn, maxx]. */
+  bool overlaps(const Key &minn, const Key &maxx) const;
+  /**
+   * Take over a block from the level above by renaming its file into
+   * this level, without rewriting it.
+   */
+  bool adopt(std::unique_ptr<Block> &block);
+  /**
+   * Put back a block taken from this level, in the place a reopen would
+   * sort it into.
+   */
+  void restore(std::unique_ptr<Block> &block);
+  /** Whether `block`'s file is in this level's directory. */
+  bool owns(const Block &block) const;
+  /** Remove and return the `n` newest blocks. */
+  std::vector<std::unique_ptr<Block>> takeNewest(size_t n);
+  /**
+   * Take over an externally built block as the newest one on this level,
+   * renaming its file in. Leaves `block` alone if that fails.
+   */
+  bool ingest(std::unique_ptr<Block> &block);
+  std::vector<std::unique_ptr<Block>> select(Order order, const Key &minn,
+                                             const Key &maxx);
+  bool locate(const Key &key, io::ReadRequest &req, ValueKind &kind,
+              size_t &probes);
+  /**
+   * Hand every version of `key` on this level to `fn`, newest first,
+   * until it returns false. Returns false if it was stopped.
+   */
+  bool versions(const Key &key, size_t &probes,
+                const std::function<bool(const io::ReadRequest &, ValueKind)> &fn);
+  void scan(const Key &key1, const Key &key2,
+            std::map<Key, StoredValue, Compare> &ret);
 };
 
+template <typename Key, typename Compare = typename keys::KeyTraits<Key>::Compare>
 class SSTable {
 private:
+  using Block = SSBlock<Key, Compare>;
+  using Level = SSLevel<Key, Compare>;
+
   std::string base;
-  std::string conf;
-  std::vector<std::unique_ptr<SSLevel>> levels;
-  std::vector<std::pair<Policy, size_t>> parseConf();
-  std::pair<uint64_t, uint64_t> rangeSelected(
-      const std::vector<std::unique_ptr<sstable::SSBlock>> &selected) const;
-  void compactBlocks(
-      const std::vector<std::unique_ptr<sstable::SSBlock>> &selected,
-      const std::unique_ptr<SSLevel> &level) const;
+  Options options;
+  std::vector<std::unique_ptr<Level>> levels;
+  std::shared_ptr<SSContext> ctx;
+  Compare cmp;
+  /** Numbers the files of flushes written but not yet committed. */
+  std::atomic<uint64_t> next_pending{0};
+  void prepare_io();
+  std::pair<Key, Key> rangeSelected(
+      const std::vector<std::unique_ptr<Block>> &selected) const;
+  /**
+   * Merge `selected`, oldest first, into `level` and delete their files.
+   * If an output block cannot be written, the blocks already written go
+   * and `selected` is put back where it came from; returns false then.
+   */
+  bool compactBlocks(std::vector<std::unique_ptr<Block>> &selected,
+                     const std::unique_ptr<Level> &level, IOPriority pri);
+  /**
+   * Merge `upper`, newer than anything on level `out`, into it, moving
+   * blocks that overlap nothing there as they are. Returns false if
+   * the merge failed.
+   */
+  bool mergeInto(size_t out, std::vector<std::unique_ptr<Block>> &upper);
+  /**
+   * Run level `i`'s compaction. Returns false if it had nothing to do or
+   * failed to write its output.
+   */
+  bool compactLevel(size_t i);
+  /** Merge the block with the most seek misses into the level below. */
+  bool compactSeekMisses();
+  /**
+   * Merge the block with the highest share of tombstones into the level
+   * below, or rewrite it in place on the last level, where they go.
+   */
+  bool compactTombstones();
+  /**
+   * Whether a single block of level `i` can be merged down, or rewritten
+   * on its own when it is the last.
+   */
+  bool tombstonesMovable(size_t i) const;
+  /**
+   * Move the blocks of `selected` that overlap neither the rest of it
+   * nor leveled level `out` down to `out` as they are. What is left of
+   * `selected` still has to be merged.
+   */
+  void moveTrivially(std::vector<std::unique_ptr<Block>> &selected, size_t out);
   void prepare_levels();
+  /** Put a new, empty leveled level under the last one. */
+  void addLevel();
+  /**
+   * With dynamic levels, give each leveled level between level 0 and
+   * the last a limit `level_fanout` times smaller than the one below,
+   * worked up from the size of the last level and never below level
+   * 1's configured limit. The last level's limit is the size at which
+   * a level is added under it.
+   */
+  void resizeLevels();
+  /** Whether level `from` or a deeper one may hold a version of `key`. */
+  bool mayExistFrom(const Key &key, size_t from) const;
+  std::string resolve(std::string stored, ValueKind kind);
+  /**
+   * Read a located value into `value`, through the value cache when
+   * there is one. Returns true if the cache had it.
+   */
+  bool readValue(const io::ReadRequest &req, std::string &value);
+  /** Like readValue(), pinning a cached value instead of copying it. */
+  bool readValue(const io::ReadRequest &req, memory::PinnableSlice &value);
+  /**
+   * Fill in every request, submitting only what the cache misses.
+   * Returns how many were read from disk.
+   */
+  size_t readValues(std::vector<io::ReadRequest> &reqs);
+  /**
+   * The value of a key whose newest version holds merge operands: the
+   * operands down to the first value, folded. Reads as deleted if they
+   * cannot be folded.
+   */
+  std::string fold(const Key &key);
 
 public:
-  SSTable(const std::string &base, const std::string &conf);
+  SSTable(const std::string &base, const std::string &conf,
+          const Compare &cmp = Compare());
+  SSTable(const std::string &base, const Options &options,
+          const Compare &cmp = Compare());
   // ~SSTable();
-  void flush(const std::vector<std::pair<uint64_t, std::string>>
-                 &block);
-  std::string search(const uint64_t key);
+  /**
+   * Write `block` to level 0; the caller may free its entries after.
+   * `kinds` says how each value is stored, as for SSBlock::flush().
+   * Returns false if it could not be written, and the entries are then
+   * still needed.
+   */
+  bool flush(const EntryRefs<Key> &block,
+             const std::vector<ValueKind> &kinds = {});
+  /**
+   * The first half of flush(): write `block` to a file of its own beside
+   * level 0, touching nothing readers use, so several can be written at
+   * once. The file is left out when the table is reopened. Returns null
+   * if it could not be written.
+   */
+  std::unique_ptr<SSBlock<Key, Compare>>
+  prepareFlush(const EntryRefs<Key> &block,
+               const std::vector<ValueKind> &kinds = {});
+  /**
+   * Make a block from prepareFlush() the newest one on level 0. Blocks
+   * must be committed in the order their memtables were written.
+   */
+  bool commitFlush(std::unique_ptr<SSBlock<Key, Compare>> &block);
+  /**
+   * The work a flush leaves behind: dropping expired blocks, compaction
+   * and value log collection.
+   */
+  void maintain();
+  std::string search(const Key &key);
+  /**
+   * Like search(), but a plain value found in the value cache is pinned
+   * there rather than copied, and one read from disk is handed over in
+   * the buffer it was read into. Returns false if no level has the key.
+   */
+  bool searchPinned(const Key &key, memory::PinnableSlice &value);
+  std::vector<std::string> multiSearch(const std::vector<Key> &keys);
+  void scan(const Key &key1, const Key &key2,
+            std::map<Key, std::string, Compare> &ret);
   void reset();
+  /** Run compactions until no level scores 1 or more. */
   void compact();
-  // TODO: implement scan here....
+  /**
+   * Run the compaction of the level scoring highest, or failing that
+   * merge a block that lookups keep missing in, or one mostly holding
+   * tombstones, into the level below. Returns false if there was
+   * nothing to do.
+   */
+  bool compactOnce();
+  /** Whether compactOnce() would find something to do. */
+  bool needsCompaction() const;
+  /**
+   * How far level `i` is over its limit: its blocks, or runs for a
+   * Universal level, per unit of limit. 1 or more asks for compaction.
+   * A last level that cannot be compacted scores 0.
+   */
+  double score(size_t i) const;
+  /** Collect value log files whose garbage ratio has been reached. */
+  void collectGarbage();
+  void setRateLimit(uint64_t bytes_per_sec, bool auto_tune);
+  statistics::Statistics *getStatistics() const;
+  void setMergeOperator(std::shared_ptr<merge::MergeOperator> op);
+  /**
+   * Move the block files at `paths` into the tree, each on the deepest
+   * level that neither it nor any level above overlaps, or level 0.
+   * Returns false, ingesting nothing, if a file is not a block, holds
+   * value log pointers or overlaps another one of `paths`; it also
+   * returns false if a file cannot be renamed, after those before it
+   * went in.
+   */
+  bool ingest(const std::vector<std::string> &paths);
+  /**
+   * Hard-link every block and value log file into a fresh directory
+   * `dir` laid out like this one, and write the options as `CONF` and
+   * the files linked, with their sizes, as `MANIFEST`. Files are never
+   * written again once they are in the tree, so the links stay a
+   * consistent copy however the tree moves on. Returns false if `dir`
+   * exists or a link fails, as across filesystems, leaving what was
+   * made; `MANIFEST` is written last, so only a complete checkpoint has
+   * one.
+   */
+  bool checkpoint(const std::string &dir) const;
+  std::shared_ptr<memory::MemoryBudget> getMemoryBudget() const;
+  /**
+   * Charge this table's filters, indexes and cache to `budget` from now
+   * on, moving what is charged to the current one over.
+   */
+  void setMemoryBudget(std::shared_ptr<memory::MemoryBudget> budget);
+  /** Evict cached values until the budget has room again. */
+  void shrinkCache();
+  /** TTL in seconds for writes that give none, 0 for no expiry. */
+  uint64_t defaultTTL() const;
+  /**
+   * Look up a named property such as "minilsm.bytes-at-level1". Returns
+   * false if the name is not known. See README.md for the list.
+   */
+  bool getProperty(const std::string &name, std::string &value) const;
 };
 }; // namespace sstable
 
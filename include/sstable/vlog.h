@@ -0,0 +1,133 @@
+#ifndef __SSTABLE_VLOG_H
+#define __SSTABLE_VLOG_H
+
+#include <sstable/io.h>
+#include <utils/slice.h>
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace sstable {
+/**
+ * Where a separated value lives: `size` bytes at `offset` of value log
+ * file number `file`. Blocks store it in place of the value.
+ */
+struct ValuePointer {
+  uint64_t file;
+  uint64_t offset;
+  uint64_t size;
+
+  static const size_t ENCODED_SIZE = 3 * sizeof(uint64_t);
+  std::string encode() const;
+  static ValuePointer decode(const std::string &data);
+};
+
+class ValueLog;
+
+/**
+ * Appends the separated values of one block to a fresh value log file.
+ * Records are varint key size | key | varint value size | value, so
+ * garbage collection can tell whose value it is looking at.
+ */
+class ValueLogWriter {
+private:
+  ValueLog *log;
+  uint64_t file;
+  std::unique_ptr<io::WritableFile> ofile;
+  uint64_t offset;
+  bool failed;
+
+public:
+  ValueLogWriter(ValueLog *log, uint64_t file,
+                 std::unique_ptr<io::WritableFile> ofile);
+  /**
+   * Append a record. A failed write is remembered and reported by
+   * finish(), so a block is written against the log as a whole.
+   */
+  ValuePointer add(const std::string &key, const memory::Slice &value);
+  /**
+   * Close the file and make it visible to readers and the collector.
+   * Returns false, removing the file instead, if a write failed.
+   */
+  bool finish();
+  /** Close and remove the file, for a block that failed to be written. */
+  void abandon();
+  uint64_t delayedMicros() const;
+};
+
+/**
+ * WiscKey-style value log: values at or above `threshold` bytes are
+ * written once, at flush, into append-only files under `dir`, and only
+ * their pointers travel through compaction. Compaction reports the
+ * pointers it drops as garbage; files whose garbage ratio passes the
+ * collection threshold get their live values rewritten and are deleted.
+ * A threshold of 0 stops separating new values but still serves
+ * existing pointers. Writers for several flushes may be open at once;
+ * the file table is guarded so they can finish while others read.
+ */
+class ValueLog {
+private:
+  struct File {
+    int fd;
+    uint64_t size;
+    uint64_t garbage;
+  };
+
+  std::string dir;
+  std::shared_ptr<io::IOBackend> io;
+  uint64_t threshold;
+  std::map<uint64_t, File> files;
+  uint64_t next_file;
+  bool garbage_dirty;
+  mutable std::mutex mutex;
+
+  std::string path(uint64_t file) const;
+  void loadGarbage();
+
+  friend class ValueLogWriter;
+  void seal(uint64_t file, uint64_t size);
+
+public:
+  ValueLog(const std::string &dir, std::shared_ptr<io::IOBackend> io,
+           uint64_t threshold);
+  ~ValueLog();
+
+  bool separates(const memory::Slice &value) const;
+  std::unique_ptr<ValueLogWriter> newWriter(IOPriority pri);
+
+  io::ReadRequest request(const ValuePointer &ptr) const;
+  std::string read(const ValuePointer &ptr);
+
+  void addGarbage(const ValuePointer &ptr);
+  /** Persist garbage counts changed since the last call. */
+  void saveGarbage();
+  /** Files whose garbage is at least `ratio` of their size. */
+  std::vector<uint64_t> collectable(double ratio) const;
+  /**
+   * Call `fn(key, value, offset)` for every record of `file`, where
+   * `offset` is that of the value, as found in its ValuePointer.
+   */
+  void forEach(uint64_t file,
+               const std::function<void(const std::string &,
+                                        const std::string &, uint64_t)> &fn);
+  void remove(uint64_t file);
+  /**
+   * Hard-link every sealed file into `dir`, which must exist, along with
+   * their garbage counts, and list the names linked with their sizes in
+   * `linked`. Returns false if a link fails.
+   */
+  bool checkpoint(const std::string &dir,
+                  std::vector<std::pair<std::string, uint64_t>> &linked) const;
+
+  size_t size() const;
+  uint64_t totalBytes() const;
+  uint64_t garbageBytes() const;
+};
+}; // namespace sstable
+
+#endif
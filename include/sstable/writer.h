@@ -0,0 +1,46 @@
+#ifndef __SSTABLE_WRITER_H
+#define __SSTABLE_WRITER_H
+
+#include <sstable/sstable.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace sstable {
+/**
+ * Builds a block file offline, outside any store, for
+ * KVStore::ingest_files. Keys must be added in strictly ascending order;
+ * the entries are held in memory until finish() writes the file, so big
+ * inputs should be cut into files of about the store's
+ * write_buffer_size, the size its own blocks have. All values are written
+ * inline, whatever the store's value log threshold.
+ */
+template <typename Key, typename Compare = typename keys::KeyTraits<Key>::Compare>
+class SSTableWriter {
+private:
+  std::string filename;
+  Compare cmp;
+  std::shared_ptr<SSContext> ctx;
+  std::vector<std::pair<Key, std::string>> entries;
+  uint64_t bytes;
+  bool finished;
+
+  bool add(const Key &key, const std::string &value);
+
+public:
+  SSTableWriter(const std::string &filename, const Compare &cmp = Compare());
+  /** Returns false if `key` is not above the last key added. */
+  bool put(const Key &key, const std::string &value);
+  bool del(const Key &key);
+  /** Bytes of keys and values added so far. */
+  uint64_t size() const;
+  /**
+   * Write the file. Returns false if nothing was added, it was written
+   * already or the write failed; a failed write can be tried again.
+   */
+  bool finish();
+};
+}; // namespace sstable
+
+#endif
@@ -0,0 +1,216 @@
+#ifndef __STATISTICS_H
+#define __STATISTICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace statistics {
+enum Ticker {
+  BLOOM_FILTER_USEFUL = 0,      // filter ruled a block out
+  BLOOM_FILTER_POSITIVE,        // filter let the lookup through
+  BLOOM_FILTER_FALSE_POSITIVE,  // ... and the key was not in the block
+  MEMTABLE_HIT,
+  MEMTABLE_MISS,
+  GET_HIT_L0,
+  GET_HIT_L1,
+  GET_HIT_L2_AND_UP,
+  NUMBER_KEYS_WRITTEN,
+  NUMBER_KEYS_READ,
+  NUMBER_KEYS_FOUND,
+  NUMBER_KEYS_DELETED,
+  NUMBER_MULTIGET_KEYS,
+  NUMBER_SCANS,
+  BYTES_WRITTEN,
+  BYTES_READ,
+  BLOCK_READ_COUNT,
+  BLOCK_READ_BYTES,
+  FLUSH_COUNT,
+  FLUSH_BYTES,
+  COMPACTION_COUNT,
+  COMPACT_READ_BYTES,
+  COMPACT_WRITE_BYTES,
+  STALL_MICROS,
+  RATE_LIMIT_DELAY_MICROS,
+  VLOG_BYTES_WRITTEN,
+  VLOG_BYTES_READ,
+  VLOG_GC_COUNT,
+  VLOG_GC_BYTES_RELOCATED,
+  COMPACTION_KEY_DROP_EXPIRED,
+  EXPIRED_BLOCKS_DROPPED,
+  NUMBER_MERGES,
+  MERGE_OPERANDS_FOLDED,
+  COMPACTION_TRIVIAL_MOVES,
+  COMPACTION_TRIVIAL_MOVE_BYTES,
+  INGESTED_FILES,
+  INGESTED_BYTES,
+  BLOCK_CACHE_HIT,
+  BLOCK_CACHE_MISS,
+  BLOCK_CACHE_ADD,
+  MEMORY_BUDGET_FLUSHES,
+  COMPACTION_SEEK_TRIGGERED,    // blocks compacted for their seek misses
+  COMPACTION_TOMBSTONE_TRIGGERED, // ... and for their share of tombstones
+  NR_TICKERS
+};
+
+enum Histogram {
+  GET_MICROS = 0,
+  PUT_MICROS,
+  MULTIGET_MICROS,
+  SCAN_MICROS,
+  FLUSH_MICROS,
+  COMPACTION_MICROS,
+  BLOCKS_READ_PER_GET,
+  BLOCKS_PROBED_PER_GET,
+  NR_HISTOGRAMS
+};
+
+const char *ticker_name(Ticker t);
+const char *histogram_name(Histogram h);
+
+struct HistogramSnapshot {
+  uint64_t count;
+  uint64_t sum;
+  uint64_t max;
+  double p50;
+  double p95;
+  double p99;
+  double p999;
+};
+
+/**
+ * Engine-wide counters and latency histograms. Updates are relaxed
+ * atomic adds on a per-thread shard, so concurrent writers never share a
+ * cache line; reads sum the shards and are only approximately consistent
+ * with each other.
+ */
+class Statistics {
+private:
+  static const int NR_SHARDS = 16;
+  // Four linear buckets per power of two, so percentiles come out
+  // within about 25% of the true value.
+  static const int SUB_BITS = 2;
+  static const int NR_BUCKETS = 64 << SUB_BITS;
+
+  // new[] does not honour over-aligned types before C++17, so instead of
+  // aligning shards, a cache line of padding keeps each one's counters
+  // off the lines of its neighbours wherever the array starts.
+  static const size_t CACHE_LINE = 64;
+  struct Shard {
+    std::atomic<uint64_t> tickers[NR_TICKERS];
+    std::atomic<uint64_t> buckets[NR_HISTOGRAMS][NR_BUCKETS];
+    std::atomic<uint64_t> sums[NR_HISTOGRAMS];
+    std::atomic<uint64_t> maxs[NR_HISTOGRAMS];
+    char pad[CACHE_LINE];
+  };
+  std::unique_ptr<Shard[]> shards;
+
+  Shard &local();
+  static int bucket(uint64_t value);
+  static uint64_t bucket_limit(int b);
+
+public:
+  Statistics();
+  void record(Ticker t, uint64_t count = 1);
+  void measure(Histogram h, uint64_t value);
+  uint64_t get(Ticker t) const;
+  HistogramSnapshot snapshot(Histogram h) const;
+  void reset();
+  std::string toString() const;
+  std::string toJson() const;
+};
+
+inline void record(Statistics *stats, Ticker t, uint64_t count = 1) {
+  if (stats != nullptr)
+    stats->record(t, count);
+}
+
+inline void measure(Statistics *stats, Histogram h, uint64_t value) {
+  if (stats != nullptr)
+    stats->measure(h, value);
+}
+
+enum PerfLevel { PERF_DISABLE = 0, PERF_COUNT = 1, PERF_TIME = 2 };
+
+/**
+ * Breakdown of the operations issued by the calling thread since the
+ * last reset(). Counters are filled at PERF_COUNT, nanosecond timers at
+ * PERF_TIME; nothing is collected at the default PERF_DISABLE.
+ */
+struct PerfContext {
+  uint64_t get_memtable_nanos;
+  uint64_t get_filter_nanos;
+  uint64_t get_index_nanos;
+  uint64_t get_read_nanos;
+  uint64_t memtable_hit_count;
+  uint64_t bloom_useful_count;
+  uint64_t bloom_positive_count;
+  uint64_t blocks_probed_count;
+  uint64_t block_read_count;
+  uint64_t block_read_bytes;
+
+  void reset();
+  std::string toString() const;
+  std::string toJson() const;
+};
+
+void set_perf_level(PerfLevel level);
+PerfLevel get_perf_level();
+PerfContext &get_perf_context();
+
+/**
+ * Adds the nanoseconds between construction and destruction to `slot`
+ * when the thread's perf level is PERF_TIME.
+ */
+class PerfTimer {
+private:
+  uint64_t *slot;
+  std::chrono::steady_clock::time_point start;
+
+public:
+  PerfTimer(uint64_t &slot)
+      : slot(get_perf_level() >= PERF_TIME ? &slot : nullptr) {
+    if (this->slot != nullptr)
+      this->start = std::chrono::steady_clock::now();
+  }
+  ~PerfTimer() {
+    if (this->slot != nullptr)
+      *this->slot += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         std::chrono::steady_clock::now() - this->start)
+                         .count();
+  }
+};
+
+inline void perf_count(uint64_t PerfContext::*field, uint64_t count = 1) {
+  if (get_perf_level() >= PERF_COUNT)
+    get_perf_context().*field += count;
+}
+
+/**
+ * Records the microseconds between construction and destruction into a
+ * histogram of `stats`, if there is one. elapsed() works either way.
+ */
+class StopWatch {
+private:
+  Statistics *stats;
+  Histogram h;
+  std::chrono::steady_clock::time_point start;
+
+public:
+  StopWatch(Statistics *stats, Histogram h)
+      : stats(stats), h(h), start(std::chrono::steady_clock::now()) {}
+  uint64_t elapsed() const {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now() - this->start)
+        .count();
+  }
+  ~StopWatch() {
+    if (this->stats != nullptr)
+      this->stats->measure(this->h, this->elapsed());
+  }
+};
+}; // namespace statistics
+
+#endif
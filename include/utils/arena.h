@@ -0,0 +1,56 @@
+#ifndef __ARENA_H
+#define __ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace memory {
+    /**
+     * Bump allocator for bytes that are all freed together, such as the
+     * values of one memtable. Small allocations are carved out of shared
+     * blocks, so each costs no allocator call or header; big ones get a
+     * block of their own so the current block is not wasted.
+     */
+    class Arena {
+    private:
+        static const size_t BLOCK_SIZE = 4096;
+
+        std::vector<std::unique_ptr<char[]>> blocks;
+        char *ptr = nullptr;
+        size_t left = 0;
+        size_t used = 0;
+
+        char *newBlock(size_t bytes) {
+            this->blocks.emplace_back(new char[bytes]);
+            this->used += bytes;
+            return this->blocks.back().get();
+        }
+
+    public:
+        char *allocate(size_t bytes) {
+            if (bytes > this->left) {
+                if (bytes > BLOCK_SIZE / 4)
+                    return this->newBlock(bytes);
+                this->ptr = this->newBlock(BLOCK_SIZE);
+                this->left = BLOCK_SIZE;
+            }
+            char *ret = this->ptr;
+            this->ptr += bytes;
+            this->left -= bytes;
+            return ret;
+        }
+
+        /** Bytes held in blocks, including what is not handed out yet. */
+        size_t memoryUsage() const { return this->used; }
+
+        void reset() {
+            this->blocks.clear();
+            this->ptr = nullptr;
+            this->left = 0;
+            this->used = 0;
+        }
+    };
+};
+
+#endif
@@ -3,10 +3,20 @@
 
 #include <cstddef>
 #include <cstring>
+#include <string>
 
 #include "MurmurHash3.h"
 
 namespace bloomfilter {
+    template <typename T>
+    inline void digest(const T &key, uint32_t x[4]) {
+        MurmurHash3_x64_128(reinterpret_cast<const void *>(&key), sizeof(T), 1, x);
+    }
+
+    inline void digest(const std::string &key, uint32_t x[4]) {
+        MurmurHash3_x64_128(key.data(), key.size(), 1, x);
+    }
+
     template <typename T>
     struct BloomFilter {
         char *data = nullptr;
@@ -14,22 +24,22 @@ namespace bloomfilter {
 
         BloomFilter(const size_t &size) : size(size) {
             this->data = new char[size];
-            memset(this->data, 0, sizeof(size));
+            memset(this->data, 0, size);
         }
 
         ~BloomFilter() { delete[] data; }
 
         void insert(const T &key) {
-            int32_t x[4];
-            MurmurHash3_x64_128(reinterpret_cast<const void *>(&key), sizeof(T), 1, x);
+            uint32_t x[4];
+            digest(key, x);
             for (int i = 0; i < 4; i++) {
                 data[x[i] % this->size] = 1;
             }
         }
 
         bool check(const T &key) {
-            int32_t x[4];
-            MurmurHash3_x64_128(reinterpret_cast<const void *>(&key), sizeof(T), 1, x);
+            uint32_t x[4];
+            digest(key, x);
             for (int i = 0; i < 4; i++) {
                 if (data[x[i] % this->size] == 0)
                     return false;
@@ -0,0 +1,75 @@
+#ifndef __BUDGET_H
+#define __BUDGET_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace memory {
+    enum Usage {
+        MEMTABLE = 0,
+        IMMUTABLE_MEMTABLE,
+        BLOCK_CACHE,
+        TABLE_META,
+        NR_USAGES
+    };
+
+    /**
+     * One memory limit shared by everything charged to it: memtables,
+     * value caches and the filters and indexes every open block keeps in
+     * memory. Several stores may share a budget. Filters and indexes
+     * cannot be given back while their blocks are live, so the budget
+     * makes room by shrinking caches first and then by flushing
+     * memtables early. A limit of 0 only counts.
+     */
+    class MemoryBudget {
+    private:
+        std::atomic<uint64_t> used[NR_USAGES];
+        std::atomic<uint64_t> total_limit;
+
+    public:
+        /** A memtable is not flushed early below this size. */
+        static const uint64_t MIN_EARLY_FLUSH = 64 * 1024;
+
+        MemoryBudget(uint64_t limit = 0) : total_limit(limit) {
+            for (auto &u : this->used)
+                u = 0;
+        }
+
+        void reserve(Usage what, uint64_t bytes) { this->used[what] += bytes; }
+        void release(Usage what, uint64_t bytes) { this->used[what] -= bytes; }
+        /** Charge `to` bytes where `from` were charged before. */
+        void update(Usage what, uint64_t from, uint64_t to) {
+            if (to >= from)
+                this->reserve(what, to - from);
+            else
+                this->release(what, from - to);
+        }
+
+        uint64_t usage(Usage what) const { return this->used[what]; }
+        uint64_t usage() const {
+            uint64_t sum = 0;
+            for (const auto &u : this->used)
+                sum += u;
+            return sum;
+        }
+        uint64_t limit() const { return this->total_limit; }
+        void setLimit(uint64_t limit) { this->total_limit = limit; }
+        bool exceeded() const {
+            return this->total_limit != 0 && this->usage() > this->total_limit;
+        }
+        /** Bytes a cache holding `cached` may keep while over the limit. */
+        uint64_t cacheRoom(uint64_t cached) const {
+            if (this->total_limit == 0)
+                return UINT64_MAX;
+            uint64_t other = this->usage() - cached;
+            return other >= this->total_limit ? 0 : this->total_limit - other;
+        }
+        /** Whether a memtable holding `own` bytes should flush to make room. */
+        bool shouldFlush(uint64_t own) const {
+            return own >= MIN_EARLY_FLUSH && this->exceeded();
+        }
+    };
+};  // namespace memory
+
+#endif
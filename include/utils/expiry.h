@@ -0,0 +1,53 @@
+#ifndef __EXPIRY_H
+#define __EXPIRY_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "slice.h"
+
+namespace expiry {
+/** Expiry of entries written without a TTL. */
+const uint64_t NEVER = UINT64_MAX;
+
+/** Seconds since the epoch, the unit expiries are kept in. */
+inline uint64_t now() {
+    return std::chrono::duration_cast<std::chrono::seconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+/**
+ * A value with a TTL as the memtable keeps it: its expiry, then the
+ * value, the same as on disk. That it has one is the entry's flag to
+ * record, never the bytes'.
+ */
+inline std::string wrap(const std::string &value, uint64_t when) {
+    std::string ret(reinterpret_cast<const char *>(&when), sizeof(when));
+    ret.append(value);
+    return ret;
+}
+
+/**
+ * The expiry of a wrapped value. `value` is set to the value without
+ * it.
+ */
+inline uint64_t unwrap(const memory::Slice &stored, std::string *value) {
+    if (stored.size() < sizeof(uint64_t)) {
+        if (value != nullptr)
+            value->clear();
+        return NEVER;
+    }
+    uint64_t when;
+    memcpy(&when, stored.data(), sizeof(when));
+    if (value != nullptr)
+        value->assign(stored.data() + sizeof(when), stored.size() - sizeof(when));
+    return when;
+}
+
+inline bool expired(uint64_t when, uint64_t now) { return when <= now; }
+};  // namespace expiry
+
+#endif
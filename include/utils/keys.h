@@ -0,0 +1,85 @@
+#ifndef __KEYS_H
+#define __KEYS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+
+namespace keys {
+/**
+ * Ordering of byte-string keys, chosen at runtime. Keys that compare
+ * equal must also be byte-for-byte equal, since bloom filters hash the
+ * raw bytes.
+ */
+class KeyComparator {
+public:
+    virtual ~KeyComparator() {}
+    virtual int compare(const std::string &a, const std::string &b) const = 0;
+    virtual const char *name() const = 0;
+};
+
+class BytewiseComparator : public KeyComparator {
+public:
+    int compare(const std::string &a, const std::string &b) const override {
+        return a.compare(b);
+    }
+    const char *name() const override { return "minilsm.BytewiseComparator"; }
+};
+
+inline const KeyComparator *bytewise() {
+    static BytewiseComparator instance;
+    return &instance;
+}
+
+/**
+ * Less-than functor over a KeyComparator, so byte-string keys plug into
+ * the same Compare parameter as integer keys.
+ */
+struct Comparator {
+    const KeyComparator *impl;
+    Comparator(const KeyComparator *impl = bytewise()) : impl(impl) {}
+    bool operator()(const std::string &a, const std::string &b) const {
+        return this->impl->compare(a, b) < 0;
+    }
+};
+
+/**
+ * Per key type defaults: the comparator used when none is given, the
+ * bytes a key occupies when sizing memtables and blocks, and how a key
+ * is written where only raw bytes fit, such as value log records.
+ */
+template <typename Key>
+struct KeyTraits {
+    using Compare = std::less<Key>;
+    static size_t size(const Key &) { return sizeof(Key); }
+    static void encode(const Key &key, std::string &out) {
+        out.append(reinterpret_cast<const char *>(&key), sizeof(Key));
+    }
+    static Key decode(const char *data, size_t) {
+        Key key;
+        memcpy(&key, data, sizeof(Key));
+        return key;
+    }
+};
+
+template <>
+struct KeyTraits<std::string> {
+    using Compare = Comparator;
+    static size_t size(const std::string &key) { return key.size(); }
+    static void encode(const std::string &key, std::string &out) {
+        out.append(key);
+    }
+    static std::string decode(const char *data, size_t size) {
+        return std::string(data, size);
+    }
+};
+
+template <typename Key, typename Compare>
+bool equal(const Compare &cmp, const Key &a, const Key &b) {
+    return !cmp(a, b) && !cmp(b, a);
+}
+};  // namespace keys
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef __MERGE_H
+#define __MERGE_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace merge {
+/**
+ * Folds the operands written by `merge()` into a value. The same
+ * operator must always be used with a store, since operands may sit
+ * unfolded on disk until a read or compaction reaches them.
+ */
+class MergeOperator {
+public:
+    virtual ~MergeOperator() {}
+    /**
+     * Apply `operands`, oldest first, to `existing`, which is nullptr if
+     * the key has no value. Returns false if they cannot be applied.
+     */
+    virtual bool fullMerge(const std::string *existing,
+                           const std::vector<std::string> &operands,
+                           std::string &result) const = 0;
+    /**
+     * Combine two adjacent operands into one, if the operator can. Lets
+     * runs of operands shrink before a value is found for them.
+     */
+    virtual bool partialMerge(const std::string &, const std::string &,
+                              std::string &) const {
+        return false;
+    }
+    virtual const char *name() const = 0;
+};
+
+/** Adds decimal operands to a decimal value, missing values count as 0. */
+class UInt64AddOperator : public MergeOperator {
+    static uint64_t parse(const std::string &s) {
+        return strtoull(s.c_str(), nullptr, 10);
+    }
+
+public:
+    bool fullMerge(const std::string *existing,
+                   const std::vector<std::string> &operands,
+                   std::string &result) const override {
+        uint64_t sum = existing == nullptr ? 0 : parse(*existing);
+        for (const auto &op : operands)
+            sum += parse(op);
+        result = std::to_string(sum);
+        return true;
+    }
+    bool partialMerge(const std::string &left, const std::string &right,
+                      std::string &result) const override {
+        result = std::to_string(parse(left) + parse(right));
+        return true;
+    }
+    const char *name() const override { return "minilsm.UInt64AddOperator"; }
+};
+
+/** Appends operands to the value, separated by `delim`. */
+class StringAppendOperator : public MergeOperator {
+    std::string delim;
+
+public:
+    StringAppendOperator(const std::string &delim = ",") : delim(delim) {}
+    bool fullMerge(const std::string *existing,
+                   const std::vector<std::string> &operands,
+                   std::string &result) const override {
+        result = existing == nullptr ? "" : *existing;
+        for (size_t i = 0; i < operands.size(); i++) {
+            if (existing != nullptr || i != 0)
+                result.append(this->delim);
+            result.append(operands[i]);
+        }
+        return true;
+    }
+    bool partialMerge(const std::string &left, const std::string &right,
+                      std::string &result) const override {
+        result = left + this->delim + right;
+        return true;
+    }
+    const char *name() const override { return "minilsm.StringAppendOperator"; }
+};
+
+/**
+ * Operands are stored as a list of fixed32 length | bytes, oldest first.
+ * That a value is such a list is recorded beside it, by a flag on the
+ * memtable entry or the index entry, never in the bytes.
+ */
+
+inline void appendOperand(std::string &list, const std::string &operand) {
+    uint32_t size = operand.size();
+    list.append(reinterpret_cast<const char *>(&size), sizeof(size));
+    list.append(operand);
+}
+
+inline std::vector<std::string> decodeOperands(const std::string &list,
+                                               size_t from = 0) {
+    std::vector<std::string> ret;
+    while (from + sizeof(uint32_t) <= list.size()) {
+        uint32_t size;
+        memcpy(&size, list.data() + from, sizeof(size));
+        from += sizeof(size);
+        ret.emplace_back(list, from, size);
+        from += size;
+    }
+    return ret;
+}
+
+/** Encode `operands`, combining neighbours where `op` allows. */
+inline std::string encodeOperands(const MergeOperator *op,
+                                  const std::vector<std::string> &operands) {
+    std::string list;
+    if (operands.empty())
+        return list;
+    std::string acc = operands[0], combined;
+    for (size_t i = 1; i < operands.size(); i++) {
+        if (op != nullptr && op->partialMerge(acc, operands[i], combined)) {
+            acc.swap(combined);
+        } else {
+            appendOperand(list, acc);
+            acc = operands[i];
+        }
+    }
+    appendOperand(list, acc);
+    return list;
+}
+};  // namespace merge
+
+#endif
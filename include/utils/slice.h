@@ -0,0 +1,168 @@
+#ifndef __SLICE_H
+#define __SLICE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <utility>
+
+namespace memory {
+    /**
+     * A view of bytes owned by someone else: a memtable's arena, a cache
+     * entry or a string. It stays valid only as long as they do.
+     */
+    class Slice {
+    private:
+        const char *ptr;
+        size_t len;
+
+    public:
+        Slice() : ptr(""), len(0) {}
+        Slice(const char *data, size_t size) : ptr(data), len(size) {}
+        Slice(const std::string &s) : ptr(s.data()), len(s.size()) {}
+        Slice(const char *s) : ptr(s), len(strlen(s)) {}
+
+        const char *data() const { return this->ptr; }
+        size_t size() const { return this->len; }
+        bool empty() const { return this->len == 0; }
+        char operator[](size_t i) const { return this->ptr[i]; }
+        std::string toString() const { return std::string(this->ptr, this->len); }
+
+        int compare(const Slice &other) const {
+            size_t n = this->len < other.len ? this->len : other.len;
+            int ret = n == 0 ? 0 : memcmp(this->ptr, other.ptr, n);
+            if (ret != 0)
+                return ret;
+            return this->len < other.len ? -1 : this->len > other.len ? 1 : 0;
+        }
+        bool startsWith(const Slice &prefix) const {
+            return this->len >= prefix.len &&
+                   memcmp(this->ptr, prefix.ptr, prefix.len) == 0;
+        }
+    };
+
+    inline bool operator==(const Slice &a, const Slice &b) {
+        return a.size() == b.size() && memcmp(a.data(), b.data(), a.size()) == 0;
+    }
+    inline bool operator!=(const Slice &a, const Slice &b) { return !(a == b); }
+
+    /**
+     * A value as a memtable node stores it, in 16 bytes: up to 15 bytes
+     * are kept in the slice itself, longer values are referenced where
+     * they live. Up to three bits of flags ride along, for the owner to
+     * say what the bytes hold without marking the bytes themselves. A
+     * view of an inline value points into the slice, so it is only good
+     * while the slice is neither changed nor moved.
+     */
+    class InlineSlice {
+    private:
+        // The tag holds the size of an inline value in its low bits, then
+        // whether the value is referenced instead, then the flags.
+        static const uint8_t SIZE_MASK = 0x0f;
+        static const uint8_t REFERENCED = 0x10;
+        static const unsigned FLAGS_SHIFT = 5;
+
+        // Inline: the bytes. Referenced: the pointer and a 48-bit length,
+        // split so no byte order is assumed.
+        char bytes[15];
+        uint8_t tag;
+
+    public:
+        static const size_t INLINE_SIZE = 15;
+        static const uint8_t MAX_FLAGS = 0xff >> FLAGS_SHIFT;
+
+        InlineSlice() : tag(0) {}
+        /** Copy `value` in if it fits, else refer to its bytes. */
+        InlineSlice(const Slice &value, uint8_t flags = 0) {
+            uint8_t high_bits = static_cast<uint8_t>(flags << FLAGS_SHIFT);
+            if (value.size() <= INLINE_SIZE) {
+                memcpy(this->bytes, value.data(), value.size());
+                this->tag = static_cast<uint8_t>(value.size()) | high_bits;
+                return;
+            }
+            const char *ptr = value.data();
+            uint32_t low = static_cast<uint32_t>(value.size());
+            uint16_t high = static_cast<uint16_t>(static_cast<uint64_t>(value.size()) >> 32);
+            memcpy(this->bytes, &ptr, sizeof(ptr));
+            memcpy(this->bytes + 8, &low, sizeof(low));
+            memcpy(this->bytes + 12, &high, sizeof(high));
+            this->tag = REFERENCED | high_bits;
+        }
+
+        static bool fits(size_t size) { return size <= INLINE_SIZE; }
+        bool isInline() const { return (this->tag & REFERENCED) == 0; }
+        uint8_t flags() const { return this->tag >> FLAGS_SHIFT; }
+
+        const char *data() const {
+            if (this->isInline())
+                return this->bytes;
+            const char *ptr;
+            memcpy(&ptr, this->bytes, sizeof(ptr));
+            return ptr;
+        }
+        size_t size() const {
+            if (this->isInline())
+                return this->tag & SIZE_MASK;
+            uint32_t low;
+            uint16_t high;
+            memcpy(&low, this->bytes + 8, sizeof(low));
+            memcpy(&high, this->bytes + 12, sizeof(high));
+            return static_cast<size_t>(static_cast<uint64_t>(high) << 32 | low);
+        }
+        Slice slice() const { return Slice(this->data(), this->size()); }
+        operator Slice() const { return this->slice(); }
+        std::string toString() const { return std::string(this->data(), this->size()); }
+    };
+
+    /**
+     * A slice that keeps its bytes alive: either pinned where they
+     * already are, such as a memtable's arena or a cache entry, until the
+     * slice is reset or destroyed, or held in a buffer of its own. Must
+     * be released before the store it came from is destroyed.
+     */
+    class PinnableSlice : public Slice {
+    private:
+        std::string self;
+        std::function<void()> release;
+
+    public:
+        PinnableSlice() {}
+        PinnableSlice(const PinnableSlice &) = delete;
+        PinnableSlice &operator=(const PinnableSlice &) = delete;
+        ~PinnableSlice() { this->reset(); }
+
+        /** View `value` in place; `release` runs once it is no longer viewed. */
+        void pin(const Slice &value, std::function<void()> release) {
+            this->reset();
+            Slice::operator=(value);
+            this->release = std::move(release);
+        }
+        /** Hold `value` in the slice's own buffer. */
+        void pinSelf(std::string &&value) {
+            this->reset();
+            this->self = std::move(value);
+            Slice::operator=(Slice(this->self));
+        }
+        bool isPinned() const { return static_cast<bool>(this->release); }
+
+        /** The bytes as a string, moved out when the slice holds them itself. */
+        std::string take() {
+            std::string ret = this->isPinned() ? this->toString() : std::move(this->self);
+            this->reset();
+            return ret;
+        }
+
+        void reset() {
+            if (this->release) {
+                this->release();
+                this->release = nullptr;
+            }
+            this->self.clear();
+            Slice::operator=(Slice());
+        }
+    };
+};
+
+#endif
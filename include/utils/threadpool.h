@@ -0,0 +1,72 @@
+#ifndef __THREADPOOL_H
+#define __THREADPOOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace threadpool {
+    class ThreadPool {
+    private:
+        std::vector<std::thread> workers;
+        std::queue<std::function<void()>> tasks;
+        std::mutex mutex;
+        std::condition_variable cv;
+        bool stopping = false;
+
+        void loop() {
+            while (true) {
+                std::function<void()> task;
+                {
+                    std::unique_lock<std::mutex> lock(this->mutex);
+                    this->cv.wait(lock, [this] { return this->stopping || !this->tasks.empty(); });
+                    if (this->stopping && this->tasks.empty())
+                        return;
+                    task = std::move(this->tasks.front());
+                    this->tasks.pop();
+                }
+                task();
+            }
+        }
+
+    public:
+        ThreadPool(const size_t &nr_threads) {
+            for (size_t i = 0; i < nr_threads; i++)
+                this->workers.emplace_back([this] { this->loop(); });
+        }
+
+        ~ThreadPool() {
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                this->stopping = true;
+            }
+            this->cv.notify_all();
+            for (auto &worker : this->workers)
+                worker.join();
+        }
+
+        size_t size() const noexcept {
+            return this->workers.size();
+        }
+
+        template <typename F>
+        std::future<typename std::result_of<F()>::type> submit(F &&f) {
+            using R = typename std::result_of<F()>::type;
+            auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(f));
+            auto ret = task->get_future();
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                this->tasks.emplace([task] { (*task)(); });
+            }
+            this->cv.notify_one();
+            return ret;
+        }
+    };
+};  // namespace threadpool
+
+#endif
@@ -1,46 +1,663 @@
 #include <kvstore.h>
 
-void kvstore::KVStore::put(const uint64_t key, const std::string &s){
-    this->mtable->insert(key,s);
-    if(this->mtable->size() > MAX_CAPACITY)
-      this->flush();
+namespace {
+    // The value and expiry of a memtable value, read as `flags` say it
+    // is stored.
+    uint64_t unwrap(const memory::Slice &stored, uint8_t flags, std::string &value){
+        if(flags == memtable_generic::EXPIRES)
+            return expiry::unwrap(stored, &value);
+        value = stored.toString();
+        return expiry::NEVER;
+    }
+
+    // Memtable values whose expiry has passed read as deleted, so older
+    // versions stay hidden.
+    std::string visible(const memory::Slice &stored, uint8_t flags, uint64_t now){
+        std::string value;
+        if(expiry::expired(unwrap(stored, flags, value), now))
+            return kvstore::deleted;
+        return value;
+    }
+
+    // How a memtable value is written to a block.
+    sstable::ValueKind kind_of(uint8_t flags){
+        switch(flags){
+        case memtable_generic::EXPIRES:
+            return sstable::VALUE_EXPIRES;
+        case memtable_generic::OPERANDS:
+            return sstable::VALUE_MERGE;
+        default:
+            return sstable::VALUE_INLINE;
+        }
+    }
 }
-std::string kvstore::KVStore::get(const uint64_t key){
-    auto ret =this->mtable->search(key);
-    if(ret != ""){
-        if(ret == deleted)
-            return "";
+
+template <typename Key, typename Compare>
+std::string kvstore::BasicKVStore<Key, Compare>::fold(const std::string &operands, const std::string &base) const{
+    bool exists = !base.empty() && base != deleted;
+    std::string result;
+    if(this->merge_operator == nullptr ||
+       !this->merge_operator->fullMerge(exists ? &base : nullptr,
+                                        merge::decodeOperands(operands), result))
+        return deleted;
+    return result;
+}
+
+template <typename Key, typename Compare>
+std::string kvstore::BasicKVStore<Key, Compare>::stack(const std::string &older, uint8_t &flags,
+                                                      const std::string &operands) const{
+    auto op = this->merge_operator.get();
+    auto newer = merge::decodeOperands(operands);
+    if(older.empty() || flags == memtable_generic::OPERANDS){
+        auto all = merge::decodeOperands(older);
+        all.insert(all.end(), newer.begin(), newer.end());
+        flags = memtable_generic::OPERANDS;
+        return merge::encodeOperands(op, all);
+    }
+    std::string value, result;
+    uint64_t when = unwrap(older, flags, value);
+    bool gone = value == deleted || expiry::expired(when, expiry::now());
+    flags = memtable_generic::PLAIN;
+    if(op == nullptr || !op->fullMerge(gone ? nullptr : &value, newer, result))
+        return deleted;
+    if(gone || when == expiry::NEVER)
+        return result;
+    flags = memtable_generic::EXPIRES;
+    return expiry::wrap(result, when);
+}
+
+template <typename Key, typename Compare>
+void kvstore::BasicKVStore<Key, Compare>::make_room(){
+    size_t size = this->mtable->size();
+    this->budget->update(memory::MEMTABLE, this->charged, size);
+    this->charged = size;
+    // Values overwritten by longer ones leave their old bytes in the
+    // arena, so a memtable of a few hot keys is flushed on the arena's
+    // growth rather than on its own size.
+    bool full = size > this->write_buffer_size ||
+                this->mtable->allocated() > 2 * this->write_buffer_size;
+    if(!full && this->budget->exceeded()){
+        this->stable->shrinkCache();
+        full = this->budget->shouldFlush(size);
+        if(full)
+            statistics::record(this->stats, statistics::MEMORY_BUDGET_FLUSHES);
+    }
+    if(!full)
+        return;
+    if(this->flushers.empty())
+        this->flush();
+    else
+        this->seal();
+}
+
+template <typename Key, typename Compare>
+void kvstore::BasicKVStore<Key, Compare>::release_memtable(){
+    this->budget->release(memory::MEMTABLE, this->charged);
+    this->charged = 0;
+}
+
+template <typename Key, typename Compare>
+std::vector<std::shared_ptr<typename kvstore::BasicKVStore<Key, Compare>::Table>>
+kvstore::BasicKVStore<Key, Compare>::sealed() const{
+    std::vector<std::shared_ptr<Table>> ret;
+    if(this->flushers.empty())
         return ret;
+    std::lock_guard<std::mutex> lock(this->mutex);
+    for(auto it = this->immutables.rbegin(); it != this->immutables.rend(); it++)
+        ret.push_back(it->table);
+    return ret;
+}
+
+template <typename Key, typename Compare>
+bool kvstore::BasicKVStore<Key, Compare>::search_memtables(const Key &key, const std::vector<std::shared_ptr<Table>> &tables,
+                                                           std::string &ret, uint64_t now) const{
+    memory::InlineSlice stored;
+    uint8_t flags = memtable_generic::PLAIN;
+    ret.clear();
+    if(this->mtable->find(key, stored)){
+        ret = stored.toString();
+        flags = stored.flags();
+    }
+    for(size_t i = 0; ; i++){
+        if(ret != "" && flags != memtable_generic::OPERANDS){
+            ret = visible(ret, flags, now);
+            return true;
+        }
+        if(i == tables.size())
+            return false;
+        // Operands are folded into the first value below them.
+        if(!tables[i]->find(key, stored) || stored.size() == 0)
+            continue;
+        auto older = stored.toString();
+        uint8_t older_flags = stored.flags();
+        if(ret == ""){
+            ret = older;
+            flags = older_flags;
+        } else if(older_flags == memtable_generic::OPERANDS){
+            ret = this->stack(older, older_flags, ret);
+            flags = older_flags;
+        } else{
+            ret = this->fold(ret, visible(older, older_flags, now));
+            return true;
+        }
+    }
+}
+
+template <typename Key, typename Compare>
+void kvstore::BasicKVStore<Key, Compare>::put(const Key &key, const std::string &s){
+    this->put(key, s, this->default_ttl);
+}
+
+template <typename Key, typename Compare>
+void kvstore::BasicKVStore<Key, Compare>::put(const Key &key, const std::string &s, uint64_t ttl){
+    statistics::StopWatch watch(this->stats, statistics::PUT_MICROS);
+    statistics::record(this->stats, statistics::NUMBER_KEYS_WRITTEN);
+    statistics::record(this->stats, statistics::BYTES_WRITTEN, keys::KeyTraits<Key>::size(key) + s.size());
+    if(ttl == 0)
+        this->mtable->insert(key,s);
+    else
+        this->mtable->insert(key, expiry::wrap(s, expiry::now() + ttl), memtable_generic::EXPIRES);
+    this->make_room();
+}
+template <typename Key, typename Compare>
+std::string kvstore::BasicKVStore<Key, Compare>::get(const Key &key){
+    using namespace statistics;
+    StopWatch watch(this->stats, GET_MICROS);
+    record(this->stats, NUMBER_KEYS_READ);
+
+    std::string ret;
+    bool settled;
+    auto tables = this->sealed();
+    {
+        PerfTimer timer(get_perf_context().get_memtable_nanos);
+        settled = this->search_memtables(key, tables, ret, expiry::now());
+    }
+    std::shared_lock<std::shared_timed_mutex> guard(this->stable_mutex);
+    if(ret != ""){
+        record(this->stats, MEMTABLE_HIT);
+        perf_count(&PerfContext::memtable_hit_count);
+        if(!settled)
+            ret = this->fold(ret, this->stable->search(key));
     } else{
+        record(this->stats, MEMTABLE_MISS);
         ret = this->stable->search(key);
-        if(ret == deleted)
-            return "";
+    }
+    this->schedule_compaction();
+
+    if(ret == deleted)
+        return "";
+    if(ret != ""){
+        record(this->stats, NUMBER_KEYS_FOUND);
+        record(this->stats, BYTES_READ, ret.size());
+    }
+    return ret;
+}
+
+template <typename Key, typename Compare>
+bool kvstore::BasicKVStore<Key, Compare>::get_pinned(const Key &key, PinnableSlice &value){
+    using namespace statistics;
+    StopWatch watch(this->stats, GET_MICROS);
+    record(this->stats, NUMBER_KEYS_READ);
+
+    memory::InlineSlice stored;
+    const Table *hit = nullptr;
+    auto tables = this->sealed();
+    {
+        PerfTimer timer(get_perf_context().get_memtable_nanos);
+        if(this->mtable->find(key, stored))
+            hit = this->mtable.get();
+        for(size_t i = 0; hit == nullptr && i < tables.size(); i++){
+            if(tables[i]->find(key, stored))
+                hit = tables[i].get();
+        }
+    }
+    std::shared_lock<std::shared_timed_mutex> guard(this->stable_mutex);
+    if(hit != nullptr){
+        record(this->stats, MEMTABLE_HIT);
+        perf_count(&PerfContext::memtable_hit_count);
+        // Operands and values with an expiry are rebuilt; only plain
+        // values are pinned.
+        if(stored.flags() == memtable_generic::OPERANDS){
+            std::string ret;
+            if(!this->search_memtables(key, tables, ret, expiry::now()))
+                ret = this->fold(ret, this->stable->search(key));
+            value.pinSelf(std::move(ret));
+        } else if(stored.flags() == memtable_generic::EXPIRES)
+            value.pinSelf(visible(stored, stored.flags(), expiry::now()));
         else
-            return ret;
+            hit->pin(stored, value);
+    } else{
+        record(this->stats, MEMTABLE_MISS);
+        this->stable->searchPinned(key, value);
     }
+    this->schedule_compaction();
+
+    if(value.empty() || value == deleted){
+        value.reset();
+        return false;
+    }
+    record(this->stats, NUMBER_KEYS_FOUND);
+    record(this->stats, BYTES_READ, value.size());
+    return true;
+}
+
+template <typename Key, typename Compare>
+std::vector<std::string> kvstore::BasicKVStore<Key, Compare>::multi_get(const std::vector<Key> &keys){
+    statistics::StopWatch watch(this->stats, statistics::MULTIGET_MICROS);
+    statistics::record(this->stats, statistics::NUMBER_MULTIGET_KEYS, keys.size());
+    std::vector<std::string> ret(keys.size());
+    std::vector<Key> missing;
+    std::vector<size_t> slots;
+    uint64_t now = expiry::now();
+    auto tables = this->sealed();
+    std::shared_lock<std::shared_timed_mutex> guard(this->stable_mutex);
+    for(size_t i = 0; i < keys.size(); i++){
+        if(this->search_memtables(keys[i], tables, ret[i], now))
+            continue;
+        if(ret[i] == ""){
+            missing.push_back(keys[i]);
+            slots.push_back(i);
+        } else
+            ret[i] = this->fold(ret[i], this->stable->search(keys[i]));
+    }
+
+    auto found = this->stable->multiSearch(missing);
+    for(size_t i = 0; i < found.size(); i++)
+        ret[slots[i]] = std::move(found[i]);
+    this->schedule_compaction();
+
+    for(auto &value : ret){
+        if(value == deleted)
+            value = "";
+    }
+    return ret;
 }
 
-void kvstore::KVStore::reset(){
+template <typename Key, typename Compare>
+void kvstore::BasicKVStore<Key, Compare>::reset(){
     this->mtable->reset();
+    this->release_memtable();
+    this->wait_for_flushes();
+    std::lock_guard<std::shared_timed_mutex> guard(this->stable_mutex);
     this->stable->reset();
 }
 
-bool kvstore::KVStore::del(const uint64_t key){
+template <typename Key, typename Compare>
+bool kvstore::BasicKVStore<Key, Compare>::del(const Key &key){
     if(this->get(key).empty())
         return false;
     else{
+      statistics::record(this->stats, statistics::NUMBER_KEYS_DELETED);
       this->mtable->remove(key);
-      if(this->mtable->size() > MAX_CAPACITY)
-        this->flush();
+      this->make_room();
       return true;
     }
 }
-void kvstore::KVStore::flush(){
-    this->stable->flush(this->mtable->dump());
+template <typename Key, typename Compare>
+bool kvstore::BasicKVStore<Key, Compare>::merge(const Key &key, const std::string &operand){
+    auto op = this->merge_operator.get();
+    if(op == nullptr)
+        return false;
+    statistics::StopWatch watch(this->stats, statistics::PUT_MICROS);
+    statistics::record(this->stats, statistics::NUMBER_MERGES);
+    statistics::record(this->stats, statistics::BYTES_WRITTEN, keys::KeyTraits<Key>::size(key) + operand.size());
+
+    // A value already in the memtable is the newest one, so the operand
+    // is applied to it right away. Otherwise it joins the key's operands.
+    memory::InlineSlice stored;
+    std::string cur, next;
+    uint8_t flags = memtable_generic::PLAIN;
+    if(this->mtable->find(key, stored)){
+        cur = stored.toString();
+        flags = stored.flags();
+    }
+    if(cur.empty() || flags == memtable_generic::OPERANDS){
+        auto operands = merge::decodeOperands(cur);
+        operands.push_back(operand);
+        next = merge::encodeOperands(op, operands);
+        flags = memtable_generic::OPERANDS;
+    } else{
+        std::string value, result;
+        uint64_t when = unwrap(cur, flags, value);
+        bool gone = value == deleted || expiry::expired(when, expiry::now());
+        if(!op->fullMerge(gone ? nullptr : &value, {operand}, result))
+            return false;
+        if(gone || when == expiry::NEVER){
+            next = result;
+            flags = memtable_generic::PLAIN;
+        } else
+            next = expiry::wrap(result, when);
+    }
+    this->mtable->insert(key, next, flags);
+    this->make_room();
+    return true;
+}
+
+template <typename Key, typename Compare>
+void kvstore::BasicKVStore<Key, Compare>::set_merge_operator(std::shared_ptr<merge::MergeOperator> op){
+    std::lock_guard<std::shared_timed_mutex> guard(this->stable_mutex);
+    this->merge_operator = op;
+    this->stable->setMergeOperator(op);
+}
+
+template <typename Key, typename Compare>
+void kvstore::BasicKVStore<Key, Compare>::set_rate_limit(uint64_t bytes_per_sec, bool auto_tune){
+    this->stable->setRateLimit(bytes_per_sec, auto_tune);
+}
+
+template <typename Key, typename Compare>
+void kvstore::BasicKVStore<Key, Compare>::set_memory_budget(std::shared_ptr<memory::MemoryBudget> budget){
+    std::lock_guard<std::shared_timed_mutex> guard(this->stable_mutex);
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->budget->release(memory::MEMTABLE, this->charged);
+    budget->reserve(memory::MEMTABLE, this->charged);
+    for(const auto &imm : this->immutables){
+        this->budget->release(memory::IMMUTABLE_MEMTABLE, imm.charged);
+        budget->reserve(memory::IMMUTABLE_MEMTABLE, imm.charged);
+    }
+    this->stable->setMemoryBudget(budget);
+    this->budget = budget;
+}
+
+template <typename Key, typename Compare>
+std::shared_ptr<memory::MemoryBudget> kvstore::BasicKVStore<Key, Compare>::get_memory_budget() const{
+    return this->budget;
+}
+
+template <typename Key, typename Compare>
+statistics::Statistics *kvstore::BasicKVStore<Key, Compare>::get_statistics() const{
+    return this->stats;
+}
+
+template <typename Key, typename Compare>
+std::string kvstore::BasicKVStore<Key, Compare>::dump_statistics(bool json) const{
+    if(this->stats == nullptr)
+        return json ? "{}" : "";
+    return json ? this->stats->toJson() : this->stats->toString();
+}
+
+template <typename Key, typename Compare>
+std::string kvstore::BasicKVStore<Key, Compare>::get_property(const std::string &name) const{
+    if(name == "minilsm.cur-size-active-mem-table")
+        return std::to_string(this->mtable->size());
+    if(name == "minilsm.num-immutable-mem-table" || name == "minilsm.cur-size-all-mem-tables"){
+        size_t count = 0, bytes = this->mtable->size();
+        for(const auto &table : this->sealed()){
+            count++;
+            bytes += table->size();
+        }
+        return std::to_string(name == "minilsm.num-immutable-mem-table" ? count : bytes);
+    }
+    std::shared_lock<std::shared_timed_mutex> guard(this->stable_mutex);
+    std::string value;
+    if(!this->stable->getProperty(name, value))
+        return "";
+    return value;
+}
+
+template <typename Key, typename Compare>
+bool kvstore::BasicKVStore<Key, Compare>::ingest_files(const std::vector<std::string> &paths){
+    // Whatever the memtable holds is older than the files.
+    this->flush();
+    std::lock_guard<std::shared_timed_mutex> guard(this->stable_mutex);
+    return this->stable->ingest(paths);
+}
+
+template <typename Key, typename Compare>
+bool kvstore::BasicKVStore<Key, Compare>::checkpoint(const std::string &dir){
+    this->flush();
+    // No flush or compaction changes the tree while it is linked.
+    std::lock_guard<std::shared_timed_mutex> guard(this->stable_mutex);
+    return this->stable->checkpoint(dir);
+}
+
+template <typename Key, typename Compare>
+void kvstore::BasicKVStore<Key, Compare>::flush(){
+    if(!this->flushers.empty()){
+        if(this->mtable->size() != 0)
+            this->seal();
+        this->wait_for_flushes();
+        return;
+    }
+    if(this->mtable->size() == 0)
+        return;
+    // Writers are held up for as long as the flush and any compaction it
+    // triggers take.
+    statistics::StopWatch watch(nullptr, statistics::FLUSH_MICROS);
+    std::lock_guard<std::shared_timed_mutex> guard(this->stable_mutex);
+    // The block is written straight from the memtable's nodes, which are
+    // only freed once it is on disk, before any compaction runs.
+    {
+        sstable::EntryRefs<Key> block;
+        std::vector<sstable::ValueKind> kinds;
+        for(auto cursor = this->mtable->cursor(); cursor->valid(); cursor->next()){
+            block.emplace_back(&cursor->entry().first, cursor->entry().second);
+            kinds.push_back(kind_of(cursor->entry().second.flags()));
+        }
+        // The memtable is kept, and the flush tried again on the next
+        // write, until the block is on disk.
+        if(!this->stable->flush(block, kinds))
+            return;
+    }
+    this->mtable->reset();
+    this->release_memtable();
+    this->stable->maintain();
+    this->schedule_compaction();
+    statistics::record(this->stats, statistics::STALL_MICROS, watch.elapsed());
+}
+
+template <typename Key, typename Compare>
+void kvstore::BasicKVStore<Key, Compare>::seal(){
+    std::unique_lock<std::mutex> lock(this->mutex);
+    if(this->immutables.size() >= this->max_immutables){
+        // Writers are held up only while every slot is taken.
+        statistics::StopWatch watch(nullptr, statistics::FLUSH_MICROS);
+        this->changed.wait(lock, [this]{ return this->immutables.size() < this->max_immutables; });
+        statistics::record(this->stats, statistics::STALL_MICROS, watch.elapsed());
+    }
+    Immutable imm{this->next_seq++, std::move(this->mtable), this->charged, false, false, nullptr};
+    this->budget->release(memory::MEMTABLE, this->charged);
+    this->budget->reserve(memory::IMMUTABLE_MEMTABLE, this->charged);
+    this->charged = 0;
+    this->immutables.push_back(std::move(imm));
+    this->mtable = memtable::make<Key, Compare>(this->memtable_type, this->cmp);
+    this->changed.notify_all();
+}
+
+template <typename Key, typename Compare>
+void kvstore::BasicKVStore<Key, Compare>::wait_for_flushes(){
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->changed.wait(lock, [this]{ return this->immutables.empty(); });
+}
+
+template <typename Key, typename Compare>
+void kvstore::BasicKVStore<Key, Compare>::flush_loop(){
+    std::unique_lock<std::mutex> lock(this->mutex);
+    while(true){
+        auto first = std::find_if(this->immutables.begin(), this->immutables.end(),
+                                  [](const Immutable &imm){ return !imm.taken; });
+        if(first == this->immutables.end()){
+            if(this->stopping)
+                return;
+            this->changed.wait(lock);
+            continue;
+        }
+        // Memtables sealed early, by flush() or the memory budget, go out
+        // together while they fit in one block.
+        uint64_t seq = first->seq;
+        size_t bytes = 0;
+        std::vector<std::shared_ptr<Table>> tables;
+        for(auto it = first; it != this->immutables.end() && !it->taken; it++){
+            size_t size = it->table->size();
+            if(!tables.empty() && bytes + size > this->write_buffer_size)
+                break;
+            it->taken = true;
+            tables.push_back(it->table);
+            bytes += size;
+        }
+
+        lock.unlock();
+        auto block = this->write_block(tables);
+        lock.lock();
+
+        // Entries before ours are only removed once ours are committed.
+        size_t at = seq - this->immutables.front().seq;
+        if(block == nullptr && !this->stopping){
+            // Nothing was written: the memtables stay readable here and
+            // are tried again shortly. On shutdown they are dropped like
+            // the active one.
+            for(size_t i = 0; i < tables.size(); i++)
+                this->immutables[at + i].taken = false;
+            this->changed.wait_for(lock, std::chrono::milliseconds(100));
+            continue;
+        }
+        this->immutables[at].block = std::move(block);
+        for(size_t i = 0; i < tables.size(); i++)
+            this->immutables[at + i].written = true;
+        if(!this->committing)
+            this->commit_written(lock);
+    }
+}
+
+template <typename Key, typename Compare>
+std::unique_ptr<typename kvstore::BasicKVStore<Key, Compare>::Block>
+kvstore::BasicKVStore<Key, Compare>::write_block(const std::vector<std::shared_ptr<Table>> &tables){
+    sstable::EntryRefs<Key> block;
+    std::vector<sstable::ValueKind> kinds;
+    std::vector<std::unique_ptr<typename Table::Cursor>> cursors;
+    for(const auto &table : tables)
+        cursors.push_back(table->cursor());
+    // Values folded from several memtables, which the block points into.
+    std::deque<std::string> stacked;
+    while(true){
+        const Key *key = nullptr;
+        for(const auto &cursor : cursors){
+            if(cursor->valid() && (key == nullptr || this->cmp(cursor->entry().first, *key)))
+                key = &cursor->entry().first;
+        }
+        if(key == nullptr)
+            break;
+        Slice value;
+        uint8_t flags = memtable_generic::PLAIN;
+        bool found = false;
+        for(const auto &cursor : cursors){
+            if(!cursor->valid() || this->cmp(*key, cursor->entry().first))
+                continue;
+            const auto &entry = cursor->entry();
+            if(found && entry.second.flags() == memtable_generic::OPERANDS){
+                stacked.push_back(this->stack(value.toString(), flags, entry.second.toString()));
+                value = Slice(stacked.back());
+            } else{
+                value = entry.second;
+                flags = entry.second.flags();
+            }
+            found = true;
+            cursor->next();
+        }
+        block.emplace_back(key, value);
+        kinds.push_back(kind_of(flags));
+    }
+    return this->stable->prepareFlush(block, kinds);
 }
 
-void kvstore::KVStore::scan(const uint64_t key1, const uint64_t key2, std::list<std::pair<uint64_t, std::string>> &list){
-    (void) key1;
-    (void) key2;
-    (void) list;
+template <typename Key, typename Compare>
+void kvstore::BasicKVStore<Key, Compare>::commit_written(std::unique_lock<std::mutex> &lock){
+    this->committing = true;
+    while(!this->immutables.empty() && this->immutables.front().written){
+        size_t ready = 0;
+        std::vector<std::unique_ptr<Block> *> blocks;
+        for(; ready < this->immutables.size() && this->immutables[ready].written; ready++){
+            if(this->immutables[ready].block != nullptr)
+                blocks.push_back(&this->immutables[ready].block);
+        }
+
+        lock.unlock();
+        {
+            std::lock_guard<std::shared_timed_mutex> guard(this->stable_mutex);
+            for(auto block : blocks)
+                this->stable->commitFlush(*block);
+            this->stable->maintain();
+            this->schedule_compaction();
+        }
+        lock.lock();
+
+        for(size_t i = 0; i < ready; i++){
+            this->budget->release(memory::IMMUTABLE_MEMTABLE, this->immutables.front().charged);
+            this->immutables.pop_front();
+        }
+        this->changed.notify_all();
+    }
+    this->committing = false;
 }
+
+template <typename Key, typename Compare>
+void kvstore::BasicKVStore<Key, Compare>::schedule_compaction(){
+    if(!this->compactor.joinable() || !this->stable->needsCompaction())
+        return;
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->compaction_wanted = true;
+    this->compaction_requested.notify_one();
+}
+
+template <typename Key, typename Compare>
+void kvstore::BasicKVStore<Key, Compare>::compact_loop(){
+    std::unique_lock<std::mutex> lock(this->mutex);
+    while(true){
+        this->compaction_requested.wait(lock, [this]{ return this->stopping || this->compaction_wanted; });
+        if(this->stopping)
+            return;
+        this->compaction_wanted = false;
+        // One compaction at a time, so reads and flushes get in between.
+        bool compacted = false;
+        while(!this->stopping){
+            lock.unlock();
+            {
+                std::lock_guard<std::shared_timed_mutex> guard(this->stable_mutex);
+                if(!this->stable->compactOnce()){
+                    if(compacted)
+                        this->stable->collectGarbage();
+                    lock.lock();
+                    break;
+                }
+            }
+            compacted = true;
+            lock.lock();
+        }
+    }
+}
+
+template <typename Key, typename Compare>
+void kvstore::BasicKVStore<Key, Compare>::scan(const Key &key1, const Key &key2, std::list<std::pair<Key, std::string>> &list){
+    statistics::StopWatch watch(this->stats, statistics::SCAN_MICROS);
+    statistics::record(this->stats, statistics::NUMBER_SCANS);
+    std::map<Key, std::string, Compare> merged(this->cmp);
+    auto tables = this->sealed();
+    {
+        std::shared_lock<std::shared_timed_mutex> guard(this->stable_mutex);
+        this->stable->scan(key1, key2, merged);
+    }
+
+    // Oldest memtable first, so each one's entries override the last.
+    tables.insert(tables.begin(), nullptr);
+    uint64_t now = expiry::now();
+    for(auto table = tables.rbegin(); table != tables.rend(); table++){
+        std::vector<typename Table::Entry> recent;
+        (*table == nullptr ? *this->mtable : **table).scanEntries(key1, key2, recent);
+        for(const auto &kv : recent){
+            uint8_t flags = kv.second.flags();
+            if(flags == memtable_generic::OPERANDS){
+                auto base = merged.find(kv.first);
+                merged[kv.first] = this->fold(kv.second.toString(), base == merged.end() ? "" : base->second);
+            } else
+                merged[kv.first] = visible(kv.second, flags, now);
+        }
+    }
+
+    for(auto &kv : merged){
+        if(kv.second != deleted)
+            list.emplace_back(kv.first, std::move(kv.second));
+    }
+}
+
+template class kvstore::BasicKVStore<uint64_t>;
+template class kvstore::BasicKVStore<std::string>;
@@ -0,0 +1,126 @@
+#include <sstable/cache.h>
+
+#include <cstring>
+#include <new>
+
+sstable::ValueCache::ValueCache(uint64_t capacity,
+                                std::shared_ptr<memory::MemoryBudget> budget)
+    : capacity(capacity), used(0), budget(budget) {
+  this->lru.prev = this->lru.next = &this->lru;
+}
+
+sstable::ValueCache::~ValueCache() {
+  while (this->lru.next != &this->lru) {
+    Entry *e = this->lru.next;
+    this->unlink(e);
+    ::operator delete(e);
+  }
+  this->budget->release(memory::BLOCK_CACHE, this->used);
+}
+
+uint64_t sstable::ValueCache::charge(const Entry *e) {
+  return e->size + ENTRY_OVERHEAD;
+}
+
+void sstable::ValueCache::unlink(Entry *e) {
+  e->prev->next = e->next;
+  e->next->prev = e->prev;
+}
+
+void sstable::ValueCache::pushFront(Entry *e) {
+  e->prev = &this->lru;
+  e->next = this->lru.next;
+  this->lru.next->prev = e;
+  this->lru.next = e;
+}
+
+void sstable::ValueCache::evict(uint64_t room) {
+  while (this->lru.prev != &this->lru && this->used > room) {
+    Entry *victim = this->lru.prev;
+    uint64_t bytes = charge(victim);
+    this->map.erase(std::make_pair(victim->block, victim->offset));
+    this->unlink(victim);
+    victim->cached = false;
+    if (victim->pins == 0)
+      ::operator delete(victim);
+    this->used -= bytes;
+    this->budget->release(memory::BLOCK_CACHE, bytes);
+  }
+}
+
+bool sstable::ValueCache::lookup(uint64_t block, uint64_t offset,
+                                 std::string &value) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  auto it = this->map.find(std::make_pair(block, offset));
+  if (it == this->map.end())
+    return false;
+  Entry *e = it->second;
+  this->unlink(e);
+  this->pushFront(e);
+  value.assign(e->data(), e->size);
+  return true;
+}
+
+bool sstable::ValueCache::lookup(uint64_t block, uint64_t offset,
+                                 memory::PinnableSlice &value) {
+  // Let go of what the slice held first; it may be an entry of this cache.
+  value.reset();
+  std::lock_guard<std::mutex> lock(this->mutex);
+  auto it = this->map.find(std::make_pair(block, offset));
+  if (it == this->map.end())
+    return false;
+  Entry *e = it->second;
+  this->unlink(e);
+  this->pushFront(e);
+  e->pins++;
+  // The pin keeps the cache alive, since a reset may drop it meanwhile.
+  auto self = this->shared_from_this();
+  value.pin(memory::Slice(e->data(), e->size), [self, e] { self->unpin(e); });
+  return true;
+}
+
+void sstable::ValueCache::unpin(Entry *e) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  if (--e->pins == 0 && !e->cached)
+    ::operator delete(e);
+}
+
+void sstable::ValueCache::insert(uint64_t block, uint64_t offset,
+                                 const std::string &value) {
+  if (value.size() + ENTRY_OVERHEAD > this->capacity)
+    return;
+  std::lock_guard<std::mutex> lock(this->mutex);
+  auto key = std::make_pair(block, offset);
+  if (this->map.count(key) != 0)
+    return;
+  Entry *e = static_cast<Entry *>(::operator new(sizeof(Entry) + value.size()));
+  e->block = block;
+  e->offset = offset;
+  e->size = value.size();
+  e->pins = 0;
+  e->cached = true;
+  memcpy(e->data(), value.data(), value.size());
+  this->pushFront(e);
+  this->map[key] = e;
+  uint64_t bytes = charge(e);
+  this->used += bytes;
+  this->budget->reserve(memory::BLOCK_CACHE, bytes);
+  this->evict(std::min(this->capacity, this->budget->cacheRoom(this->used)));
+}
+
+void sstable::ValueCache::shrink() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->evict(this->budget->cacheRoom(this->used));
+}
+
+void sstable::ValueCache::setBudget(std::shared_ptr<memory::MemoryBudget> budget) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->budget->release(memory::BLOCK_CACHE, this->used);
+  budget->reserve(memory::BLOCK_CACHE, this->used);
+  this->budget = budget;
+}
+
+uint64_t sstable::ValueCache::usage() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  return this->used;
+}
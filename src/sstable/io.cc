@@ -0,0 +1,464 @@
+#include <sstable/io.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+namespace {
+/**
+ * Region of the file actually transferred for one request. Direct I/O
+ * needs offset, length and memory aligned, so the read is widened and
+ * the requested bytes are copied out at `skip` afterwards.
+ */
+struct Staging {
+  uint64_t offset;
+  size_t size;
+  char *buf;
+  size_t skip;
+  bool owned;
+};
+
+uint64_t align_down(uint64_t x) {
+  return x & ~(uint64_t)(sstable::io::DIRECT_IO_ALIGNMENT - 1);
+}
+
+uint64_t align_up(uint64_t x) {
+  return align_down(x + sstable::io::DIRECT_IO_ALIGNMENT - 1);
+}
+
+Staging stage(sstable::io::ReadRequest &req, bool direct) {
+  req.result.assign(req.size, 0);
+  req.ok = false;
+  if (!direct)
+    return Staging{req.offset, req.size, &req.result[0], 0, false};
+
+  uint64_t begin = align_down(req.offset);
+  uint64_t end = align_up(req.offset + req.size);
+  void *buf = nullptr;
+  if (posix_memalign(&buf, sstable::io::DIRECT_IO_ALIGNMENT, end - begin) != 0)
+    return Staging{req.offset, req.size, &req.result[0], 0, false};
+  return Staging{begin, end - begin, static_cast<char *>(buf),
+                 req.offset - begin, true};
+}
+
+void finish(sstable::io::ReadRequest &req, Staging &s, size_t got) {
+  req.ok = got >= s.skip + req.size;
+  if (s.owned) {
+    if (got > s.skip)
+      memcpy(&req.result[0], s.buf + s.skip, std::min(got - s.skip, req.size));
+    free(s.buf);
+    s.buf = nullptr;
+  }
+}
+
+size_t pread_full(int fd, char *buf, size_t size, uint64_t offset) {
+  size_t got = 0;
+  while (got < size) {
+    ssize_t n = ::pread(fd, buf + got, size - got, offset + got);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+    got += n;
+  }
+  return got;
+}
+
+// Write buffers are kept for the next file rather than freed: a fresh
+// megabyte from the allocator is a fresh mapping, faulted in page by
+// page on every flush. The list is never destroyed, so files closed
+// during static destruction can still hand theirs back.
+const size_t KEPT_WRITE_BUFFERS = 4;
+
+struct KeptBuffers {
+  std::mutex mutex;
+  std::vector<char *> buffers;
+};
+
+KeptBuffers &kept() {
+  static KeptBuffers *kept = new KeptBuffers;
+  return *kept;
+}
+
+char *acquire_buffer() {
+  {
+    auto &k = kept();
+    std::lock_guard<std::mutex> lock(k.mutex);
+    if (!k.buffers.empty()) {
+      char *buf = k.buffers.back();
+      k.buffers.pop_back();
+      return buf;
+    }
+  }
+  void *buf = nullptr;
+  if (posix_memalign(&buf, sstable::io::DIRECT_IO_ALIGNMENT,
+                     sstable::io::WRITE_BUFFER_SIZE) != 0)
+    return nullptr;
+  return static_cast<char *>(buf);
+}
+
+void release_buffer(char *buf) {
+  if (buf == nullptr)
+    return;
+  {
+    auto &k = kept();
+    std::lock_guard<std::mutex> lock(k.mutex);
+    if (k.buffers.size() < KEPT_WRITE_BUFFERS) {
+      k.buffers.push_back(buf);
+      return;
+    }
+  }
+  free(buf);
+}
+
+bool write_full(int fd, const char *buf, size_t size) {
+  size_t done = 0;
+  while (done < size) {
+    ssize_t n = ::write(fd, buf + done, size - done);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    done += n;
+  }
+  return true;
+}
+} // namespace
+
+sstable::io::WritableFile::WritableFile(const std::string &filename,
+                                        bool direct, RateLimiter *limiter,
+                                        IOPriority pri) {
+  int flags = O_WRONLY | O_CREAT | O_TRUNC;
+  this->fd = -1;
+  this->direct = direct;
+  this->limiter = limiter;
+  this->pri = pri;
+  this->used = 0;
+  this->written = 0;
+  this->delayed = 0;
+#ifdef O_DIRECT
+  if (direct)
+    this->fd = ::open(filename.c_str(), flags | O_DIRECT, 0644);
+#endif
+  if (this->fd < 0) {
+    // Not every filesystem (tmpfs, for one) accepts O_DIRECT.
+    this->direct = false;
+    this->fd = ::open(filename.c_str(), flags, 0644);
+  }
+  this->buffer = acquire_buffer();
+}
+
+sstable::io::WritableFile::~WritableFile() {
+  this->close();
+  release_buffer(this->buffer);
+}
+
+bool sstable::io::WritableFile::drain(size_t size) {
+  if (this->limiter != nullptr)
+    this->delayed += this->limiter->request(size, this->pri);
+  bool ok = write_full(this->fd, this->buffer, size);
+  this->written += this->used;
+  this->used = 0;
+  return ok;
+}
+
+bool sstable::io::WritableFile::append(const char *data, size_t size) {
+  if (this->fd < 0 || this->buffer == nullptr)
+    return false;
+  while (size != 0) {
+    size_t n = std::min(size, WRITE_BUFFER_SIZE - this->used);
+    memcpy(this->buffer + this->used, data, n);
+    this->used += n;
+    data += n;
+    size -= n;
+    if (this->used == WRITE_BUFFER_SIZE && !this->drain(WRITE_BUFFER_SIZE))
+      return false;
+  }
+  return true;
+}
+
+bool sstable::io::WritableFile::close() {
+  if (this->fd < 0)
+    return true;
+  bool ok = true;
+  if (this->used != 0) {
+    if (this->direct) {
+      // The tail has to go out as whole blocks; trim the padding after.
+      uint64_t logical = this->written + this->used;
+      size_t padded = align_up(this->used);
+      memset(this->buffer + this->used, 0, padded - this->used);
+      ok = this->drain(padded) && ::ftruncate(this->fd, logical) == 0;
+    } else
+      ok = this->drain(this->used);
+  }
+  ::close(this->fd);
+  this->fd = -1;
+  return ok;
+}
+
+int sstable::io::IOBackend::open(const std::string &filename) const {
+#ifdef O_DIRECT
+  if (this->direct_reads) {
+    int fd = ::open(filename.c_str(), O_RDONLY | O_DIRECT);
+    if (fd >= 0)
+      return fd;
+  }
+#endif
+  return ::open(filename.c_str(), O_RDONLY);
+}
+
+void sstable::io::IOBackend::close(int fd) const {
+  if (fd >= 0)
+    ::close(fd);
+}
+
+uint64_t sstable::io::IOBackend::fileSize(int fd) const {
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0)
+    return 0;
+  return st.st_size;
+}
+
+std::unique_ptr<sstable::io::WritableFile>
+sstable::io::IOBackend::create(const std::string &filename,
+                               IOPriority pri) const {
+  return std::make_unique<WritableFile>(filename, this->direct,
+                                        this->limiter.get(), pri);
+}
+
+void sstable::io::IOBackend::readAll(ReadRequest &req) const {
+  Staging s = stage(req, this->direct_reads);
+  finish(req, s, pread_full(req.fd, s.buf, s.size, s.offset));
+}
+
+std::string sstable::io::IOBackend::read(int fd, uint64_t offset,
+                                         size_t size) {
+  std::vector<ReadRequest> reqs(1);
+  reqs[0].fd = fd;
+  reqs[0].offset = offset;
+  reqs[0].size = size;
+  this->readAll(reqs[0]);
+  return std::move(reqs[0].result);
+}
+
+void sstable::io::IOBackend::submit(std::vector<ReadRequest> &reqs) {
+  for (auto &req : reqs)
+    this->readAll(req);
+}
+
+sstable::io::ThreadPoolIO::ThreadPoolIO(bool direct, size_t nr_threads)
+    : IOBackend(direct), pool(std::max<size_t>(nr_threads, 1)) {}
+
+void sstable::io::ThreadPoolIO::submit(std::vector<ReadRequest> &reqs) {
+  if (reqs.size() <= 1) {
+    IOBackend::submit(reqs);
+    return;
+  }
+  std::vector<std::future<void>> pending;
+  pending.reserve(reqs.size());
+  for (auto &req : reqs)
+    pending.push_back(this->pool.submit([this, &req] { this->readAll(req); }));
+  for (auto &f : pending)
+    f.wait();
+}
+
+#if defined(__linux__)
+/**
+ * A bare io_uring instance driven through the raw syscalls, so that no
+ * liburing is needed at build time.
+ */
+struct sstable::io::UringIO::Ring {
+  int fd = -1;
+  unsigned entries = 0;
+  void *sq_ptr = MAP_FAILED;
+  void *cq_ptr = MAP_FAILED;
+  size_t sq_len = 0;
+  size_t cq_len = 0;
+  io_uring_sqe *sqes = static_cast<io_uring_sqe *>(MAP_FAILED);
+  size_t sqes_len = 0;
+  unsigned *sq_tail, *sq_mask, *sq_array;
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  io_uring_cqe *cqes;
+
+  Ring(unsigned nr_entries) {
+    io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    this->fd = syscall(__NR_io_uring_setup, nr_entries, &p);
+    if (this->fd < 0)
+      return;
+
+    this->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    this->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+    if (single)
+      this->sq_len = this->cq_len = std::max(this->sq_len, this->cq_len);
+
+    this->sq_ptr = mmap(nullptr, this->sq_len, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, this->fd, IORING_OFF_SQ_RING);
+    if (this->sq_ptr == MAP_FAILED) {
+      this->teardown();
+      return;
+    }
+    this->cq_ptr = single ? this->sq_ptr
+                          : mmap(nullptr, this->cq_len, PROT_READ | PROT_WRITE,
+                                 MAP_SHARED | MAP_POPULATE, this->fd,
+                                 IORING_OFF_CQ_RING);
+    if (this->cq_ptr == MAP_FAILED) {
+      this->teardown();
+      return;
+    }
+    this->sqes_len = p.sq_entries * sizeof(io_uring_sqe);
+    this->sqes = static_cast<io_uring_sqe *>(
+        mmap(nullptr, this->sqes_len, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, this->fd, IORING_OFF_SQES));
+    if (this->sqes == MAP_FAILED) {
+      this->teardown();
+      return;
+    }
+
+    char *sq = static_cast<char *>(this->sq_ptr);
+    char *cq = static_cast<char *>(this->cq_ptr);
+    this->sq_tail = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+    this->sq_mask = reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+    this->sq_array = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+    this->cq_head = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+    this->cq_tail = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+    this->cq_mask = reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+    this->cqes = reinterpret_cast<io_uring_cqe *>(cq + p.cq_off.cqes);
+    this->entries = p.sq_entries;
+  }
+
+  ~Ring() { this->teardown(); }
+
+  void teardown() {
+    if (this->sqes != MAP_FAILED)
+      munmap(this->sqes, this->sqes_len);
+    if (this->cq_ptr != MAP_FAILED && this->cq_ptr != this->sq_ptr)
+      munmap(this->cq_ptr, this->cq_len);
+    if (this->sq_ptr != MAP_FAILED)
+      munmap(this->sq_ptr, this->sq_len);
+    if (this->fd >= 0)
+      ::close(this->fd);
+    this->sqes = static_cast<io_uring_sqe *>(MAP_FAILED);
+    this->sq_ptr = this->cq_ptr = MAP_FAILED;
+    this->fd = -1;
+    this->entries = 0;
+  }
+};
+
+sstable::io::UringIO::UringIO(bool direct, unsigned entries)
+    : IOBackend(direct), ring(new Ring(entries)) {}
+
+sstable::io::UringIO::~UringIO() {}
+
+bool sstable::io::UringIO::valid() const { return this->ring->entries != 0; }
+
+void sstable::io::UringIO::submit(std::vector<ReadRequest> &reqs) {
+  if (reqs.size() <= 1) {
+    IOBackend::submit(reqs);
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(this->mutex);
+  Ring &r = *this->ring;
+  size_t n = reqs.size();
+  std::vector<Staging> staging(n);
+  std::vector<iovec> iov(n);
+  std::vector<bool> done(n, false);
+  for (size_t i = 0; i < n; i++) {
+    staging[i] = stage(reqs[i], this->direct_reads);
+    iov[i].iov_base = staging[i].buf;
+    iov[i].iov_len = staging[i].size;
+  }
+
+  size_t next = 0, inflight = 0, completed = 0;
+  unsigned unsubmitted = 0;
+  bool failed = false;
+  while (completed < n && !(failed && inflight == 0)) {
+    unsigned tail = *r.sq_tail;
+    while (!failed && next < n && inflight < r.entries) {
+      unsigned idx = tail & *r.sq_mask;
+      io_uring_sqe *sqe = &r.sqes[idx];
+      memset(sqe, 0, sizeof(*sqe));
+      sqe->opcode = IORING_OP_READV;
+      sqe->fd = reqs[next].fd;
+      sqe->addr = reinterpret_cast<uint64_t>(&iov[next]);
+      sqe->len = 1;
+      sqe->off = staging[next].offset;
+      sqe->user_data = next;
+      r.sq_array[idx] = idx;
+      tail++;
+      next++;
+      inflight++;
+      unsubmitted++;
+    }
+    __atomic_store_n(r.sq_tail, tail, __ATOMIC_RELEASE);
+
+    int ret = syscall(__NR_io_uring_enter, r.fd, unsubmitted, 1,
+                      IORING_ENTER_GETEVENTS, nullptr, 0);
+    if (ret >= 0)
+      unsubmitted -= std::min<unsigned>(ret, unsubmitted);
+    else if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+      // Take back what the kernel never saw; those requests are read
+      // synchronously once the ones already in flight have landed.
+      __atomic_store_n(r.sq_tail, tail - unsubmitted, __ATOMIC_RELEASE);
+      inflight -= unsubmitted;
+      unsubmitted = 0;
+      failed = true;
+    }
+
+    unsigned head = *r.cq_head;
+    while (head != __atomic_load_n(r.cq_tail, __ATOMIC_ACQUIRE)) {
+      io_uring_cqe *cqe = &r.cqes[head & *r.cq_mask];
+      size_t i = cqe->user_data;
+      size_t got = cqe->res < 0 ? 0 : cqe->res;
+      if (got < staging[i].size)
+        got += pread_full(reqs[i].fd, staging[i].buf + got,
+                          staging[i].size - got, staging[i].offset + got);
+      finish(reqs[i], staging[i], got);
+      done[i] = true;
+      head++;
+      inflight--;
+      completed++;
+    }
+    __atomic_store_n(r.cq_head, head, __ATOMIC_RELEASE);
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    if (done[i])
+      continue;
+    finish(reqs[i], staging[i],
+           pread_full(reqs[i].fd, staging[i].buf, staging[i].size,
+                      staging[i].offset));
+  }
+}
+#endif
+
+std::shared_ptr<sstable::io::IOBackend>
+sstable::io::make_backend(Backend backend, bool direct, size_t nr_threads) {
+  switch (backend) {
+  case IO_URING: {
+#if defined(__linux__)
+    auto uring = std::make_shared<UringIO>(direct, 64);
+    if (uring->valid())
+      return uring;
+#endif
+    return std::make_shared<ThreadPoolIO>(direct, nr_threads);
+  }
+  case PREAD_POOL:
+    return std::make_shared<ThreadPoolIO>(direct, nr_threads);
+  default:
+    return std::make_shared<IOBackend>(direct);
+  }
+}
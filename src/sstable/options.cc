@@ -0,0 +1,143 @@
+#include <sstable/options.h>
+
+#include <cctype>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+
+sstable::Options sstable::Options::fromFile(const std::string &path) {
+  Options ret;
+  std::vector<std::pair<Policy, size_t>> levels;
+  std::unordered_map<std::string, std::string> settings;
+  std::ifstream ifile(path);
+  std::string line;
+  while (std::getline(ifile, line)) {
+    std::istringstream iline(line);
+    std::string first;
+    if (!(iline >> first) || first[0] == '#')
+      continue;
+
+    if (isdigit(first[0])) {
+      size_t limit;
+      std::string mode;
+      if (!(iline >> limit >> mode))
+        continue;
+      if (mode == "Leveling")
+        levels.push_back(std::make_pair(LEVELING, limit));
+      else if (mode == "Universal")
+        levels.push_back(std::make_pair(UNIVERSAL, limit));
+      else
+        levels.push_back(std::make_pair(TIERING, limit));
+    } else {
+      std::string value;
+      if (iline >> value)
+        settings[first] = value;
+    }
+  }
+  if (!levels.empty())
+    ret.levels = levels;
+
+  auto get = [&settings](const std::string &name, const std::string &dflt) {
+    auto it = settings.find(name);
+    return it == settings.end() ? dflt : it->second;
+  };
+
+  // Lazy leveling: tiers everywhere but the last level, which holds most
+  // of the data and is kept as a single run.
+  if (get("compaction_style", "") == "lazy_leveling") {
+    for (auto &level : ret.levels)
+      level.first = TIERING;
+    ret.levels.back().first = LEVELING;
+  }
+
+  ret.dynamic_levels = get("dynamic_level_sizing", "off") == "on";
+  ret.level_fanout = std::max(2ul, std::stoul(get("level_fanout", "10")));
+  ret.background_compaction = get("background_compaction", "off") == "on";
+  ret.seek_miss_limit = std::stoull(get("seek_miss_limit", "0"));
+  ret.tombstone_compaction_ratio =
+      std::stod(get("tombstone_compaction_ratio", "0"));
+
+  auto backend = get("memtable", "rbtree");
+  if (backend == "avltree")
+    ret.memtable = memtable::MEMTABLE_USE_AVLTREE;
+  else if (backend == "skiplist")
+    ret.memtable = memtable::MEMTABLE_USE_SKIPLIST;
+  else if (backend == "bptree")
+    ret.memtable = memtable::MEMTABLE_USE_BPTREE;
+  else if (backend == "hashskiplist")
+    ret.memtable = memtable::MEMTABLE_USE_HASH_SKIPLIST;
+  ret.write_buffer_size = std::stoull(
+      get("write_buffer_size", std::to_string(DEFAULT_WRITE_BUFFER_SIZE)));
+  ret.max_immutable_memtables =
+      std::stoul(get("max_immutable_memtables", "0"));
+  ret.flush_threads = std::max(1ul, std::stoul(get("flush_threads", "1")));
+  ret.block_cache_size = std::stoull(get("block_cache_size", "0"));
+  ret.memory_limit = std::stoull(get("memory_limit", "0"));
+  ret.bloom_filter_size =
+      std::stoull(get("bloom_filter_size", std::to_string(BLOOMFILTER_SIZE)));
+
+  auto name = get("io_backend", "sync");
+  if (name == "io_uring")
+    ret.io_backend = io::IO_URING;
+  else if (name == "pread")
+    ret.io_backend = io::PREAD_POOL;
+  ret.direct_io = get("direct_io", "off") == "on";
+  ret.direct_reads = get("direct_reads", "off") == "on";
+  ret.io_threads = std::stoul(get("io_threads", "4"));
+
+  ret.rate_limit = std::stoull(get("rate_limit", "0"));
+  ret.rate_limit_auto = get("rate_limit_auto", "off") == "on";
+  ret.statistics = get("statistics", "on") == "on";
+  ret.vlog_threshold = std::stoull(get("vlog_threshold", "0"));
+  ret.vlog_gc_ratio = std::stod(get("vlog_gc_ratio", "0.5"));
+  ret.default_ttl = std::stoull(get("default_ttl", "0"));
+
+  ret.universal.size_ratio = std::stoul(get("universal_size_ratio", "1"));
+  ret.universal.min_merge_width =
+      std::max(2ul, std::stoul(get("universal_min_merge_width", "2")));
+  ret.universal.max_size_amplification =
+      std::stoul(get("universal_max_size_amplification", "200"));
+  return ret;
+}
+
+bool sstable::Options::toFile(const std::string &path) const {
+  static const char *policies[] = {"Tiering", "Leveling", "Universal"};
+  static const char *memtables[] = {"avltree", "rbtree", "skiplist", "bptree",
+                                    "hashskiplist"};
+  static const char *backends[] = {"sync", "pread", "io_uring"};
+  auto onoff = [](bool on) { return on ? "on" : "off"; };
+
+  std::ofstream ofile(path);
+  // Enough digits for fractions to read back exactly.
+  ofile.precision(17);
+  for (size_t i = 0; i < this->levels.size(); i++)
+    ofile << i << " " << this->levels[i].second << " "
+          << policies[this->levels[i].first] << "\n";
+  ofile << "dynamic_level_sizing " << onoff(this->dynamic_levels) << "\n"
+        << "level_fanout " << this->level_fanout << "\n"
+        << "background_compaction " << onoff(this->background_compaction) << "\n"
+        << "seek_miss_limit " << this->seek_miss_limit << "\n"
+        << "tombstone_compaction_ratio " << this->tombstone_compaction_ratio << "\n"
+        << "memtable " << memtables[this->memtable] << "\n"
+        << "write_buffer_size " << this->write_buffer_size << "\n"
+        << "max_immutable_memtables " << this->max_immutable_memtables << "\n"
+        << "flush_threads " << this->flush_threads << "\n"
+        << "block_cache_size " << this->block_cache_size << "\n"
+        << "memory_limit " << this->memory_limit << "\n"
+        << "bloom_filter_size " << this->bloom_filter_size << "\n"
+        << "io_backend " << backends[this->io_backend] << "\n"
+        << "direct_io " << onoff(this->direct_io) << "\n"
+        << "direct_reads " << onoff(this->direct_reads) << "\n"
+        << "io_threads " << this->io_threads << "\n"
+        << "rate_limit " << this->rate_limit << "\n"
+        << "rate_limit_auto " << onoff(this->rate_limit_auto) << "\n"
+        << "statistics " << onoff(this->statistics) << "\n"
+        << "vlog_threshold " << this->vlog_threshold << "\n"
+        << "vlog_gc_ratio " << this->vlog_gc_ratio << "\n"
+        << "default_ttl " << this->default_ttl << "\n"
+        << "universal_size_ratio " << this->universal.size_ratio << "\n"
+        << "universal_min_merge_width " << this->universal.min_merge_width << "\n"
+        << "universal_max_size_amplification "
+        << this->universal.max_size_amplification << "\n";
+  return bool(ofile);
+}
@@ -0,0 +1,138 @@
+#include <sstable/ratelimiter.h>
+
+#include <algorithm>
+
+sstable::RateLimiter::RateLimiter(uint64_t bytes_per_sec, bool auto_tune) {
+  this->rate = bytes_per_sec;
+  this->compaction_rate = bytes_per_sec;
+  this->min_rate = std::max<uint64_t>(bytes_per_sec / AUTO_TUNE_FLOOR_DIV, 1);
+  this->auto_tune = auto_tune;
+  this->tokens = burst(this->rate);
+  this->compaction_tokens = burst(this->compaction_rate);
+  this->last_refill = clock::now();
+  std::fill(this->total_bytes, this->total_bytes + NR_IO_PRIORITIES, 0);
+}
+
+uint64_t sstable::RateLimiter::burst(uint64_t rate) {
+  return std::max<uint64_t>(rate * REFILL_PERIOD_US / 1000000, 4096);
+}
+
+uint64_t sstable::RateLimiter::rateOf(int pri) const {
+  return pri == IO_FLUSH ? this->rate : this->compaction_rate;
+}
+
+void sstable::RateLimiter::refill() {
+  auto now = clock::now();
+  auto elapsed =
+      std::chrono::duration_cast<std::chrono::microseconds>(now - this->last_refill)
+          .count();
+  this->last_refill = now;
+  this->tokens = std::min<double>(
+      burst(this->rate), this->tokens + (double)this->rate * elapsed / 1000000);
+  this->compaction_tokens = std::min<double>(
+      burst(this->compaction_rate),
+      this->compaction_tokens + (double)this->compaction_rate * elapsed / 1000000);
+}
+
+void sstable::RateLimiter::grant() {
+  bool granted = false;
+  for (int p = 0; p < NR_IO_PRIORITIES; p++) {
+    while (!this->queues[p].empty()) {
+      Request *req = this->queues[p].front();
+      if (this->rate != 0) {
+        // A piece queued under a bigger burst than the current one is
+        // served a burst at a time, as the bucket never holds more.
+        bool compaction = p != IO_FLUSH;
+        uint64_t piece = std::min(req->bytes, burst(this->rateOf(p)));
+        // Strict priority: nothing below may overtake a starved request.
+        if (this->tokens < piece || (compaction && this->compaction_tokens < piece))
+          goto out;
+        this->tokens -= piece;
+        if (compaction)
+          this->compaction_tokens -= piece;
+        req->bytes -= piece;
+        if (req->bytes != 0)
+          continue;
+      }
+      req->granted = true;
+      granted = true;
+      this->queues[p].pop_front();
+    }
+  }
+out:
+  if (granted)
+    this->cv.notify_all();
+}
+
+uint64_t sstable::RateLimiter::request(uint64_t bytes, IOPriority pri) {
+  auto start = clock::now();
+  std::unique_lock<std::mutex> lock(this->mutex);
+  this->total_bytes[pri] += bytes;
+
+  while (bytes != 0 && this->rate != 0) {
+    uint64_t piece = std::min(bytes, burst(this->rateOf(pri)));
+    Request req{piece, false};
+    this->queues[pri].push_back(&req);
+    while (true) {
+      this->refill();
+      this->grant();
+      if (req.granted)
+        break;
+
+      // Sleep roughly until the head of the line can be served.
+      int p = 0;
+      while (this->queues[p].empty())
+        p++;
+      uint64_t head = std::min(this->queues[p].front()->bytes,
+                               burst(this->rateOf(p)));
+      double seconds = std::max(1.0, head - this->tokens) / this->rate;
+      if (p != IO_FLUSH)
+        seconds = std::max(seconds, std::max(1.0, head - this->compaction_tokens) /
+                                        std::max<uint64_t>(this->compaction_rate, 1));
+      auto wait = std::chrono::microseconds((uint64_t)(seconds * 1000000) + 1);
+      this->cv.wait_for(lock, wait);
+    }
+    bytes -= piece;
+  }
+  return std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - start)
+      .count();
+}
+
+void sstable::RateLimiter::setRate(uint64_t bytes_per_sec, bool auto_tune) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->refill();
+  this->rate = bytes_per_sec;
+  this->compaction_rate = bytes_per_sec;
+  this->min_rate = std::max<uint64_t>(bytes_per_sec / AUTO_TUNE_FLOOR_DIV, 1);
+  this->auto_tune = auto_tune;
+  this->tokens = std::min<double>(this->tokens, burst(this->rate));
+  this->compaction_tokens =
+      std::min<double>(this->compaction_tokens, burst(this->compaction_rate));
+  this->grant();
+}
+
+uint64_t sstable::RateLimiter::getRate() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  return this->rate;
+}
+
+uint64_t sstable::RateLimiter::getCompactionRate() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  return this->compaction_rate;
+}
+
+uint64_t sstable::RateLimiter::getTotalBytes(IOPriority pri) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  return this->total_bytes[pri];
+}
+
+void sstable::RateLimiter::tune(double backlog) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  if (!this->auto_tune || this->rate == 0)
+    return;
+  backlog = std::min(1.0, std::max(0.0, backlog));
+  this->refill();
+  this->compaction_rate =
+      this->min_rate + (uint64_t)((this->rate - this->min_rate) * backlog);
+  this->grant();
+}
@@ -2,156 +2,450 @@
 
 #include <sstable/sstable.h>
 
+#include <atomic>
 #include <chrono>
-#include <iostream>
+#include <cstring>
+#include <deque>
 #include <fstream>
+#include <future>
+
+namespace {
+// Never reused, so a cached value cannot outlive its block and be found
+// under a later block's name. 0 means uncached.
+std::atomic<uint64_t> next_block_id{1};
+}
+
+template <typename Key, typename Compare>
+sstable::SSBlock<Key, Compare>::SSBlock(const std::string &filename,
+                                        std::shared_ptr<SSContext> ctx,
+                                        const Compare &cmp)
+    : index(cmp), cmp(cmp), filename(filename), ctx(ctx) {
 
-sstable::SSBlock::SSBlock(const std::string &filename):filename(filename){
-  
   this->header = {};
-  this->filter = std::make_unique<bloomfilter::BloomFilter<uint64_t>>(BLOOMFILTER_SIZE);
-  this->index = {};
+  this->filter = std::make_unique<bloomfilter::BloomFilter<Key>>(ctx->filter_size);
+  this->consumed = 0;
+  this->fd = -1;
+  this->file_size = 0;
   this->is_prepared = false;
-  if(utils::dirExists(filename) == true)
+  this->id = next_block_id++;
+  this->meta_charge = 0;
+  if(utils::fileExists(filename) == true)
     this->prepare_from_file();
 }
 
 
-sstable::SSBlock::~SSBlock() { 
+template <typename Key, typename Compare>
+sstable::SSBlock<Key, Compare>::~SSBlock() {
   this->filter.reset();
+  this->ctx->io->close(this->fd);
+  if (this->ctx->budget != nullptr)
+    this->ctx->budget->release(memory::TABLE_META, this->meta_charge);
+}
+
+template <typename Key, typename Compare>
+bool sstable::SSBlock<Key, Compare>::covers(const Key &key) const {
+  return !this->cmp(key, this->minn) && !this->cmp(this->maxx, key);
+}
+
+template <typename Key, typename Compare>
+bool sstable::SSBlock<Key, Compare>::mayContain(const Key &key) const {
+  return this->covers(key) && this->filter->check(key);
 }
 
-uint64_t sstable::SSBlock::timestamp() const{
+template <typename Key, typename Compare>
+bool sstable::SSBlock<Key, Compare>::anyKey(
+    const std::function<bool(const Key &)> &pred) const {
+  for (auto it = this->index.begin(); it.valid(); it.next()) {
+    if (pred(it.key()))
+      return true;
+  }
+  return false;
+}
+
+template <typename Key, typename Compare>
+int sstable::SSBlock<Key, Compare>::handle() {
+  if (this->fd < 0)
+    this->fd = this->ctx->io->open(this->filename);
+  return this->fd;
+}
+
+template <typename Key, typename Compare>
+uint64_t sstable::SSBlock<Key, Compare>::timestamp() const{
   return this->header.timestamp;
 }
 
-const std::string & sstable::SSBlock::getFilename() const{
+template <typename Key, typename Compare>
+const std::string & sstable::SSBlock<Key, Compare>::getFilename() const{
   return this->filename;
 }
 
-uint64_t sstable::SSBlock::min() const {
-  return this->header.minn;
+template <typename Key, typename Compare>
+bool sstable::SSBlock<Key, Compare>::rename(const std::string &filename) {
+  if (utils::mvfile(this->filename.c_str(), filename.c_str()) != 0)
+    return false;
+  this->filename = filename;
+  return true;
+}
+
+template <typename Key, typename Compare>
+bool sstable::SSBlock<Key, Compare>::stamp(uint64_t timestamp) {
+  // The timestamp leads the header.
+  std::fstream file(this->filename, std::ios::in | std::ios::out | std::ios::binary);
+  file.write(reinterpret_cast<const char *>(&timestamp), sizeof(timestamp));
+  if (!file)
+    return false;
+  this->header.timestamp = timestamp;
+  return true;
 }
 
-uint64_t sstable::SSBlock::max() const {
-  return this->header.maxx;
+template <typename Key, typename Compare>
+const Key &sstable::SSBlock<Key, Compare>::min() const {
+  return this->minn;
 }
 
-void sstable::SSBlock::prepare_from_block(
-    const std::vector<std::pair<uint64_t, std::string>> &block) {
+template <typename Key, typename Compare>
+const Key &sstable::SSBlock<Key, Compare>::max() const {
+  return this->maxx;
+}
+
+template <typename Key, typename Compare>
+uint64_t sstable::SSBlock<Key, Compare>::dataOffset() const {
+  return sizeof(SSBlockHeader) + this->header.filter_size + this->header.index_size;
+}
+
+template <typename Key, typename Compare>
+void sstable::SSBlock<Key, Compare>::prepare_keys() {
+  this->minn = this->index.first();
+  this->maxx = this->index.last();
+  this->cursor = this->index.begin();
+  this->consumed = 0;
+}
+
+template <typename Key, typename Compare>
+void sstable::SSBlock<Key, Compare>::chargeMeta() {
+  uint64_t charge = this->filter->size + this->index.memoryUsage();
+  if (this->ctx->budget != nullptr)
+    this->ctx->budget->update(memory::TABLE_META, this->meta_charge, charge);
+  this->meta_charge = charge;
+}
+
+template <typename Key, typename Compare>
+uint64_t sstable::SSBlock<Key, Compare>::memoryUsage() const {
+  return this->meta_charge;
+}
+
+template <typename Key, typename Compare>
+uint64_t sstable::SSBlock<Key, Compare>::seekMisses() const {
+  return this->seek_misses;
+}
+
+template <typename Key, typename Compare>
+void sstable::SSBlock<Key, Compare>::prepare_from_block(
+    const EntryRefs<Key> &block,
+    const std::vector<memory::Slice> &stored,
+    const std::vector<ValueKind> &kinds) {
   this->header.timestamp =
       std::chrono::duration_cast<std::chrono::microseconds>(
           std::chrono::system_clock::now().time_since_epoch())
           .count();
   this->header.nr_keys = block.size();
-  this->header.minn = block.begin()->first;
-  this->header.maxx = (block.end()-1)->first;
-  uint64_t offset = SSBLOCK_RESERVED_SIZE+block.size() * 2 * sizeof(uint64_t);
-
-  for (const auto &p : block) {
-    this->index.push_back(std::make_pair(p.first, offset));
-    offset += p.second.size();
-    this->filter->insert(p.first);
+  this->header.max_expiry = 0;
+  this->header.filter_size = this->filter->size;
+
+  for (size_t i = 0; i < block.size(); i++) {
+    this->index.add(*block[i].first, stored[i].size(), kinds[i]);
+    if (kinds[i] == VALUE_INLINE && block[i].second == deleted)
+      this->header.nr_tombstones++;
+    uint64_t when = (kinds[i] & VALUE_EXPIRES)
+                        ? coding::getFixed64(stored[i].data())
+                        : expiry::NEVER;
+    this->header.max_expiry = std::max(this->header.max_expiry, when);
   }
+  this->prepare_keys();
+  this->chargeMeta();
   this->is_prepared = true;
 }
-void sstable::SSBlock::flush(
-    const std::vector<std::pair<uint64_t, std::string>> &block) {
-  
-  
-  std::ofstream ofile(this->filename,std::ios::binary | std::ios::out);
-  this->prepare_from_block(block);
-
-  ofile.write(reinterpret_cast<const char *>(&this->header),
-              sizeof(this->header));
-  ofile.write(reinterpret_cast<const char *>(this->filter->data),
-              BLOOMFILTER_SIZE);
-  for (const auto &p : this->index) {
-    ofile.write(reinterpret_cast<const char *>(&p.first), sizeof(uint64_t));
-    ofile.write(reinterpret_cast<const char *>(&p.second), sizeof(uint64_t));
-  }
 
-  for (const auto &p : block) {
-      ofile.write(p.second.data(), p.second.length());
+template <typename Key, typename Compare>
+bool sstable::SSBlock<Key, Compare>::flush(
+    const std::vector<std::pair<Key, std::string>> &block, IOPriority pri,
+    const std::vector<ValueKind> &kinds) {
+  return this->flush(refsTo(block), pri, kinds);
+}
+
+template <typename Key, typename Compare>
+bool sstable::SSBlock<Key, Compare>::flush(
+    const EntryRefs<Key> &block, IOPriority pri,
+    const std::vector<ValueKind> &kinds) {
+  auto stats = this->ctx->stats.get();
+  auto vlog = this->ctx->vlog.get();
+
+  // The filter needs only the keys, so on big blocks it is built on
+  // another thread while the values and the index are prepared.
+  auto build_filter = [this, &block] {
+    for (const auto &kv : block)
+      this->filter->insert(*kv.first);
+  };
+  std::future<void> filtering;
+  if (block.size() >= PARALLEL_FILTER_KEYS)
+    filtering = std::async(std::launch::async, build_filter);
+  else
+    build_filter();
+
+  // Values headed for the value log are written there first; the block
+  // keeps their pointers and any expiry. Other entries are written as
+  // they are.
+  std::vector<ValueKind> stored_kinds(block.size(), VALUE_INLINE);
+  std::vector<memory::Slice> stored(block.size());
+  std::deque<std::string> rewritten;
+  std::unique_ptr<ValueLogWriter> writer;
+  std::string key, value;
+  for (size_t i = 0; i < block.size(); i++) {
+    const auto &entry = block[i].second;
+    stored[i] = entry;
+    uint64_t when = expiry::NEVER;
+    if (!kinds.empty())
+      stored_kinds[i] = kinds[i];
+    if (stored_kinds[i] & (VALUE_POINTER | VALUE_MERGE))
+      continue;
+
+    memory::Slice payload = entry;
+    if (stored_kinds[i] & VALUE_EXPIRES) {
+      value = entry.toString();
+      when = takeExpiry(value, stored_kinds[i]);
+      payload = value;
+    }
+    bool separate = vlog != nullptr && payload != deleted &&
+                    vlog->separates(payload);
+    if (when == expiry::NEVER && !separate)
+      continue;
+
+    rewritten.emplace_back();
+    auto &out = rewritten.back();
+    if (when != expiry::NEVER) {
+      coding::putFixed64(out, when);
+      stored_kinds[i] = VALUE_EXPIRES;
+    }
+    if (separate) {
+      if (writer == nullptr)
+        writer = vlog->newWriter(pri);
+      key.clear();
+      keys::KeyTraits<Key>::encode(*block[i].first, key);
+      out.append(writer->add(key, payload).encode());
+      stored_kinds[i] = static_cast<ValueKind>(stored_kinds[i] | VALUE_POINTER);
+      statistics::record(stats, statistics::VLOG_BYTES_WRITTEN,
+                         payload.size());
+    } else
+      out.append(payload.data(), payload.size());
+    stored[i] = out;
+  }
+  auto ofile = this->ctx->io->create(this->filename, pri);
+  this->prepare_from_block(block, stored, stored_kinds);
+  auto encoded = this->index.encode();
+  this->header.index_size = encoded.size();
+
+  bool ok = ofile->append(reinterpret_cast<const char *>(&this->header),
+                          sizeof(this->header));
+  if (filtering.valid())
+    filtering.get();
+  ok = ok && ofile->append(reinterpret_cast<const char *>(this->filter->data),
+                           this->filter->size);
+  ok = ok && ofile->append(encoded.data(), encoded.size());
+
+  uint64_t offset = this->dataOffset();
+  for (const auto &value : stored) {
+    ok = ok && ofile->append(value.data(), value.size());
+    offset += value.size();
+  }
+  ok = ofile->close() && ok;
+  this->file_size = offset;
+
+  // The value log file is only sealed once the block pointing into it is
+  // safely written, so a failure leaves neither behind.
+  if (writer != nullptr) {
+    if (ok)
+      ok = writer->finish();
+    else
+      writer->abandon();
+    statistics::record(stats, statistics::RATE_LIMIT_DELAY_MICROS,
+                       writer->delayedMicros());
   }
-  ofile.close();
+  statistics::record(stats, statistics::RATE_LIMIT_DELAY_MICROS,
+                     ofile->delayedMicros());
+  if (!ok) {
+    utils::rmfile(this->filename.c_str());
+    return false;
+  }
+  statistics::record(stats,
+                     pri == IO_FLUSH ? statistics::FLUSH_BYTES
+                                     : statistics::COMPACT_WRITE_BYTES,
+                     this->file_size);
+  return true;
 }
 
-std::string sstable::SSBlock::read(uint64_t offset,
+template <typename Key, typename Compare>
+std::string sstable::SSBlock<Key, Compare>::read(uint64_t offset,
                                                   size_t size){
-  std::ifstream ifile(this->filename,std::ios::binary | std::ios::in);
+  if (size == (size_t)-1)
+    size = this->file_size - offset;
+  return this->ctx->io->read(this->handle(), offset, size);
+}
+
+template <typename Key, typename Compare>
+void sstable::SSBlock<Key, Compare>::prepare_from_file() {
+  int fd = this->handle();
+  this->ctx->io->read(fd, 0, sizeof(this->header))
+      .copy(reinterpret_cast<char *>(&this->header), sizeof(this->header));
+
+  // Blocks keep the filter size they were written with.
+  size_t filter_size = this->header.filter_size;
+  if (filter_size != this->filter->size)
+    this->filter = std::make_unique<bloomfilter::BloomFilter<Key>>(filter_size);
+  auto meta = this->ctx->io->read(fd, sizeof(this->header),
+                             filter_size + this->header.index_size);
+  meta.copy(this->filter->data, filter_size);
+  this->index.decode(meta.substr(filter_size));
+  this->prepare_keys();
+  this->file_size = this->ctx->io->fileSize(fd);
+  this->chargeMeta();
+  this->is_prepared = true;
+}
+
+template <typename Key, typename Compare>
+bool sstable::SSBlock<Key, Compare>::locate(const Key &key, io::ReadRequest &req,
+                                            ValueKind &kind) {
+  using namespace statistics;
+
+  if(this->covers(key) == false)
+    return false;
 
-  if (size == (size_t)-1) {
-    ifile.seekg(0, std::ios::end);
-    size = ifile.tellg();
-    size -= offset;
+  auto &perf = get_perf_context();
+  auto stats = this->ctx->stats.get();
+  bool maybe;
+  {
+    PerfTimer timer(perf.get_filter_nanos);
+    maybe = this->filter->check(key);
   }
+  if (maybe == false) {
+    record(stats, BLOOM_FILTER_USEFUL);
+    perf_count(&PerfContext::bloom_useful_count);
+    return false;
+  }
+  record(stats, BLOOM_FILTER_POSITIVE);
+  perf_count(&PerfContext::bloom_positive_count);
 
-  std::string ret(size, 0);
-  ifile.seekg(offset);
-  ifile.read(&ret[0], size);
-  ifile.close();
-  return ret;
-}
+  typename Index::Iterator it;
+  {
+    PerfTimer timer(perf.get_index_nanos);
+    it = this->index.seek(key);
+  }
 
-void sstable::SSBlock::prepare_from_file() {
-  std::ifstream ifile(this->filename);
-  ifile.read(reinterpret_cast<char *>(&this->header), sizeof(this->header));
-  ifile.read(this->filter->data, BLOOMFILTER_SIZE);
-  for (uint64_t i = 0; i < this->header.nr_keys; i++) {
-    std::pair<uint64_t, uint64_t> p;
-    ifile.read(reinterpret_cast<char *>(&p.first), sizeof(uint64_t));
-    ifile.read(reinterpret_cast<char *>(&p.second), sizeof(uint64_t));
-    this->index.push_back(p);
+  if (!it.valid() || this->cmp(key, it.key())) {
+    record(stats, BLOOM_FILTER_FALSE_POSITIVE);
+    if (++this->seek_misses == this->ctx->seek_miss_limit)
+      this->ctx->seek_pending = true;
+    return false;
   }
-  this->is_prepared = true;
+
+  req.fd = this->handle();
+  req.offset = this->dataOffset() + it.offset();
+  req.size = it.size();
+  req.cache_id = this->id;
+  kind = it.kind();
+  return true;
 }
 
-std::string sstable::SSBlock::search(const uint64_t key) {
+template <typename Key, typename Compare>
+void sstable::SSBlock<Key, Compare>::scan(const Key &key1, const Key &key2,
+                                          std::map<Key, StoredValue, Compare> &ret) {
+  if (this->cmp(key2, this->minn) || this->cmp(this->maxx, key1))
+    return;
+
+  std::vector<io::ReadRequest> reqs;
+  std::vector<Key> found;
+  std::vector<ValueKind> kinds;
+  for (auto it = this->index.seek(key1); it.valid() && !this->cmp(key2, it.key());
+       it.next()) {
+    io::ReadRequest req;
+    req.fd = this->handle();
+    req.offset = this->dataOffset() + it.offset();
+    req.size = it.size();
+    reqs.push_back(std::move(req));
+    found.push_back(it.key());
+    kinds.push_back(it.kind());
+  }
+  this->ctx->io->submit(reqs);
 
-  if(this->header.checkBound(key) == false || this->filter->check(key) == false)
-    return "";
+  for (size_t i = 0; i < reqs.size(); i++)
+    ret[found[i]] = StoredValue{std::move(reqs[i].result), kinds[i]};
+}
 
+template <typename Key, typename Compare>
+const Key &sstable::SSBlock<Key, Compare>::top_key() const {
+  return this->cursor.key();
+}
 
-  auto range = std::equal_range(
-      this->index.begin(), this->index.end(), std::make_pair(key, 0),
-      [](auto p1, auto p2) -> bool { return p1.first < p2.first; });
+template <typename Key, typename Compare>
+uint64_t sstable::SSBlock<Key, Compare>::size() const {
+  return this->header.nr_keys - this->consumed;
+}
 
-  if (range.first == range.second) {
-    return "";
-  } else {
+template <typename Key, typename Compare>
+uint64_t sstable::SSBlock<Key, Compare>::keys() const {
+  return this->header.nr_keys;
+}
 
-    size_t size = (size_t)-1;
-    uint64_t offset = (*range.first).second;
+template <typename Key, typename Compare>
+uint64_t sstable::SSBlock<Key, Compare>::tombstones() const {
+  return this->header.nr_tombstones;
+}
 
-    if (range.second != this->index.end())
-      size = (range.first + 1)->second - range.first->second;
+template <typename Key, typename Compare>
+uint64_t sstable::SSBlock<Key, Compare>::maxExpiry() const {
+  return this->header.max_expiry;
+}
 
-    return this->read(offset,size);
+template <typename Key, typename Compare>
+std::vector<sstable::ValuePointer> sstable::SSBlock<Key, Compare>::pointers() {
+  std::vector<ValuePointer> ret;
+  for (auto it = this->index.begin(); it.valid(); it.next()) {
+    if (!(it.kind() & VALUE_POINTER))
+      continue;
+    auto stored = this->read(this->dataOffset() + it.offset(), it.size());
+    takeExpiry(stored, it.kind());
+    ret.push_back(ValuePointer::decode(stored));
   }
+  return ret;
 }
 
-uint64_t sstable::SSBlock::top_key() const {
-  return this->index.front().first;
+template <typename Key, typename Compare>
+uint64_t sstable::SSBlock<Key, Compare>::fileSize() const {
+  return this->file_size;
 }
 
-uint64_t sstable::SSBlock::size() const {
-  return this->index.size();
+template <typename Key, typename Compare>
+std::pair<Key,std::string> sstable::SSBlock<Key, Compare>::top() {
+  return std::make_pair(this->cursor.key(),
+                        this->read(this->dataOffset() + this->cursor.offset(),
+                                   this->cursor.size()));
 }
 
-std::pair<uint64_t,std::string> sstable::SSBlock::top() {
-
-  size_t size = (size_t)-1;
-  auto key = this->index.front().first;
-  auto offset = this->index.front().second;
-  
-  if(this->index.size() != 1)
-    size = (this->index.begin()+1)->second - this->index.begin()->second;
+template <typename Key, typename Compare>
+sstable::ValueKind sstable::SSBlock<Key, Compare>::top_kind() const {
+  return this->cursor.kind();
+}
 
-  return std::make_pair(key,this->read(offset,size));
+template <typename Key, typename Compare>
+void sstable::SSBlock<Key, Compare>::rewind() {
+  this->cursor = this->index.begin();
+  this->consumed = 0;
 }
 
-void sstable::SSBlock::pop(){
-  this->index.pop_front();
+template <typename Key, typename Compare>
+void sstable::SSBlock<Key, Compare>::pop(){
+  this->cursor.next();
+  this->consumed++;
 }
 
+template class sstable::SSBlock<uint64_t>;
+template class sstable::SSBlock<std::string>;
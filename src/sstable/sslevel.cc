@@ -1,63 +1,372 @@
 #include "utils.h"
 #include <sstable/sstable.h>
 #include <chrono>
+#include <sstream>
 
 
-sstable::SSLevel::SSLevel(const std::string &base, const Policy &policy, const size_t &limit) {
+template <typename Key, typename Compare>
+sstable::SSLevel<Key, Compare>::SSLevel(const std::string &base, const Policy &policy, const size_t &limit,
+                          std::shared_ptr<SSContext> ctx, const Compare &cmp)
+    : cmp(cmp) {
     this->base = base;
     this->policy = policy;
     this->limit = limit;
-    this->blocks = std::deque<std::unique_ptr<SSBlock>>();
+    this->ctx = ctx;
+    this->blocks = std::deque<std::unique_ptr<Block>>();
 
     auto blockfiles = std::vector<std::string>();
     utils::scanDir(this->base,blockfiles);
     
     for (const auto &blockfile : blockfiles) {
         if(blockfile.find("block") == 0)
-          this->blocks.emplace_back(std::make_unique<SSBlock>(blockfile));
+          this->blocks.emplace_back(std::make_unique<Block>(this->base + "/" + blockfile, this->ctx, this->cmp));
     }
 
-    std::sort(this->blocks.begin(),this->blocks.end(),[](auto &a,auto &b){
+    std::sort(this->blocks.begin(),this->blocks.end(),[&cmp](auto &a,auto &b){
         if(a->timestamp() == b->timestamp()){
-          return a->min() < b->min();
+          return cmp(a->min(), b->min());
         }
         return a->timestamp() < b->timestamp();
     });
 
+    for (const auto &block : this->blocks)
+        this->account(*block, true);
 }
 
-std::string sstable::SSLevel::nextFile() const{
+template <typename Key, typename Compare>
+void sstable::SSLevel<Key, Compare>::account(const Block &block, bool adding) {
+    auto apply = [adding](std::atomic<uint64_t> &counter, uint64_t n) {
+        if (adding)
+            counter += n;
+        else
+            counter -= n;
+    };
+    apply(this->stats.nr_files, 1);
+    apply(this->stats.bytes, block.fileSize());
+    apply(this->stats.keys, block.keys());
+    apply(this->stats.tombstones, block.tombstones());
+    apply(this->stats.meta_bytes, block.memoryUsage());
+    if (block.tombstones() != 0) {
+        double density = (double)block.tombstones() / block.keys();
+        if (adding)
+            this->densities.insert(density);
+        else
+            this->densities.erase(this->densities.find(density));
+    }
+}
+
+template <typename Key, typename Compare>
+std::string sstable::SSLevel<Key, Compare>::nextFile() const{
   return this->base + "/block-" + std::to_string(std::chrono::duration_cast<std::chrono::microseconds>(
           std::chrono::system_clock::now().time_since_epoch())
           .count()) + ".sst"; 
 }
 
-void sstable::SSLevel::insertBlock(const std::vector<std::pair<uint64_t, std::string>> &block) {
+template <typename Key, typename Compare>
+bool sstable::SSLevel<Key, Compare>::insertBlock(const std::vector<std::pair<Key, std::string>> &block, IOPriority pri,
+                                                 const std::vector<ValueKind> &kinds) {
+    return this->insertBlock(refsTo(block), pri, kinds);
+}
+
+template <typename Key, typename Compare>
+bool sstable::SSLevel<Key, Compare>::insertBlock(const EntryRefs<Key> &block, IOPriority pri,
+                                                 const std::vector<ValueKind> &kinds) {
     std::string blockfile = this->nextFile();
-    auto newblock = std::make_unique<SSBlock>(blockfile);
+    auto newblock = std::make_unique<Block>(blockfile, this->ctx, this->cmp);
+    if (!newblock->flush(block, pri, kinds))
+        return false;
+    this->account(*newblock, true);
+    if (pri == IO_FLUSH)
+        this->stats.flush_bytes += newblock->fileSize();
+    else
+        this->stats.compact_write_bytes += newblock->fileSize();
     this->blocks.push_back(std::move(newblock));
-    (*(this->blocks).rbegin())->flush(block);
+    return true;
 }
 
-size_t sstable::SSLevel::getLimit() const {
+template <typename Key, typename Compare>
+size_t sstable::SSLevel<Key, Compare>::getLimit() const {
   return this->limit;
 }
 
-size_t sstable::SSLevel::size() const {
+template <typename Key, typename Compare>
+void sstable::SSLevel<Key, Compare>::setLimit(size_t limit) {
+  this->limit = limit;
+}
+
+template <typename Key, typename Compare>
+sstable::Policy sstable::SSLevel<Key, Compare>::getPolicy() const {
+  return this->policy;
+}
+
+template <typename Key, typename Compare>
+size_t sstable::SSLevel<Key, Compare>::size() const {
   return this->blocks.size();
 }
 
-std::string sstable::SSLevel::search(const uint64_t key) {
+template <typename Key, typename Compare>
+std::vector<typename sstable::SSLevel<Key, Compare>::Run>
+sstable::SSLevel<Key, Compare>::runs() const {
+  // Compaction writes its output as ascending, disjoint blocks in one go,
+  // so a run is recovered from the block order alone.
+  std::vector<Run> ret;
+  for (size_t i = 0; i < this->blocks.size(); i++) {
+    const auto &block = this->blocks[i];
+    if (ret.empty() || !this->cmp(this->blocks[i - 1]->max(), block->min()))
+      ret.push_back(Run{i, i, 0});
+    ret.back().end = i + 1;
+    ret.back().bytes += block->fileSize();
+  }
+  return ret;
+}
+
+template <typename Key, typename Compare>
+size_t sstable::SSLevel<Key, Compare>::sortedRuns() const {
+  return this->runs().size();
+}
+
+template <typename Key, typename Compare>
+bool sstable::SSLevel<Key, Compare>::needsCompaction() const {
+  if (this->policy == UNIVERSAL)
+    return this->sortedRuns() >= this->limit;
+  return this->blocks.size() >= this->limit;
+}
+
+template <typename Key, typename Compare>
+std::unique_ptr<sstable::SSBlock<Key, Compare>>
+sstable::SSLevel<Key, Compare>::takeHeaviest(
+    const std::function<double(const Block &)> &weight, double least) {
+  auto most = this->blocks.end();
+  double heaviest = least;
+  for (auto it = this->blocks.begin(); it != this->blocks.end(); it++) {
+    double w = weight(**it);
+    if (w >= heaviest) {
+      most = it;
+      heaviest = w;
+    }
+  }
+  if (most == this->blocks.end())
+    return nullptr;
+  auto ret = std::move(*most);
+  this->blocks.erase(most);
+  this->account(*ret, false);
+  return ret;
+}
+
+template <typename Key, typename Compare>
+size_t sstable::SSLevel<Key, Compare>::pickUniversal(const std::vector<Run> &runs) const {
+  const auto &opts = this->ctx->universal;
+  size_t n = runs.size();
+  if (n < 2 || n < this->limit)
+    return 0;
+
+  // Space amplification: everything newer than the oldest run is
+  // overhead until it is merged into it.
+  uint64_t newer = 0;
+  for (size_t i = 1; i < n; i++)
+    newer += runs[i].bytes;
+  if (newer * 100 >= (uint64_t)opts.max_size_amplification * runs[0].bytes)
+    return n;
+
+  // Size ratio: grow the pick from the newest run while the next older
+  // one is not much bigger than what has been picked.
+  uint64_t picked = runs[n - 1].bytes;
+  size_t width = 1;
+  while (width < n &&
+         runs[n - 1 - width].bytes * 100 <= picked * (100 + opts.size_ratio)) {
+    picked += runs[n - 1 - width].bytes;
+    width++;
+  }
+  if (width >= opts.min_merge_width)
+    return width;
+
+  // Too many runs of dissimilar size: merge the newest ones until the
+  // level is back under its limit.
+  return std::min(n, std::max(opts.min_merge_width, n - this->limit + 2));
+}
+
+template <typename Key, typename Compare>
+const sstable::LevelStats &sstable::SSLevel<Key, Compare>::getStats() const {
+  return this->stats;
+}
+
+template <typename Key, typename Compare>
+double sstable::SSLevel<Key, Compare>::densest() const {
+  return this->densities.empty() ? 0.0 : *this->densities.rbegin();
+}
+
+template <typename Key, typename Compare>
+void sstable::SSLevel<Key, Compare>::recordCompaction(uint64_t upper_bytes, uint64_t lower_bytes) {
+  this->stats.nr_compactions++;
+  this->stats.compact_read_upper_bytes += upper_bytes;
+  this->stats.compact_read_lower_bytes += lower_bytes;
+}
+
+template <typename Key, typename Compare>
+void sstable::SSLevel<Key, Compare>::recordFlush(uint64_t bytes) {
+  this->stats.flush_bytes += bytes;
+}
+
+template <typename Key, typename Compare>
+bool sstable::SSLevel<Key, Compare>::mayContain(const Key &key, size_t end) const {
+  end = std::min(end, this->blocks.size());
+  for (size_t i = 0; i < end; i++) {
+    if (this->blocks[i]->mayContain(key))
+      return true;
+  }
+  return false;
+}
+
+template <typename Key, typename Compare>
+size_t sstable::SSLevel<Key, Compare>::dropExpired(
+    uint64_t now, const std::function<bool(const Key &)> &below) {
+  size_t dropped = 0;
+  for (size_t i = 0; i < this->blocks.size();) {
+    auto &block = this->blocks[i];
+    bool shadows = !expiry::expired(block->maxExpiry(), now) ||
+                   block->anyKey([this, i, &below](const Key &key) {
+                     return this->mayContain(key, i) || below(key);
+                   });
+    if (shadows) {
+      i++;
+      continue;
+    }
+    if (this->ctx->vlog != nullptr) {
+      for (const auto &ptr : block->pointers())
+        this->ctx->vlog->addGarbage(ptr);
+    }
+    this->account(*block, false);
+    utils::rmfile(block->getFilename().c_str());
+    this->blocks.erase(this->blocks.begin() + i);
+    dropped++;
+  }
+  return dropped;
+}
+
+template <typename Key, typename Compare>
+std::string sstable::SSLevel<Key, Compare>::describeFiles() const {
+  std::ostringstream ss;
+  for (const auto &block : this->blocks) {
+    auto name = block->getFilename();
+    ss << name.substr(name.rfind('/') + 1) << " keys=" << block->keys()
+       << " tombstones=" << block->tombstones() << " bytes=" << block->fileSize()
+       << " min=" << block->min() << " max=" << block->max() << "\n";
+  }
+  return ss.str();
+}
+
+template <typename Key, typename Compare>
+std::vector<std::pair<std::string, uint64_t>>
+sstable::SSLevel<Key, Compare>::files() const {
+  std::vector<std::pair<std::string, uint64_t>> ret;
+  for (const auto &block : this->blocks)
+    ret.emplace_back(block->getFilename(), block->fileSize());
+  return ret;
+}
+
+template <typename Key, typename Compare>
+bool sstable::SSLevel<Key, Compare>::overlaps(const Key &minn, const Key &maxx) const {
+  for (const auto &block : this->blocks) {
+    if (!this->cmp(block->max(), minn) && !this->cmp(maxx, block->min()))
+      return true;
+  }
+  return false;
+}
+
+template <typename Key, typename Compare>
+bool sstable::SSLevel<Key, Compare>::adopt(std::unique_ptr<Block> &block) {
+  auto name = block->getFilename();
+  if (!block->rename(this->base + name.substr(name.rfind('/'))))
+    return false;
+  this->stats.moved_bytes += block->fileSize();
+  this->restore(block);
+  return true;
+}
+
+template <typename Key, typename Compare>
+void sstable::SSLevel<Key, Compare>::restore(std::unique_ptr<Block> &block) {
+  // Keep the order a reopen would sort the level into.
+  auto pos = this->blocks.end();
+  while (pos != this->blocks.begin() &&
+         (*(pos - 1))->timestamp() > block->timestamp())
+    pos--;
+  this->account(*block, true);
+  this->blocks.insert(pos, std::move(block));
+}
+
+template <typename Key, typename Compare>
+bool sstable::SSLevel<Key, Compare>::owns(const Block &block) const {
+  const auto &name = block.getFilename();
+  return name.compare(0, name.rfind('/'), this->base) == 0;
+}
+
+template <typename Key, typename Compare>
+std::vector<std::unique_ptr<sstable::SSBlock<Key, Compare>>>
+sstable::SSLevel<Key, Compare>::takeNewest(size_t n) {
+  std::vector<std::unique_ptr<Block>> ret;
+  for (; n != 0 && !this->blocks.empty(); n--) {
+    ret.push_back(std::move(this->blocks.back()));
+    this->blocks.pop_back();
+    this->account(*ret.back(), false);
+  }
+  return ret;
+}
+
+template <typename Key, typename Compare>
+bool sstable::SSLevel<Key, Compare>::ingest(std::unique_ptr<Block> &block) {
+  auto blockfile = this->nextFile();
+  if (!block->rename(blockfile))
+    return false;
+  // Newer than anything already loaded, so it keeps its place on reopen.
+  block->stamp(std::chrono::duration_cast<std::chrono::microseconds>(
+                   std::chrono::system_clock::now().time_since_epoch())
+                   .count());
+  this->account(*block, true);
+  this->blocks.push_back(std::move(block));
+  return true;
+}
+
+template <typename Key, typename Compare>
+bool sstable::SSLevel<Key, Compare>::locate(const Key &key, io::ReadRequest &req, ValueKind &kind,
+                                            size_t &probes) {
     for (auto block = this->blocks.rbegin(); block != this->blocks.rend(); block++) {
-        auto ret = (*block)->search(key);
-        if (ret != "")
-            return ret;
+        if (!(*block)->covers(key))
+            continue;
+        probes++;
+        if ((*block)->locate(key, req, kind))
+            return true;
     }
-    return "";
+    return false;
 }
 
-std::vector<std::unique_ptr<sstable::SSBlock>> sstable::SSLevel::select(sstable::Order order,uint64_t minn, uint64_t maxx){
-  std::vector<std::unique_ptr<sstable::SSBlock>> ret{};
+template <typename Key, typename Compare>
+bool sstable::SSLevel<Key, Compare>::versions(
+    const Key &key, size_t &probes,
+    const std::function<bool(const io::ReadRequest &, ValueKind)> &fn) {
+    io::ReadRequest req;
+    ValueKind kind;
+    for (auto block = this->blocks.rbegin(); block != this->blocks.rend(); block++) {
+        if (!(*block)->covers(key))
+            continue;
+        probes++;
+        if ((*block)->locate(key, req, kind) && !fn(req, kind))
+            return false;
+    }
+    return true;
+}
+
+template <typename Key, typename Compare>
+void sstable::SSLevel<Key, Compare>::scan(const Key &key1, const Key &key2,
+                                        std::map<Key, StoredValue, Compare> &ret) {
+    // Oldest first, so newer blocks overwrite what they shadow.
+    for (auto &block : this->blocks)
+        block->scan(key1, key2, ret);
+}
+
+template <typename Key, typename Compare>
+std::vector<std::unique_ptr<sstable::SSBlock<Key, Compare>>>
+sstable::SSLevel<Key, Compare>::select(sstable::Order order, const Key &minn, const Key &maxx){
+  std::vector<std::unique_ptr<Block>> ret{};
   if(order == PREV){
     if(this->policy == TIERING){
       while(!this->blocks.empty()){
@@ -65,6 +374,17 @@ std::vector<std::unique_ptr<sstable::SSBlock>> sstable::SSLevel::select(sstable:
         this->blocks.pop_front();
       }
     }
+    else if(this->policy == UNIVERSAL){
+      // Always the newest runs, so the merged run can go back at the end.
+      auto runs = this->runs();
+      auto width = this->pickUniversal(runs);
+      if(width != 0){
+        size_t begin = runs[runs.size() - width].begin;
+        for(size_t i = begin; i < this->blocks.size(); i++)
+          ret.push_back(std::move(this->blocks[i]));
+        this->blocks.erase(this->blocks.begin() + begin, this->blocks.end());
+      }
+    }
     else{
       while(this->blocks.size() > this->limit){
         ret.push_back(std::move(this->blocks.front()));
@@ -73,10 +393,10 @@ std::vector<std::unique_ptr<sstable::SSBlock>> sstable::SSLevel::select(sstable:
     }
   } else {
     if(this->policy == LEVELING){
-      std::deque<std::unique_ptr<sstable::SSBlock>> next{};
+      std::deque<std::unique_ptr<Block>> next{};
       while(!this->blocks.empty()){
         auto block = std::move(this->blocks.front());
-        if(block->min() >= minn || block->max() <= maxx)
+        if(!this->cmp(block->max(), minn) && !this->cmp(maxx, block->min()))
           ret.push_back(std::move(block));
         else
           next.push_back(std::move(block));
@@ -85,7 +405,10 @@ std::vector<std::unique_ptr<sstable::SSBlock>> sstable::SSLevel::select(sstable:
       this->blocks = std::move(next);
     }
   }
+  for (const auto &block : ret)
+    this->account(*block, false);
   return ret;
 }
 
-
+template class sstable::SSLevel<uint64_t>;
+template class sstable::SSLevel<std::string>;
@@ -1,168 +1,1297 @@
 #include "utils.h"
 
-#include <filesystem>
 #include <fstream>
-#include <kvstore.h>
+#include <iomanip>
+#include <sstream>
 #include <sstable/sstable.h>
-#include <unordered_set>
 
+namespace {
+const std::string pending_prefix = "pending-";
+} // namespace
 
-sstable::SSTable::SSTable(const std::string &base, const std::string &conf) {
+template <typename Key, typename Compare>
+sstable::SSTable<Key, Compare>::SSTable(const std::string &base, const std::string &conf,
+                                        const Compare &cmp)
+    : SSTable(base, Options::fromFile(conf), cmp) {}
+
+template <typename Key, typename Compare>
+sstable::SSTable<Key, Compare>::SSTable(const std::string &base, const Options &options,
+                                        const Compare &cmp)
+    : options(options), cmp(cmp) {
   this->base = base;
-  this->conf = conf;
-  this->levels = std::vector<std::unique_ptr<SSLevel>>();
+  this->ctx = std::make_shared<SSContext>();
+  this->levels = std::vector<std::unique_ptr<Level>>();
   this->prepare_levels();
 }
 
-std::vector<std::pair<sstable::Policy, size_t>> sstable::SSTable::parseConf() {
-  std::vector<std::pair<Policy, size_t>> ret;
-  std::ifstream ifile(this->conf);
-  int id;
-  size_t limit;
-  std::string mode;
-  while (ifile >> id >> limit >> mode) {
-    if (mode == "Leveling")
-      ret.push_back(std::make_pair(LEVELING, limit));
-    else
-      ret.push_back(std::make_pair(TIERING, limit));
-  }
-  return ret;
-}
+template <typename Key, typename Compare>
+void sstable::SSTable<Key, Compare>::prepare_io() {
+  const auto &options = this->options;
+  this->ctx->io = io::make_backend(options.io_backend, options.direct_io,
+                                   options.io_threads);
+  this->ctx->io->setDirectReads(options.direct_reads);
 
-void sstable::SSTable::prepare_levels() {
+  if (this->ctx->limiter == nullptr)
+    this->ctx->limiter =
+        std::make_shared<RateLimiter>(options.rate_limit, options.rate_limit_auto);
+  this->ctx->io->setRateLimiter(this->ctx->limiter);
 
-  if (utils::dirExists(this->base))
-    utils::mkdir(this->base.c_str());
+  if (this->ctx->stats == nullptr && options.statistics)
+    this->ctx->stats = std::make_shared<statistics::Statistics>();
 
-  auto dirs = std::vector<std::string>();
-  utils::scanDir(this->base, dirs);
+  this->ctx->vlog = std::make_shared<ValueLog>(
+      this->base + "/vlog", this->ctx->io, options.vlog_threshold);
+  this->ctx->universal = options.universal;
+  this->ctx->filter_size = std::max<size_t>(options.bloom_filter_size, 1);
+  this->ctx->seek_miss_limit = options.seek_miss_limit;
 
-  std::sort(dirs.begin(), dirs.end());
+  // A budget handed in by setMemoryBudget outlives a reset; its limit is
+  // left to whoever shares it.
+  if (this->ctx->budget == nullptr)
+    this->ctx->budget = std::make_shared<memory::MemoryBudget>(options.memory_limit);
+  this->ctx->cache.reset();
+  if (options.block_cache_size != 0)
+    this->ctx->cache = std::make_shared<ValueCache>(options.block_cache_size,
+                                                    this->ctx->budget);
+}
 
-  auto config = this->parseConf();
+template <typename Key, typename Compare>
+void sstable::SSTable<Key, Compare>::prepare_levels() {
 
-  if (dirs.size() < config.size()) {
-    for (auto i = dirs.size(); i < config.size(); i++) {
-      utils::mkdir((this->base + "/level-" + std::to_string(i)).c_str());
-      dirs.emplace_back(this->base + "/level-" + std::to_string(i));
-    }
-  } else
-    std::sort(dirs.begin(), dirs.end());
+  if (!utils::dirExists(this->base))
+    utils::mkdir(this->base.c_str());
 
+  this->prepare_io();
+  const auto &config = this->options.levels;
   for (size_t i = 0; i < config.size(); i++) {
+    auto dir = this->base + "/level-" + std::to_string(i);
+    if (!utils::dirExists(dir))
+      utils::mkdir(dir.c_str());
+    // Flushes that were written but never committed.
+    auto files = std::vector<std::string>();
+    utils::scanDir(dir, files);
+    for (const auto &file : files) {
+      if (file.compare(0, pending_prefix.size(), pending_prefix) == 0)
+        utils::rmfile((dir + "/" + file).c_str());
+    }
     auto policy = config[i].first;
     auto limit = config[i].second;
     this->levels.emplace_back(
-        std::make_unique<SSLevel>(dirs[i], policy, limit));
+        std::make_unique<Level>(dir, policy, limit, this->ctx, this->cmp));
   }
+  // Levels added as the tree grew.
+  while (!this->levels.empty() &&
+         utils::dirExists(this->base + "/level-" +
+                          std::to_string(this->levels.size())))
+    this->addLevel();
+  this->resizeLevels();
 }
 
-void sstable::SSTable::flush(
-    const std::vector<std::pair<uint64_t, std::string>> &block) {
-  this->levels[0]->insertBlock(block);
-  if (this->levels[0]->getLimit() >= this->levels[0]->size())
+template <typename Key, typename Compare>
+void sstable::SSTable<Key, Compare>::addLevel() {
+  auto dir = this->base + "/level-" + std::to_string(this->levels.size());
+  if (!utils::dirExists(dir))
+    utils::mkdir(dir.c_str());
+  auto limit = this->levels.back()->getLimit();
+  this->levels.emplace_back(
+      std::make_unique<Level>(dir, LEVELING, limit, this->ctx, this->cmp));
+}
+
+template <typename Key, typename Compare>
+void sstable::SSTable<Key, Compare>::resizeLevels() {
+  if (!this->options.dynamic_levels || this->options.levels.size() < 2)
+    return;
+  size_t fanout = std::max<size_t>(this->options.level_fanout, 2);
+  size_t base = this->options.levels[1].second;
+  size_t last = this->levels.size() - 1;
+
+  size_t target = this->levels[last]->size();
+  for (size_t i = last; i-- > 1;) {
+    target = (target + fanout - 1) / fanout;
+    if (this->levels[i]->getPolicy() == LEVELING)
+      this->levels[i]->setLimit(std::max(base, target));
+  }
+  // Level 1 may hold up to `fanout` times its configured limit before the
+  // tree gets deeper.
+  size_t limit = base;
+  for (size_t i = 0; i < last && limit <= SIZE_MAX / fanout; i++)
+    limit *= fanout;
+  if (this->levels[last]->getPolicy() == LEVELING)
+    this->levels[last]->setLimit(limit);
+}
+
+template <typename Key, typename Compare>
+bool sstable::SSTable<Key, Compare>::flush(const EntryRefs<Key> &block,
+                                           const std::vector<ValueKind> &kinds) {
+  statistics::StopWatch watch(this->ctx->stats.get(), statistics::FLUSH_MICROS);
+  statistics::record(this->ctx->stats.get(), statistics::FLUSH_COUNT);
+  return this->levels[0]->insertBlock(block, IO_FLUSH, kinds);
+}
+
+template <typename Key, typename Compare>
+std::unique_ptr<sstable::SSBlock<Key, Compare>>
+sstable::SSTable<Key, Compare>::prepareFlush(const EntryRefs<Key> &block,
+                                             const std::vector<ValueKind> &kinds) {
+  statistics::StopWatch watch(this->ctx->stats.get(), statistics::FLUSH_MICROS);
+  statistics::record(this->ctx->stats.get(), statistics::FLUSH_COUNT);
+  auto name = this->base + "/level-0/" + pending_prefix +
+              std::to_string(this->next_pending++) + ".sst";
+  auto ret = std::make_unique<Block>(name, this->ctx, this->cmp);
+  if (!ret->flush(block, IO_FLUSH, kinds))
+    return nullptr;
+  return ret;
+}
+
+template <typename Key, typename Compare>
+bool sstable::SSTable<Key, Compare>::commitFlush(std::unique_ptr<Block> &block) {
+  uint64_t bytes = block->fileSize();
+  if (!this->levels[0]->ingest(block))
+    return false;
+  this->levels[0]->recordFlush(bytes);
+  return true;
+}
+
+template <typename Key, typename Compare>
+void sstable::SSTable<Key, Compare>::maintain() {
+  // Blocks past their latest expiry go without being merged.
+  uint64_t now = expiry::now();
+  for (size_t i = 0; i < this->levels.size(); i++) {
+    auto dropped = this->levels[i]->dropExpired(now, [this, i](const Key &key) {
+      return this->mayExistFrom(key, i + 1);
+    });
+    statistics::record(this->ctx->stats.get(),
+                       statistics::EXPIRED_BLOCKS_DROPPED, dropped);
+  }
+  this->ctx->vlog->saveGarbage();
+  this->ctx->limiter->tune((double)this->levels[0]->size() /
+                      this->levels[0]->getLimit());
+  // A background thread calls compactOnce() instead.
+  if (!this->options.background_compaction && this->needsCompaction()) {
     this->compact();
+    this->collectGarbage();
+  }
+}
+
+template <typename Key, typename Compare>
+void sstable::SSTable<Key, Compare>::setRateLimit(uint64_t bytes_per_sec, bool auto_tune) {
+  this->ctx->limiter->setRate(bytes_per_sec, auto_tune);
+}
+
+template <typename Key, typename Compare>
+statistics::Statistics *sstable::SSTable<Key, Compare>::getStatistics() const {
+  return this->ctx->stats.get();
+}
+
+template <typename Key, typename Compare>
+void sstable::SSTable<Key, Compare>::setMergeOperator(
+    std::shared_ptr<merge::MergeOperator> op) {
+  this->ctx->merge_operator = op;
+}
+
+template <typename Key, typename Compare>
+std::shared_ptr<memory::MemoryBudget>
+sstable::SSTable<Key, Compare>::getMemoryBudget() const {
+  return this->ctx->budget;
+}
+
+template <typename Key, typename Compare>
+void sstable::SSTable<Key, Compare>::setMemoryBudget(
+    std::shared_ptr<memory::MemoryBudget> budget) {
+  uint64_t meta = 0;
+  for (const auto &level : this->levels)
+    meta += level->getStats().meta_bytes;
+  this->ctx->budget->release(memory::TABLE_META, meta);
+  budget->reserve(memory::TABLE_META, meta);
+  if (this->ctx->cache != nullptr)
+    this->ctx->cache->setBudget(budget);
+  this->ctx->budget = budget;
+}
+
+template <typename Key, typename Compare>
+void sstable::SSTable<Key, Compare>::shrinkCache() {
+  if (this->ctx->cache != nullptr)
+    this->ctx->cache->shrink();
+}
+
+template <typename Key, typename Compare>
+uint64_t sstable::SSTable<Key, Compare>::defaultTTL() const {
+  return this->options.default_ttl;
+}
+
+namespace {
+const std::string property_prefix = "minilsm.";
+
+std::string ratio(uint64_t num, uint64_t den) {
+  std::ostringstream ss;
+  ss << std::fixed << std::setprecision(3)
+     << (den == 0 ? 0.0 : (double)num / den);
+  return ss.str();
+}
+
+const char *policyName(sstable::Policy policy) {
+  switch (policy) {
+  case sstable::LEVELING:
+    return "Leveling";
+  case sstable::UNIVERSAL:
+    return "Universal";
+  default:
+    return "Tiering";
+  }
+}
+
+// Write amplification of compactions into a level: bytes written there
+// per byte moved down from the level above. Level 0 has no compactions
+// into it, so its flushed bytes count as both.
+std::string levelWriteAmp(const sstable::LevelStats &s) {
+  if (s.compact_read_upper_bytes == 0)
+    return ratio(s.flush_bytes, s.flush_bytes);
+  return ratio(s.compact_write_bytes, s.compact_read_upper_bytes);
+}
+// Whether `path` is long enough for the header, filter and index its
+// header describes, before any of it is decoded.
+bool plausibleBlock(const std::string &path) {
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if (!file)
+    return false;
+  uint64_t size = file.tellg();
+  sstable::SSBlockHeader header;
+  if (size < sizeof(header))
+    return false;
+  file.seekg(0);
+  file.read(reinterpret_cast<char *>(&header), sizeof(header));
+  if (!file || header.nr_keys == 0 || header.filter_size == 0)
+    return false;
+  uint64_t meta = size - sizeof(header);
+  return header.filter_size <= meta &&
+         header.index_size <= meta - header.filter_size;
+}
+} // namespace
+
+template <typename Key, typename Compare>
+bool sstable::SSTable<Key, Compare>::getProperty(const std::string &name,
+                                   std::string &value) const {
+  if (name.compare(0, property_prefix.size(), property_prefix) != 0)
+    return false;
+  auto prop = name.substr(property_prefix.size());
+
+  // Per-level properties end in "-at-level<N>".
+  auto at = prop.rfind("-at-level");
+  if (at != std::string::npos) {
+    auto num = prop.substr(at + 9);
+    if (num.empty() || num.find_first_not_of("0123456789") != std::string::npos)
+      return false;
+    size_t i = std::stoul(num);
+    if (i >= this->levels.size())
+      return false;
+    const auto &s = this->levels[i]->getStats();
+    auto what = prop.substr(0, at);
+    if (what == "num-files")
+      value = std::to_string(s.nr_files);
+    else if (what == "bytes")
+      value = std::to_string(s.bytes);
+    else if (what == "keys")
+      value = std::to_string(s.keys);
+    else if (what == "tombstones")
+      value = std::to_string(s.tombstones);
+    else if (what == "tombstone-ratio")
+      value = ratio(s.tombstones, s.keys);
+    else if (what == "compact-read-bytes")
+      value = std::to_string(s.compact_read_upper_bytes +
+                             s.compact_read_lower_bytes);
+    else if (what == "compact-write-bytes")
+      value = std::to_string(s.compact_write_bytes);
+    else if (what == "moved-bytes")
+      value = std::to_string(s.moved_bytes);
+    else if (what == "write-amplification")
+      value = levelWriteAmp(s);
+    else if (what == "files")
+      value = this->levels[i]->describeFiles();
+    else if (what == "num-runs")
+      value = std::to_string(this->levels[i]->sortedRuns());
+    else if (what == "policy")
+      value = policyName(this->levels[i]->getPolicy());
+    else if (what == "limit")
+      value = std::to_string(this->levels[i]->getLimit());
+    else if (what == "compaction-score") {
+      std::ostringstream ss;
+      ss << std::fixed << std::setprecision(3) << this->score(i);
+      value = ss.str();
+    }
+    else
+      return false;
+    return true;
+  }
+
+  uint64_t files = 0, bytes = 0, keys = 0, tombstones = 0;
+  uint64_t flushed = 0, read = 0, written = 0, moved = 0, last_bytes = 0;
+  for (const auto &level : this->levels) {
+    const auto &s = level->getStats();
+    files += s.nr_files;
+    bytes += s.bytes;
+    keys += s.keys;
+    tombstones += s.tombstones;
+    flushed += s.flush_bytes;
+    read += s.compact_read_upper_bytes + s.compact_read_lower_bytes;
+    written += s.compact_write_bytes;
+    moved += s.moved_bytes;
+    if (s.bytes != 0)
+      last_bytes = s.bytes;
+  }
+
+  if (prop == "num-levels")
+    value = std::to_string(this->levels.size());
+  else if (prop == "total-files")
+    value = std::to_string(files);
+  else if (prop == "total-bytes")
+    value = std::to_string(bytes);
+  else if (prop == "total-keys")
+    value = std::to_string(keys);
+  else if (prop == "total-tombstones")
+    value = std::to_string(tombstones);
+  else if (prop == "flush-bytes")
+    value = std::to_string(flushed);
+  else if (prop == "compact-read-bytes")
+    value = std::to_string(read);
+  else if (prop == "compact-write-bytes")
+    value = std::to_string(written);
+  else if (prop == "moved-bytes")
+    value = std::to_string(moved);
+  else if (prop == "write-amplification")
+    // Everything written to disk per byte flushed.
+    value = ratio(flushed + written, flushed);
+  else if (prop == "space-amplification")
+    // Total size against the deepest non-empty level, which would hold
+    // everything if the tree were fully compacted.
+    value = ratio(bytes, last_bytes);
+  else if (prop == "vlog-files")
+    value = std::to_string(this->ctx->vlog->size());
+  else if (prop == "vlog-bytes")
+    value = std::to_string(this->ctx->vlog->totalBytes());
+  else if (prop == "vlog-garbage-bytes")
+    value = std::to_string(this->ctx->vlog->garbageBytes());
+  else if (prop == "block-cache-usage")
+    value = std::to_string(this->ctx->cache == nullptr
+                               ? 0 : this->ctx->cache->usage());
+  else if (prop == "block-cache-capacity")
+    value = std::to_string(this->ctx->cache == nullptr
+                               ? 0 : this->ctx->cache->getCapacity());
+  else if (prop == "estimate-table-readers-mem") {
+    uint64_t meta = 0;
+    for (const auto &level : this->levels)
+      meta += level->getStats().meta_bytes;
+    value = std::to_string(meta);
+  } else if (prop == "memory-budget-usage")
+    value = std::to_string(this->ctx->budget->usage());
+  else if (prop == "memory-budget-limit")
+    value = std::to_string(this->ctx->budget->limit());
+  else if (prop == "levelstats") {
+    std::ostringstream ss;
+    ss << "Level Files Bytes Keys Tombstones Compactions ReadBytes "
+          "WriteBytes W-Amp\n";
+    for (size_t i = 0; i < this->levels.size(); i++) {
+      const auto &s = this->levels[i]->getStats();
+      ss << "L" << i << " " << s.nr_files << " " << s.bytes << " " << s.keys
+         << " " << s.tombstones << " " << s.nr_compactions << " "
+         << s.compact_read_upper_bytes + s.compact_read_lower_bytes << " "
+         << (i == 0 ? s.flush_bytes.load() : s.compact_write_bytes.load())
+         << " " << levelWriteAmp(s) << "\n";
+    }
+    ss << "Sum " << files << " " << bytes << " " << keys << " " << tombstones
+       << " - " << read << " " << flushed + written << " "
+       << ratio(flushed + written, flushed) << "\n";
+    value = ss.str();
+  } else
+    return false;
+  return true;
+}
+
+template <typename Key, typename Compare>
+bool sstable::SSTable<Key, Compare>::mayExistFrom(const Key &key,
+                                                  size_t from) const {
+  for (size_t i = from; i < this->levels.size(); i++) {
+    if (this->levels[i]->mayContain(key))
+      return true;
+  }
+  return false;
+}
+
+template <typename Key, typename Compare>
+std::string sstable::SSTable<Key, Compare>::resolve(std::string stored,
+                                                    ValueKind kind) {
+  // Expired entries read as deleted, so older versions stay hidden.
+  if (expiry::expired(takeExpiry(stored, kind), expiry::now()))
+    return deleted;
+  if (!(kind & VALUE_POINTER))
+    return stored;
+  auto ret = this->ctx->vlog->read(ValuePointer::decode(stored));
+  statistics::record(this->ctx->stats.get(), statistics::VLOG_BYTES_READ,
+                     ret.size());
+  return ret;
+}
+
+template <typename Key, typename Compare>
+bool sstable::SSTable<Key, Compare>::readValue(const io::ReadRequest &req,
+                                               std::string &value) {
+  memory::PinnableSlice pinned;
+  bool hit = this->readValue(req, pinned);
+  value = pinned.take();
+  return hit;
+}
+
+template <typename Key, typename Compare>
+bool sstable::SSTable<Key, Compare>::readValue(const io::ReadRequest &req,
+                                               memory::PinnableSlice &value) {
+  auto cache = this->ctx->cache.get();
+  bool cacheable = cache != nullptr && req.cache_id != 0;
+  if (cacheable) {
+    bool hit = cache->lookup(req.cache_id, req.offset, value);
+    statistics::record(this->ctx->stats.get(), hit ? statistics::BLOCK_CACHE_HIT
+                                                   : statistics::BLOCK_CACHE_MISS);
+    if (hit)
+      return true;
+  }
+  auto read = this->ctx->io->read(req.fd, req.offset, req.size);
+  if (cacheable) {
+    cache->insert(req.cache_id, req.offset, read);
+    statistics::record(this->ctx->stats.get(), statistics::BLOCK_CACHE_ADD);
+  }
+  value.pinSelf(std::move(read));
+  return false;
 }
 
-std::string sstable::SSTable::search(const uint64_t key) {
+template <typename Key, typename Compare>
+size_t sstable::SSTable<Key, Compare>::readValues(
+    std::vector<io::ReadRequest> &reqs) {
+  auto cache = this->ctx->cache.get();
+  if (cache == nullptr) {
+    this->ctx->io->submit(reqs);
+    return reqs.size();
+  }
+
+  std::vector<io::ReadRequest> misses;
+  std::vector<size_t> slots;
+  for (size_t i = 0; i < reqs.size(); i++) {
+    auto &req = reqs[i];
+    if (req.cache_id != 0 && cache->lookup(req.cache_id, req.offset, req.result)) {
+      req.ok = true;
+      continue;
+    }
+    misses.push_back(std::move(req));
+    slots.push_back(i);
+  }
+  statistics::record(this->ctx->stats.get(), statistics::BLOCK_CACHE_HIT,
+                     reqs.size() - misses.size());
+  statistics::record(this->ctx->stats.get(), statistics::BLOCK_CACHE_MISS,
+                     misses.size());
+
+  this->ctx->io->submit(misses);
+  for (size_t i = 0; i < misses.size(); i++) {
+    auto &req = misses[i];
+    if (req.ok && req.cache_id != 0) {
+      cache->insert(req.cache_id, req.offset, req.result);
+      statistics::record(this->ctx->stats.get(), statistics::BLOCK_CACHE_ADD);
+    }
+    reqs[slots[i]] = std::move(req);
+  }
+  return misses.size();
+}
+
+template <typename Key, typename Compare>
+std::string sstable::SSTable<Key, Compare>::fold(const Key &key) {
+  std::vector<std::string> operands;
+  std::string base;
+  bool has_base = false;
+  size_t probes = 0;
   for (auto &level : this->levels) {
-    auto ret = level->search(key);
-    if (ret != "")
-      return ret;
+    bool more = level->versions(
+        key, probes, [&](const io::ReadRequest &req, ValueKind kind) {
+          std::string stored;
+          this->readValue(req, stored);
+          if (kind & VALUE_MERGE) {
+            auto older = merge::decodeOperands(stored);
+            operands.insert(operands.begin(), older.begin(), older.end());
+            return true;
+          }
+          base = this->resolve(std::move(stored), kind);
+          has_base = base != deleted;
+          return false;
+        });
+    if (!more)
+      break;
+  }
+
+  auto op = this->ctx->merge_operator.get();
+  std::string result;
+  if (op == nullptr || !op->fullMerge(has_base ? &base : nullptr, operands, result))
+    return deleted;
+  statistics::record(this->ctx->stats.get(), statistics::MERGE_OPERANDS_FOLDED,
+                     operands.size());
+  return result;
+}
+
+template <typename Key, typename Compare>
+std::string sstable::SSTable<Key, Compare>::search(const Key &key) {
+  memory::PinnableSlice value;
+  this->searchPinned(key, value);
+  return value.take();
+}
+
+template <typename Key, typename Compare>
+bool sstable::SSTable<Key, Compare>::searchPinned(const Key &key,
+                                                  memory::PinnableSlice &value) {
+  using namespace statistics;
+  auto stats = this->ctx->stats.get();
+  io::ReadRequest req;
+  ValueKind kind;
+  size_t probes = 0;
+  value.reset();
+  for (size_t i = 0; i < this->levels.size(); i++) {
+    if (!this->levels[i]->locate(key, req, kind, probes))
+      continue;
+
+    record(stats, i == 0 ? GET_HIT_L0 : i == 1 ? GET_HIT_L1 : GET_HIT_L2_AND_UP);
+    bool cached;
+    {
+      PerfTimer timer(get_perf_context().get_read_nanos);
+      cached = this->readValue(req, value);
+    }
+    if (!cached) {
+      record(stats, BLOCK_READ_COUNT);
+      record(stats, BLOCK_READ_BYTES, value.size());
+      perf_count(&PerfContext::block_read_count);
+      perf_count(&PerfContext::block_read_bytes, value.size());
+    }
+    perf_count(&PerfContext::blocks_probed_count, probes);
+    measure(stats, BLOCKS_READ_PER_GET, cached ? 0 : 1);
+    measure(stats, BLOCKS_PROBED_PER_GET, probes);
+    // Only plain values can be handed out as they are stored.
+    if (kind & VALUE_MERGE)
+      value.pinSelf(this->fold(key));
+    else if (kind != VALUE_INLINE)
+      value.pinSelf(this->resolve(value.take(), kind));
+    return true;
+  }
+  perf_count(&PerfContext::blocks_probed_count, probes);
+  measure(stats, BLOCKS_READ_PER_GET, 0);
+  measure(stats, BLOCKS_PROBED_PER_GET, probes);
+  return false;
+}
+
+template <typename Key, typename Compare>
+std::vector<std::string>
+sstable::SSTable<Key, Compare>::multiSearch(const std::vector<Key> &keys) {
+  auto stats = this->ctx->stats.get();
+  std::vector<std::string> ret(keys.size());
+  std::vector<io::ReadRequest> reqs;
+  std::vector<ValueKind> kinds;
+  std::vector<size_t> slots;
+
+  // Resolve every key against the in-memory indexes first, then hand all
+  // the value reads to the backend at once.
+  for (size_t i = 0; i < keys.size(); i++) {
+    io::ReadRequest req;
+    ValueKind kind;
+    size_t probes = 0;
+    for (auto &level : this->levels) {
+      if (level->locate(keys[i], req, kind, probes)) {
+        reqs.push_back(std::move(req));
+        kinds.push_back(kind);
+        slots.push_back(i);
+        break;
+      }
+    }
   }
-  return "";
+
+  statistics::record(stats, statistics::BLOCK_READ_COUNT,
+                     this->readValues(reqs));
+
+  // Separated values take a second batch, against the value log.
+  std::vector<io::ReadRequest> vreqs;
+  std::vector<size_t> vslots;
+  uint64_t now = expiry::now();
+  for (size_t i = 0; i < reqs.size(); i++) {
+    statistics::record(stats, statistics::BLOCK_READ_BYTES,
+                       reqs[i].result.size());
+    if (kinds[i] & VALUE_MERGE)
+      ret[slots[i]] = this->fold(keys[slots[i]]);
+    else if (expiry::expired(takeExpiry(reqs[i].result, kinds[i]), now))
+      ret[slots[i]] = deleted;
+    else if (kinds[i] & VALUE_POINTER) {
+      auto req = this->ctx->vlog->request(ValuePointer::decode(reqs[i].result));
+      if (req.fd < 0)
+        continue;
+      vreqs.push_back(std::move(req));
+      vslots.push_back(slots[i]);
+    } else
+      ret[slots[i]] = std::move(reqs[i].result);
+  }
+
+  this->ctx->io->submit(vreqs);
+  for (size_t i = 0; i < vreqs.size(); i++) {
+    statistics::record(stats, statistics::VLOG_BYTES_READ,
+                       vreqs[i].result.size());
+    ret[vslots[i]] = std::move(vreqs[i].result);
+  }
+  return ret;
 }
 
-void sstable::SSTable::reset() {
-  utils::rmdir(this->base.c_str());
+template <typename Key, typename Compare>
+void sstable::SSTable<Key, Compare>::scan(const Key &key1, const Key &key2,
+                                        std::map<Key, std::string, Compare> &ret) {
+  std::map<Key, StoredValue, Compare> stored(this->cmp);
+  for (auto level = this->levels.rbegin(); level != this->levels.rend(); level++)
+    (*level)->scan(key1, key2, stored);
+
+  std::vector<io::ReadRequest> reqs;
+  std::vector<Key> found;
+  uint64_t now = expiry::now();
+  for (auto &kv : stored) {
+    if (kv.second.kind & VALUE_MERGE) {
+      ret[kv.first] = this->fold(kv.first);
+      continue;
+    }
+    if (expiry::expired(takeExpiry(kv.second.data, kv.second.kind), now)) {
+      ret[kv.first] = deleted;
+      continue;
+    }
+    if (!(kv.second.kind & VALUE_POINTER)) {
+      ret[kv.first] = std::move(kv.second.data);
+      continue;
+    }
+    auto req = this->ctx->vlog->request(ValuePointer::decode(kv.second.data));
+    if (req.fd < 0)
+      continue;
+    reqs.push_back(std::move(req));
+    found.push_back(kv.first);
+  }
+
+  this->ctx->io->submit(reqs);
+  for (size_t i = 0; i < reqs.size(); i++) {
+    statistics::record(this->ctx->stats.get(), statistics::VLOG_BYTES_READ,
+                       reqs[i].result.size());
+    ret[found[i]] = std::move(reqs[i].result);
+  }
+}
+
+template <typename Key, typename Compare>
+void sstable::SSTable<Key, Compare>::reset() {
+  // Drop the open levels and value log before their files go, so nothing
+  // writes back into the directory afterwards.
   this->levels.clear();
+  this->ctx->vlog.reset();
+
+  auto dirs = std::vector<std::string>();
+  utils::scanDir(this->base, dirs);
+  for (const auto &dir : dirs) {
+    auto path = this->base + "/" + dir;
+    // A checkpoint's CONF and MANIFEST.
+    if (!utils::dirExists(path)) {
+      utils::rmfile(path.c_str());
+      continue;
+    }
+    auto files = std::vector<std::string>();
+    utils::scanDir(path, files);
+    for (const auto &file : files)
+      utils::rmfile((path + "/" + file).c_str());
+    utils::rmdir(path.c_str());
+  }
   this->prepare_levels();
 }
 
-std::pair<uint64_t, uint64_t> sstable::SSTable::rangeSelected(
-    const std::vector<std::unique_ptr<sstable::SSBlock>> &selected) const {
-  std::pair<uint64_t, uint64_t> ret{(size_t)-1, 0};
+template <typename Key, typename Compare>
+std::pair<Key, Key> sstable::SSTable<Key, Compare>::rangeSelected(
+    const std::vector<std::unique_ptr<Block>> &selected) const {
+  std::pair<Key, Key> ret{selected.front()->min(), selected.front()->max()};
   for (auto const &b : selected) {
-    if (b->max() > ret.second)
+    if (this->cmp(ret.second, b->max()))
       ret.second = b->max();
-    if (b->min() < ret.first)
+    if (this->cmp(b->min(), ret.first))
       ret.first = b->min();
   }
   return ret;
 }
 
-void sstable::SSTable::compactBlocks(
-    const std::vector<std::unique_ptr<sstable::SSBlock>> &selected,
-    const std::unique_ptr<SSLevel> &level) const {
+template <typename Key, typename Compare>
+bool sstable::SSTable<Key, Compare>::compactBlocks(
+    std::vector<std::unique_ptr<Block>> &selected,
+    const std::unique_ptr<Level> &level, IOPriority pri) {
+  auto stats = this->ctx->stats.get();
+  statistics::StopWatch watch(stats, statistics::COMPACTION_MICROS);
+  statistics::record(stats, statistics::COMPACTION_COUNT);
 
-  using pq_node = std::tuple<size_t, uint64_t, uint64_t>;
-  auto compare = [](pq_node &lhs, pq_node &rhs) {
-    if (std::get<1>(lhs) == std::get<1>(rhs))
-      return std::get<2>(lhs) < std::get<2>(rhs);
-    return std::get<1>(lhs) > std::get<1>(rhs);
+  // The queue holds indexes into `selected`, ordered by each block's
+  // current key. Blocks later in `selected` hold newer data and win on
+  // equal keys.
+  auto cmp = this->cmp;
+  auto compare = [&selected, &cmp](size_t lhs, size_t rhs) {
+    const Key &l = selected[lhs]->top_key();
+    const Key &r = selected[rhs]->top_key();
+    if (keys::equal(cmp, l, r))
+      return lhs < rhs;
+    return cmp(r, l);
   };
 
-  std::priority_queue<pq_node, std::vector<pq_node>, decltype(compare)> pq(
-      compare); // <index, timestamp, key>
-  std::unordered_set<uint64_t> record;
-  std::vector<std::pair<uint64_t, std::string>> temp;
-  std::vector<std::unique_ptr<SSBlock>> ret;
+  std::priority_queue<size_t, std::vector<size_t>, decltype(compare)> pq(
+      compare);
+  std::vector<std::pair<Key, std::string>> temp;
+  std::vector<ValueKind> kinds;
   size_t capacity = 0;
+  bool has_last = false;
+  Key last{};
+  uint64_t now = expiry::now();
+  size_t out = 0;
+  while (out < this->levels.size() && this->levels[out] != level)
+    out++;
+  // Value log pointers of entries that are dropped become garbage.
+  auto discard = [this](std::string stored, ValueKind kind) {
+    if (!(kind & VALUE_POINTER))
+      return;
+    takeExpiry(stored, kind);
+    this->ctx->vlog->addGarbage(ValuePointer::decode(stored));
+  };
+  // Output blocks written so far; once one fails, the rest is not tried.
+  size_t written = 0;
+  bool failed = false;
+  auto write = [&]() {
+    if (!failed && level->insertBlock(temp, pri, kinds))
+      written++;
+    else
+      failed = true;
+    temp.clear();
+    kinds.clear();
+    capacity = 0;
+  };
+  auto emit = [&](const Key &key, std::string value, ValueKind kind) {
+    capacity += keys::KeyTraits<Key>::size(key) + sizeof(uint64_t) + value.size();
+    temp.emplace_back(key, std::move(value));
+    kinds.push_back(kind);
+    if (capacity >= this->options.write_buffer_size)
+      write();
+  };
+
+  // Merge operands of the current key that have not met a value yet.
+  // They are folded into the first older value; if none turns up here,
+  // they are kept as operands while an older version may still exist
+  // outside this compaction.
+  auto op = this->ctx->merge_operator.get();
+  bool merging = false;
+  std::vector<std::string> operands;
+  auto settle = [&](const std::string *base) {
+    merging = false;
+    std::string result;
+    if (op == nullptr) {
+      emit(last, merge::encodeOperands(op, operands), VALUE_MERGE);
+    } else if (op->fullMerge(base, operands, result)) {
+      statistics::record(stats, statistics::MERGE_OPERANDS_FOLDED,
+                         operands.size());
+      emit(last, std::move(result), VALUE_INLINE);
+    } else if (this->mayExistFrom(last, out)) {
+      emit(last, deleted, VALUE_INLINE);
+    }
+  };
+  auto finish = [&]() {
+    if (this->mayExistFrom(last, out)) {
+      merging = false;
+      emit(last, merge::encodeOperands(op, operands), VALUE_MERGE);
+    } else
+      settle(nullptr);
+  };
 
   for (size_t i = 0; i < selected.size(); i++) {
-    pq.push(
-        std::make_tuple(i, selected[i]->top_key(), selected[i]->timestamp()));
+    if (selected[i]->size() != 0)
+      pq.push(i);
   }
 
   while (!pq.empty()) {
-    auto node = pq.top();
-    auto i = std::get<0>(node);
-    auto key = std::get<1>(node);
-    auto timestamp = std::get<2>(node);
+    auto i = pq.top();
     pq.pop();
+    auto kind = selected[i]->top_kind();
 
-    if (record.find(key) == record.end()) {
+    // Keys leave the queue in order, so older versions of a key follow
+    // the newest one directly.
+    if (!has_last || !keys::equal(cmp, last, selected[i]->top_key())) {
+      if (merging)
+        finish();
       auto kv = selected[i]->top();
+      statistics::record(stats, statistics::COMPACT_READ_BYTES,
+                         keys::KeyTraits<Key>::size(kv.first) + kv.second.size());
+      last = kv.first;
+      has_last = true;
 
-      if(kv.second != deleted){
-        capacity += 2 * sizeof(uint64_t) +  kv.second.size();
-        temp.push_back(kv);
+      bool expired = (kind & VALUE_EXPIRES) &&
+                     expiry::expired(coding::getFixed64(kv.second.data()), now);
+      if (kind & VALUE_MERGE) {
+        merging = true;
+        operands = merge::decodeOperands(kv.second);
+      } else if (expired) {
+        // Dropped outright unless an older version outside this
+        // compaction would show through, which a tombstone must cover.
+        statistics::record(stats, statistics::COMPACTION_KEY_DROP_EXPIRED);
+        discard(kv.second, kind);
+        if (this->mayExistFrom(kv.first, out))
+          emit(kv.first, deleted, VALUE_INLINE);
+      } else if (kind != VALUE_INLINE || kv.second != deleted) {
+        emit(kv.first, std::move(kv.second), kind);
+      } else if (this->mayExistFrom(kv.first, out)) {
+        // Only where nothing older is left to hide may a tombstone go.
+        emit(kv.first, deleted, VALUE_INLINE);
+      }
+    } else if (merging) {
+      auto stored = selected[i]->top().second;
+      statistics::record(stats, statistics::COMPACT_READ_BYTES,
+                         keys::KeyTraits<Key>::size(last) + stored.size());
+      if (kind & VALUE_MERGE) {
+        auto older = merge::decodeOperands(stored);
+        operands.insert(operands.begin(), older.begin(), older.end());
+      } else {
+        discard(stored, kind);
+        auto value = this->resolve(std::move(stored), kind);
+        settle(value == deleted ? nullptr : &value);
       }
-        
-      record.insert(key);
+    } else if (kind & VALUE_POINTER) {
+      // A shadowed version whose value lives in the value log.
+      discard(selected[i]->top().second, kind);
     }
 
     selected[i]->pop();
 
     if (selected[i]->size() != 0)
-      pq.push(
-          std::make_tuple(i, selected[i]->top_key(), selected[i]->timestamp()));
-
-    if (capacity >= kvstore::MAX_CAPACITY) {
-      level->insertBlock(temp);
-      temp.clear();
-      capacity = 0;
-    }
+      pq.push(i);
   }
+  if (merging)
+    finish();
   if (!temp.empty())
-    level->insertBlock(temp);
+    write();
 
+  if (failed) {
+    // Nothing is lost: the partial output goes and the inputs return to
+    // their levels. Garbage counted for them only brings a value log
+    // file's collection forward, which checks what is live anyway.
+    for (auto &b : level->takeNewest(written))
+      utils::rmfile(b->getFilename().c_str());
+    for (auto &b : selected) {
+      b->rewind();
+      for (auto &l : this->levels) {
+        if (l->owns(*b)) {
+          l->restore(b);
+          break;
+        }
+      }
+    }
+    selected.clear();
+    this->ctx->vlog->saveGarbage();
+    return false;
+  }
   for (auto const &b : selected)
     utils::rmfile(b->getFilename().c_str());
+  this->ctx->vlog->saveGarbage();
+  return true;
+}
+
+template <typename Key, typename Compare>
+void sstable::SSTable<Key, Compare>::moveTrivially(
+    std::vector<std::unique_ptr<Block>> &selected, size_t out) {
+  auto &cmp = this->cmp;
+  auto overlap = [&cmp](const Block &a, const Block &b) {
+    return !cmp(a.max(), b.min()) && !cmp(b.max(), a.min());
+  };
+  std::vector<bool> moves(selected.size());
+  for (size_t j = 0; j < selected.size(); j++) {
+    moves[j] = !this->levels[out]->overlaps(selected[j]->min(), selected[j]->max());
+    for (size_t k = 0; moves[j] && k < selected.size(); k++)
+      moves[j] = k == j || !overlap(*selected[j], *selected[k]);
+  }
+  // The merged output spans the whole range of what stays, so a block
+  // inside that range has to stay too, which can widen it again.
+  for (bool changed = true; changed;) {
+    changed = false;
+    bool any = false;
+    Key minn{}, maxx{};
+    for (size_t j = 0; j < selected.size(); j++) {
+      if (moves[j])
+        continue;
+      if (!any || cmp(selected[j]->min(), minn))
+        minn = selected[j]->min();
+      if (!any || cmp(maxx, selected[j]->max()))
+        maxx = selected[j]->max();
+      any = true;
+    }
+    for (size_t j = 0; any && j < selected.size(); j++) {
+      if (moves[j] && !cmp(selected[j]->max(), minn) &&
+          !cmp(maxx, selected[j]->min())) {
+        moves[j] = false;
+        changed = true;
+      }
+    }
+  }
+
+  auto stats = this->ctx->stats.get();
+  std::vector<std::unique_ptr<Block>> rest;
+  for (size_t j = 0; j < selected.size(); j++) {
+    uint64_t bytes = selected[j]->fileSize();
+    if (moves[j] && this->levels[out]->adopt(selected[j])) {
+      statistics::record(stats, statistics::COMPACTION_TRIVIAL_MOVES);
+      statistics::record(stats, statistics::COMPACTION_TRIVIAL_MOVE_BYTES, bytes);
+    } else {
+      rest.push_back(std::move(selected[j]));
+    }
+  }
+  selected = std::move(rest);
+}
+
+template <typename Key, typename Compare>
+bool sstable::SSTable<Key, Compare>::mergeInto(
+    size_t out, std::vector<std::unique_ptr<Block>> &upper) {
+  if (this->levels[out]->getPolicy() == LEVELING)
+    this->moveTrivially(upper, out);
+  if (upper.empty())
+    return true;
+  auto range = rangeSelected(upper);
+  auto minn = range.first;
+  auto maxx = range.second;
+  // Older data from the next level goes first so that the upper level,
+  // oldest to newest, overrides it in compactBlocks.
+  auto selected = this->levels[out]->select(NEXT, minn, maxx);
+  uint64_t upper_bytes = 0, lower_bytes = 0;
+  for (const auto &b : upper)
+    upper_bytes += b->fileSize();
+  for (const auto &b : selected)
+    lower_bytes += b->fileSize();
+  this->levels[out]->recordCompaction(upper_bytes, lower_bytes);
+  selected.insert(selected.end(), std::make_move_iterator(upper.begin()),
+                  std::make_move_iterator(upper.end()));
+  return this->compactBlocks(selected, this->levels[out],
+                             out == 1 ? IO_COMPACT_SHALLOW : IO_COMPACT_DEEP);
+}
+
+template <typename Key, typename Compare>
+bool sstable::SSTable<Key, Compare>::compactLevel(size_t i) {
+  // A Universal level merges its newest runs into one, in place.
+  if (this->levels[i]->getPolicy() == UNIVERSAL) {
+    auto selected = this->levels[i]->select(PREV, Key(), Key());
+    if (selected.empty())
+      return false;
+    uint64_t bytes = 0;
+    for (const auto &b : selected)
+      bytes += b->fileSize();
+    this->levels[i]->recordCompaction(bytes, 0);
+    return this->compactBlocks(selected, this->levels[i],
+                               i <= 1 ? IO_COMPACT_SHALLOW : IO_COMPACT_DEEP);
+  }
+  if (i + 1 == this->levels.size()) {
+    // Without dynamic levels the last one grows without bound.
+    if (!this->options.dynamic_levels || this->options.levels.size() < 2)
+      return false;
+    this->addLevel();
+    this->resizeLevels();
+  }
+
+  auto selected = this->levels[i]->select(PREV, Key(), Key());
+  if (selected.empty())
+    return false;
+  return this->mergeInto(i + 1, selected);
 }
 
-void sstable::SSTable::compact() {
-  for (size_t i = 0; i < this->levels.size() - 1 &&
-                     this->levels[i]->size() >= this->levels[i]->getLimit();
-       i++) {
-    auto selected = this->levels[i]->select(PREV, -1, -1);
-    auto range = rangeSelected(selected);
-    auto minn = range.first;
-    auto maxx = range.second;
-    auto selected_next = this->levels[i + 1]->select(NEXT, minn, maxx);
-    selected.insert(selected.end(),
-                    std::make_move_iterator(selected_next.begin()),
-                    std::make_move_iterator(selected_next.end()));
-    this->compactBlocks(selected, this->levels[i + 1]);
+template <typename Key, typename Compare>
+bool sstable::SSTable<Key, Compare>::compactSeekMisses() {
+  if (this->ctx->seek_miss_limit == 0 || !this->ctx->seek_pending)
+    return false;
+  // Only between leveled levels can one block go down ahead of the rest.
+  for (size_t i = 0; i + 1 < this->levels.size(); i++) {
+    if (this->levels[i]->getPolicy() != LEVELING ||
+        this->levels[i + 1]->getPolicy() != LEVELING)
+      continue;
+    auto block = this->levels[i]->takeHeaviest(
+        [](const Block &b) { return b.seekMisses(); }, this->ctx->seek_miss_limit);
+    if (block == nullptr)
+      continue;
+    statistics::record(this->ctx->stats.get(),
+                       statistics::COMPACTION_SEEK_TRIGGERED);
+    std::vector<std::unique_ptr<Block>> upper;
+    upper.push_back(std::move(block));
+    return this->mergeInto(i + 1, upper);
   }
+  this->ctx->seek_pending = false;
+  return false;
 }
+
+template <typename Key, typename Compare>
+bool sstable::SSTable<Key, Compare>::tombstonesMovable(size_t i) const {
+  return this->levels[i]->getPolicy() == LEVELING &&
+         (i + 1 == this->levels.size() ||
+          this->levels[i + 1]->getPolicy() == LEVELING);
+}
+
+template <typename Key, typename Compare>
+bool sstable::SSTable<Key, Compare>::compactTombstones() {
+  double ratio = this->options.tombstone_compaction_ratio;
+  if (ratio <= 0)
+    return false;
+  auto density = [](const Block &b) {
+    return b.keys() == 0 ? 0.0 : (double)b.tombstones() / b.keys();
+  };
+  for (size_t i = 0; i < this->levels.size(); i++) {
+    if (!this->tombstonesMovable(i))
+      continue;
+    auto block = this->levels[i]->takeHeaviest(density, ratio);
+    if (block == nullptr)
+      continue;
+    statistics::record(this->ctx->stats.get(),
+                       statistics::COMPACTION_TOMBSTONE_TRIGGERED);
+    std::vector<std::unique_ptr<Block>> upper;
+    upper.push_back(std::move(block));
+    if (i + 1 < this->levels.size())
+      return this->mergeInto(i + 1, upper);
+    // Nothing is left below to hide, so the rewrite drops them all.
+    this->levels[i]->recordCompaction(upper[0]->fileSize(), 0);
+    return this->compactBlocks(upper, this->levels[i], IO_COMPACT_DEEP);
+  }
+  return false;
+}
+
+template <typename Key, typename Compare>
+double sstable::SSTable<Key, Compare>::score(size_t i) const {
+  const auto &level = *this->levels[i];
+  auto policy = level.getPolicy();
+  if (i + 1 == this->levels.size() && policy != UNIVERSAL &&
+      !this->options.dynamic_levels)
+    return 0;
+  double units = policy == UNIVERSAL ? level.sortedRuns() : level.size();
+  return units / std::max<size_t>(level.getLimit(), 1);
+}
+
+template <typename Key, typename Compare>
+bool sstable::SSTable<Key, Compare>::needsCompaction() const {
+  for (size_t i = 0; i < this->levels.size(); i++) {
+    if (this->score(i) >= 1)
+      return true;
+  }
+  if (this->ctx->seek_miss_limit != 0 && this->ctx->seek_pending)
+    return true;
+  // Scored per block, as compactTombstones() picks them: one dense block
+  // in an otherwise clean level still counts.
+  double ratio = this->options.tombstone_compaction_ratio;
+  for (size_t i = 0; ratio > 0 && i < this->levels.size(); i++) {
+    if (this->tombstonesMovable(i) && this->levels[i]->densest() >= ratio)
+      return true;
+  }
+  return false;
+}
+
+template <typename Key, typename Compare>
+bool sstable::SSTable<Key, Compare>::compactOnce() {
+  this->resizeLevels();
+  std::vector<std::pair<double, size_t>> scores;
+  for (size_t i = 0; i < this->levels.size(); i++)
+    scores.emplace_back(this->score(i), i);
+  // Highest first; a level whose compaction finds nothing to move, like
+  // a leveled one right at its limit, gives way to the next.
+  std::sort(scores.begin(), scores.end(),
+            [](const std::pair<double, size_t> &a,
+               const std::pair<double, size_t> &b) {
+              return a.first > b.first || (a.first == b.first && a.second < b.second);
+            });
+  for (const auto &s : scores) {
+    if (s.first < 1)
+      break;
+    if (this->compactLevel(s.second))
+      return true;
+  }
+  return this->compactSeekMisses() || this->compactTombstones();
+}
+
+template <typename Key, typename Compare>
+void sstable::SSTable<Key, Compare>::compact() {
+  while (this->compactOnce())
+    ;
+}
+
+template <typename Key, typename Compare>
+bool sstable::SSTable<Key, Compare>::ingest(const std::vector<std::string> &paths) {
+  std::vector<std::unique_ptr<Block>> blocks;
+  for (const auto &path : paths) {
+    if (!plausibleBlock(path))
+      return false;
+    blocks.push_back(std::make_unique<Block>(path, this->ctx, this->cmp));
+    // Pointers would lead into some other store's value log.
+    if (blocks.back()->keys() == 0 || !blocks.back()->pointers().empty())
+      return false;
+  }
+  auto &cmp = this->cmp;
+  std::sort(blocks.begin(), blocks.end(),
+            [&cmp](const std::unique_ptr<Block> &l, const std::unique_ptr<Block> &r) {
+              return cmp(l->min(), r->min());
+            });
+  for (size_t j = 1; j < blocks.size(); j++) {
+    if (!cmp(blocks[j - 1]->max(), blocks[j]->min()))
+      return false;
+  }
+
+  // Ingested data is newer than anything in the tree, so nothing above
+  // it may hold its keys.
+  auto stats = this->ctx->stats.get();
+  for (auto &block : blocks) {
+    size_t out = 0;
+    while (out + 1 < this->levels.size() &&
+           !this->levels[out]->overlaps(block->min(), block->max()) &&
+           !this->levels[out + 1]->overlaps(block->min(), block->max()))
+      out++;
+    uint64_t bytes = block->fileSize();
+    if (!this->levels[out]->ingest(block))
+      return false;
+    statistics::record(stats, statistics::INGESTED_FILES);
+    statistics::record(stats, statistics::INGESTED_BYTES, bytes);
+  }
+  if (!this->options.background_compaction && this->needsCompaction()) {
+    this->compact();
+    this->collectGarbage();
+  }
+  return true;
+}
+
+template <typename Key, typename Compare>
+bool sstable::SSTable<Key, Compare>::checkpoint(const std::string &dir) const {
+  if (utils::dirExists(dir) || utils::fileExists(dir) ||
+      utils::mkdir(dir.c_str()) != 0)
+    return false;
+  std::vector<std::pair<std::string, uint64_t>> linked;
+  for (size_t i = 0; i < this->levels.size(); i++) {
+    auto level = "level-" + std::to_string(i);
+    if (utils::mkdir((dir + "/" + level).c_str()) != 0)
+      return false;
+    for (const auto &file : this->levels[i]->files()) {
+      auto name = level + file.first.substr(file.first.rfind('/'));
+      if (utils::lnfile(file.first.c_str(), (dir + "/" + name).c_str()) != 0)
+        return false;
+      linked.emplace_back(name, file.second);
+    }
+  }
+  std::vector<std::pair<std::string, uint64_t>> logs;
+  if (utils::mkdir((dir + "/vlog").c_str()) != 0 ||
+      !this->ctx->vlog->checkpoint(dir + "/vlog", logs))
+    return false;
+  for (const auto &log : logs)
+    linked.emplace_back("vlog/" + log.first, log.second);
+  if (!this->options.toFile(dir + "/CONF"))
+    return false;
+
+  {
+    std::ofstream ofile(dir + "/MANIFEST.tmp");
+    for (const auto &file : linked)
+      ofile << file.first << " " << file.second << "\n";
+    if (!ofile)
+      return false;
+  }
+  return utils::mvfile((dir + "/MANIFEST.tmp").c_str(),
+                       (dir + "/MANIFEST").c_str()) == 0;
+}
+
+template <typename Key, typename Compare>
+void sstable::SSTable<Key, Compare>::collectGarbage() {
+  auto vlog = this->ctx->vlog.get();
+  auto stats = this->ctx->stats.get();
+  auto files = vlog->collectable(this->options.vlog_gc_ratio);
+  if (files.empty())
+    return;
+
+  for (auto file : files) {
+    // A record is live when the newest value of its key, past any merge
+    // operands, still points at it. Live values are written back through
+    // level 0 as ordinary inline values, which separates them again into
+    // a new file. Operands above a live value would be shadowed by the
+    // new copy, so it is written back folded.
+    struct Live {
+      Key key;
+      std::string value;
+      ValueKind kind;
+    };
+    std::vector<Live> live;
+    uint64_t relocated = 0;
+    bool keep = false;
+    vlog->forEach(file, [&](const std::string &encoded, const std::string &value,
+                            uint64_t offset) {
+      auto key = keys::KeyTraits<Key>::decode(encoded.data(), encoded.size());
+      std::vector<std::string> operands;
+      bool is_live = false;
+      uint64_t when = expiry::NEVER;
+      size_t probes = 0;
+      for (auto &level : this->levels) {
+        bool more = level->versions(
+            key, probes, [&](const io::ReadRequest &req, ValueKind kind) {
+              auto stored = this->ctx->io->read(req.fd, req.offset, req.size);
+              if (kind & VALUE_MERGE) {
+                auto older = merge::decodeOperands(stored);
+                operands.insert(operands.begin(), older.begin(), older.end());
+                return true;
+              }
+              if (kind & VALUE_POINTER) {
+                when = takeExpiry(stored, kind);
+                auto ptr = ValuePointer::decode(stored);
+                // Expired values are left for compaction to drop.
+                is_live = ptr.file == file && ptr.offset == offset &&
+                          !expiry::expired(when, expiry::now());
+              }
+              return false;
+            });
+        if (!more)
+          break;
+      }
+      if (!is_live)
+        return;
+
+      std::string current = value;
+      if (!operands.empty()) {
+        auto op = this->ctx->merge_operator.get();
+        if (op == nullptr || !op->fullMerge(&value, operands, current)) {
+          keep = true;
+          return;
+        }
+        when = expiry::NEVER;
+      }
+      relocated += current.size();
+      if (when == expiry::NEVER)
+        live.push_back({key, std::move(current), VALUE_INLINE});
+      else
+        live.push_back({key, expiry::wrap(current, when), VALUE_EXPIRES});
+    });
+
+    auto cmp = this->cmp;
+    std::sort(live.begin(), live.end(),
+              [&cmp](const Live &l, const Live &r) {
+                return cmp(l.key, r.key);
+              });
+    std::vector<std::pair<Key, std::string>> batch;
+    std::vector<ValueKind> kinds;
+    size_t capacity = 0;
+    for (auto &entry : live) {
+      capacity += keys::KeyTraits<Key>::size(entry.key) + sizeof(uint64_t) +
+                  entry.value.size();
+      batch.emplace_back(std::move(entry.key), std::move(entry.value));
+      kinds.push_back(entry.kind);
+      if (capacity >= this->options.write_buffer_size) {
+        // Until every live value is rewritten the file has to stay.
+        if (!this->levels[0]->insertBlock(batch, IO_COMPACT_DEEP, kinds))
+          keep = true;
+        batch.clear();
+        kinds.clear();
+        capacity = 0;
+      }
+    }
+    if (!batch.empty() &&
+        !this->levels[0]->insertBlock(batch, IO_COMPACT_DEEP, kinds))
+      keep = true;
+
+    if (keep)
+      continue;
+    vlog->remove(file);
+    vlog->saveGarbage();
+    statistics::record(stats, statistics::VLOG_GC_COUNT);
+    statistics::record(stats, statistics::VLOG_GC_BYTES_RELOCATED, relocated);
+  }
+
+  if (!this->options.background_compaction && this->needsCompaction())
+    this->compact();
+}
+
+template class sstable::SSTable<uint64_t>;
+template class sstable::SSTable<std::string>;
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdio>
 #include <sstream>
 #include <sys/stat.h>
 #include <vector>
@@ -29,6 +30,17 @@ namespace utils{
         return ret == 0 && st.st_mode & S_IFDIR;
     }
 
+    /**
+     * Check whether regular file exists
+     * @param path file to be checked.
+     * @return ture if file exists, false otherwise.
+     */
+    static inline bool fileExists(std::string path){
+        struct stat st;
+        int ret = stat(path.c_str(), &st);
+        return ret == 0 && st.st_mode & S_IFREG;
+    }
+
     /**
      * list all filename in a directory
      * @param path directory path.
@@ -67,7 +79,9 @@ namespace utils{
         DIR *dir;
         struct dirent *rent;
         dir = opendir(path.c_str());
-        char s[100];
+        if (dir == nullptr)
+            return 0;
+        char s[256];
         while((rent = readdir(dir))){
             strcpy(s,rent->d_name);
             if (s[0] != '.'){
@@ -104,6 +118,10 @@ namespace utils{
 
         while (std::getline(ss, dirName, '/')){
             currentPath += dirName;
+            if (dirName.empty()){
+                currentPath += "/";
+                continue;
+            }
             if (!dirExists(currentPath) && _mkdir(currentPath.c_str()) != 0){
                 return -1;
             }
@@ -138,6 +156,30 @@ namespace utils{
         #endif
     }
 
+    /**
+     * Move a file, replacing any file at the destination
+     * @param from file to be moved.
+     * @param to new path of the file.
+     * @return 0 if moved successfully, -1 otherwise.
+     */
+    static inline int mvfile(const char *from, const char *to){
+        return ::rename(from, to) == 0 ? 0 : -1;
+    }
+
+    /**
+     * Give a file a second name, on the same filesystem
+     * @param from existing file.
+     * @param to new name, which must not exist yet.
+     * @return 0 if linked successfully, -1 otherwise.
+     */
+    static inline int lnfile(const char *from, const char *to){
+        #ifdef _WIN32
+            return CreateHardLinkA(to, from, nullptr) ? 0 : -1;
+        #else
+            return ::link(from, to) == 0 ? 0 : -1;
+        #endif
+    }
+
 
     
 }
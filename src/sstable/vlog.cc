@@ -0,0 +1,258 @@
+#include "utils.h"
+
+#include <sstable/index.h>
+#include <sstable/vlog.h>
+
+#include <cstdio>
+#include <fstream>
+
+namespace {
+const std::string garbage_file = "GARBAGE";
+const std::string file_prefix = "vlog-";
+const std::string file_suffix = ".log";
+} // namespace
+
+std::string sstable::ValuePointer::encode() const {
+  std::string ret;
+  coding::putFixed64(ret, this->file);
+  coding::putFixed64(ret, this->offset);
+  coding::putFixed64(ret, this->size);
+  return ret;
+}
+
+sstable::ValuePointer sstable::ValuePointer::decode(const std::string &data) {
+  ValuePointer ret{};
+  if (data.size() < ENCODED_SIZE)
+    return ret;
+  ret.file = coding::getFixed64(data.data());
+  ret.offset = coding::getFixed64(data.data() + sizeof(uint64_t));
+  ret.size = coding::getFixed64(data.data() + 2 * sizeof(uint64_t));
+  return ret;
+}
+
+sstable::ValueLogWriter::ValueLogWriter(ValueLog *log, uint64_t file,
+                                        std::unique_ptr<io::WritableFile> ofile)
+    : log(log), file(file), ofile(std::move(ofile)), offset(0), failed(false) {}
+
+sstable::ValuePointer sstable::ValueLogWriter::add(const std::string &key,
+                                                   const memory::Slice &value) {
+  std::string head;
+  coding::putVarint(head, key.size());
+  head.append(key);
+  coding::putVarint(head, value.size());
+  if (!this->ofile->append(head.data(), head.size()) ||
+      !this->ofile->append(value.data(), value.size()))
+    this->failed = true;
+
+  ValuePointer ret{this->file, this->offset + head.size(), value.size()};
+  this->offset += head.size() + value.size();
+  return ret;
+}
+
+bool sstable::ValueLogWriter::finish() {
+  if (!this->ofile->close() || this->failed) {
+    utils::rmfile(this->log->path(this->file).c_str());
+    return false;
+  }
+  this->log->seal(this->file, this->offset);
+  return true;
+}
+
+void sstable::ValueLogWriter::abandon() {
+  this->ofile->close();
+  utils::rmfile(this->log->path(this->file).c_str());
+}
+
+uint64_t sstable::ValueLogWriter::delayedMicros() const {
+  return this->ofile->delayedMicros();
+}
+
+sstable::ValueLog::ValueLog(const std::string &dir,
+                            std::shared_ptr<io::IOBackend> io,
+                            uint64_t threshold)
+    : dir(dir), io(io), threshold(threshold), next_file(0),
+      garbage_dirty(false) {
+  if (!utils::dirExists(this->dir))
+    utils::mkdir(this->dir.c_str());
+
+  std::vector<std::string> names;
+  utils::scanDir(this->dir, names);
+  for (const auto &name : names) {
+    if (name.compare(0, file_prefix.size(), file_prefix) != 0)
+      continue;
+    uint64_t file = std::stoull(name.substr(file_prefix.size()));
+    int fd = this->io->open(this->path(file));
+    this->files[file] = File{fd, this->io->fileSize(fd), 0};
+    this->next_file = std::max(this->next_file, file + 1);
+  }
+  this->loadGarbage();
+}
+
+sstable::ValueLog::~ValueLog() {
+  this->saveGarbage();
+  for (auto &f : this->files)
+    this->io->close(f.second.fd);
+}
+
+std::string sstable::ValueLog::path(uint64_t file) const {
+  return this->dir + "/" + file_prefix + std::to_string(file) + file_suffix;
+}
+
+void sstable::ValueLog::loadGarbage() {
+  std::ifstream ifile(this->dir + "/" + garbage_file);
+  uint64_t file, garbage;
+  while (ifile >> file >> garbage) {
+    auto it = this->files.find(file);
+    if (it != this->files.end())
+      it->second.garbage = garbage;
+  }
+}
+
+void sstable::ValueLog::saveGarbage() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  if (!this->garbage_dirty)
+    return;
+  auto name = this->dir + "/" + garbage_file;
+  {
+    std::ofstream ofile(name + ".tmp");
+    for (const auto &f : this->files)
+      ofile << f.first << " " << f.second.garbage << "\n";
+  }
+  std::rename((name + ".tmp").c_str(), name.c_str());
+  this->garbage_dirty = false;
+}
+
+bool sstable::ValueLog::separates(const memory::Slice &value) const {
+  return this->threshold != 0 && value.size() >= this->threshold;
+}
+
+std::unique_ptr<sstable::ValueLogWriter>
+sstable::ValueLog::newWriter(IOPriority pri) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  uint64_t file = this->next_file++;
+  return std::make_unique<ValueLogWriter>(
+      this, file, this->io->create(this->path(file), pri));
+}
+
+void sstable::ValueLog::seal(uint64_t file, uint64_t size) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->files[file] = File{this->io->open(this->path(file)), size, 0};
+}
+
+sstable::io::ReadRequest
+sstable::ValueLog::request(const ValuePointer &ptr) const {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  io::ReadRequest req{};
+  auto it = this->files.find(ptr.file);
+  req.fd = it == this->files.end() ? -1 : it->second.fd;
+  req.offset = ptr.offset;
+  req.size = ptr.size;
+  return req;
+}
+
+std::string sstable::ValueLog::read(const ValuePointer &ptr) {
+  auto req = this->request(ptr);
+  if (req.fd < 0)
+    return "";
+  return this->io->read(req.fd, req.offset, req.size);
+}
+
+void sstable::ValueLog::addGarbage(const ValuePointer &ptr) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  auto it = this->files.find(ptr.file);
+  if (it == this->files.end())
+    return;
+  it->second.garbage += ptr.size;
+  this->garbage_dirty = true;
+}
+
+std::vector<uint64_t> sstable::ValueLog::collectable(double ratio) const {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  std::vector<uint64_t> ret;
+  for (const auto &f : this->files) {
+    if (f.second.size != 0 && f.second.garbage >= ratio * f.second.size)
+      ret.push_back(f.first);
+  }
+  return ret;
+}
+
+void sstable::ValueLog::forEach(
+    uint64_t file,
+    const std::function<void(const std::string &, const std::string &,
+                             uint64_t)> &fn) {
+  int fd;
+  uint64_t size;
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    auto it = this->files.find(file);
+    if (it == this->files.end())
+      return;
+    fd = it->second.fd;
+    size = it->second.size;
+  }
+  auto data = this->io->read(fd, 0, size);
+  const char *begin = data.data();
+  const char *p = begin;
+  const char *end = begin + data.size();
+  // A crash mid-append leaves a torn last record, which is skipped.
+  while (p < end) {
+    uint64_t key_size, value_size;
+    if (!coding::getVarint(p, end, key_size) || key_size > (uint64_t)(end - p))
+      break;
+    std::string key(p, key_size);
+    p += key_size;
+    if (!coding::getVarint(p, end, value_size) ||
+        value_size > (uint64_t)(end - p))
+      break;
+    fn(key, std::string(p, value_size), p - begin);
+    p += value_size;
+  }
+}
+
+void sstable::ValueLog::remove(uint64_t file) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  auto it = this->files.find(file);
+  if (it == this->files.end())
+    return;
+  this->io->close(it->second.fd);
+  this->files.erase(it);
+  utils::rmfile(this->path(file).c_str());
+  this->garbage_dirty = true;
+}
+
+bool sstable::ValueLog::checkpoint(
+    const std::string &dir,
+    std::vector<std::pair<std::string, uint64_t>> &linked) const {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  for (const auto &f : this->files) {
+    auto name = file_prefix + std::to_string(f.first) + file_suffix;
+    if (utils::lnfile(this->path(f.first).c_str(), (dir + "/" + name).c_str()) != 0)
+      return false;
+    linked.emplace_back(name, f.second.size);
+  }
+  std::ofstream ofile(dir + "/" + garbage_file);
+  for (const auto &f : this->files)
+    ofile << f.first << " " << f.second.garbage << "\n";
+  return bool(ofile);
+}
+
+size_t sstable::ValueLog::size() const {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  return this->files.size();
+}
+
+uint64_t sstable::ValueLog::totalBytes() const {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  uint64_t ret = 0;
+  for (const auto &f : this->files)
+    ret += f.second.size;
+  return ret;
+}
+
+uint64_t sstable::ValueLog::garbageBytes() const {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  uint64_t ret = 0;
+  for (const auto &f : this->files)
+    ret += f.second.garbage;
+  return ret;
+}
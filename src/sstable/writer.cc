@@ -0,0 +1,57 @@
+#include "utils.h"
+
+#include <sstable/writer.h>
+
+template <typename Key, typename Compare>
+sstable::SSTableWriter<Key, Compare>::SSTableWriter(const std::string &filename,
+                                                    const Compare &cmp)
+    : filename(filename), cmp(cmp), bytes(0), finished(false) {
+  // Enough of a context for SSBlock::flush: plain writes, no rate limit,
+  // no value log, no statistics.
+  this->ctx = std::make_shared<SSContext>();
+  this->ctx->io = io::make_backend(io::SYNC, false, 1);
+}
+
+template <typename Key, typename Compare>
+bool sstable::SSTableWriter<Key, Compare>::add(const Key &key,
+                                               const std::string &value) {
+  if (this->finished ||
+      (!this->entries.empty() && !this->cmp(this->entries.back().first, key)))
+    return false;
+  this->bytes += keys::KeyTraits<Key>::size(key) + value.size();
+  this->entries.emplace_back(key, value);
+  return true;
+}
+
+template <typename Key, typename Compare>
+bool sstable::SSTableWriter<Key, Compare>::put(const Key &key,
+                                               const std::string &value) {
+  return this->add(key, value);
+}
+
+template <typename Key, typename Compare>
+bool sstable::SSTableWriter<Key, Compare>::del(const Key &key) {
+  return this->add(key, deleted);
+}
+
+template <typename Key, typename Compare>
+uint64_t sstable::SSTableWriter<Key, Compare>::size() const {
+  return this->bytes;
+}
+
+template <typename Key, typename Compare>
+bool sstable::SSTableWriter<Key, Compare>::finish() {
+  if (this->finished || this->entries.empty())
+    return false;
+  // A block opened on an existing file would load it first.
+  utils::rmfile(this->filename.c_str());
+  SSBlock<Key, Compare> block(this->filename, this->ctx, this->cmp);
+  if (!block.flush(this->entries, IO_FLUSH))
+    return false;
+  this->entries.clear();
+  this->finished = true;
+  return true;
+}
+
+template class sstable::SSTableWriter<uint64_t>;
+template class sstable::SSTableWriter<std::string>;
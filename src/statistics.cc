@@ -0,0 +1,255 @@
+#include <statistics.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+namespace {
+const char *ticker_names[] = {
+    "bloom.filter.useful",
+    "bloom.filter.positive",
+    "bloom.filter.false.positive",
+    "memtable.hit",
+    "memtable.miss",
+    "get.hit.l0",
+    "get.hit.l1",
+    "get.hit.l2andup",
+    "number.keys.written",
+    "number.keys.read",
+    "number.keys.found",
+    "number.keys.deleted",
+    "number.multiget.keys",
+    "number.scans",
+    "bytes.written",
+    "bytes.read",
+    "block.read.count",
+    "block.read.bytes",
+    "flush.count",
+    "flush.bytes",
+    "compaction.count",
+    "compact.read.bytes",
+    "compact.write.bytes",
+    "stall.micros",
+    "rate.limit.delay.micros",
+    "vlog.bytes.written",
+    "vlog.bytes.read",
+    "vlog.gc.count",
+    "vlog.gc.bytes.relocated",
+    "compaction.key.drop.expired",
+    "expired.blocks.dropped",
+    "number.merges",
+    "merge.operands.folded",
+    "compaction.trivial.moves",
+    "compaction.trivial.move.bytes",
+    "ingested.files",
+    "ingested.bytes",
+    "block.cache.hit",
+    "block.cache.miss",
+    "block.cache.add",
+    "memory.budget.flushes",
+    "compaction.seek.triggered",
+    "compaction.tombstone.triggered",
+};
+
+const char *histogram_names[] = {
+    "get.micros",
+    "put.micros",
+    "multiget.micros",
+    "scan.micros",
+    "flush.micros",
+    "compaction.micros",
+    "blocks.read.per.get",
+    "blocks.probed.per.get",
+};
+
+static_assert(sizeof(ticker_names) / sizeof(*ticker_names) == statistics::NR_TICKERS,
+              "every ticker needs a name");
+static_assert(sizeof(histogram_names) / sizeof(*histogram_names) ==
+                  statistics::NR_HISTOGRAMS,
+              "every histogram needs a name");
+
+std::atomic<unsigned> next_shard{0};
+thread_local int shard_id = -1;
+
+thread_local statistics::PerfLevel perf_level = statistics::PERF_DISABLE;
+thread_local statistics::PerfContext perf_context{};
+} // namespace
+
+const char *statistics::ticker_name(Ticker t) { return ticker_names[t]; }
+
+const char *statistics::histogram_name(Histogram h) {
+  return histogram_names[h];
+}
+
+statistics::Statistics::Statistics() : shards(new Shard[NR_SHARDS]) {
+  this->reset();
+}
+
+statistics::Statistics::Shard &statistics::Statistics::local() {
+  if (shard_id < 0)
+    shard_id = next_shard.fetch_add(1, std::memory_order_relaxed) % NR_SHARDS;
+  return this->shards[shard_id];
+}
+
+int statistics::Statistics::bucket(uint64_t value) {
+  if (value < (1u << SUB_BITS))
+    return value;
+  int msb = 63 - __builtin_clzll(value);
+  int shift = msb - SUB_BITS;
+  return ((shift + 1) << SUB_BITS) +
+         ((value >> shift) & ((1u << SUB_BITS) - 1));
+}
+
+uint64_t statistics::Statistics::bucket_limit(int b) {
+  if (b < (1 << SUB_BITS))
+    return b;
+  int shift = (b >> SUB_BITS) - 1;
+  uint64_t sub = b & ((1 << SUB_BITS) - 1);
+  return (((1ull << SUB_BITS) + sub + 1) << shift) - 1;
+}
+
+void statistics::Statistics::record(Ticker t, uint64_t count) {
+  this->local().tickers[t].fetch_add(count, std::memory_order_relaxed);
+}
+
+void statistics::Statistics::measure(Histogram h, uint64_t value) {
+  Shard &shard = this->local();
+  shard.buckets[h][bucket(value)].fetch_add(1, std::memory_order_relaxed);
+  shard.sums[h].fetch_add(value, std::memory_order_relaxed);
+  uint64_t prev = shard.maxs[h].load(std::memory_order_relaxed);
+  while (prev < value &&
+         !shard.maxs[h].compare_exchange_weak(prev, value,
+                                              std::memory_order_relaxed))
+    ;
+}
+
+uint64_t statistics::Statistics::get(Ticker t) const {
+  uint64_t ret = 0;
+  for (int i = 0; i < NR_SHARDS; i++)
+    ret += this->shards[i].tickers[t].load(std::memory_order_relaxed);
+  return ret;
+}
+
+statistics::HistogramSnapshot
+statistics::Statistics::snapshot(Histogram h) const {
+  HistogramSnapshot ret{};
+  uint64_t buckets[NR_BUCKETS] = {};
+  for (int i = 0; i < NR_SHARDS; i++) {
+    const Shard &shard = this->shards[i];
+    for (int b = 0; b < NR_BUCKETS; b++) {
+      uint64_t n = shard.buckets[h][b].load(std::memory_order_relaxed);
+      buckets[b] += n;
+      ret.count += n;
+    }
+    ret.sum += shard.sums[h].load(std::memory_order_relaxed);
+    ret.max = std::max(ret.max, shard.maxs[h].load(std::memory_order_relaxed));
+  }
+
+  auto percentile = [&](double p) -> double {
+    if (ret.count == 0)
+      return 0;
+    uint64_t target = std::max<uint64_t>(1, ret.count * p / 100);
+    uint64_t seen = 0;
+    for (int b = 0; b < NR_BUCKETS; b++) {
+      seen += buckets[b];
+      if (seen >= target)
+        return std::min(bucket_limit(b), ret.max);
+    }
+    return ret.max;
+  };
+  ret.p50 = percentile(50);
+  ret.p95 = percentile(95);
+  ret.p99 = percentile(99);
+  ret.p999 = percentile(99.9);
+  return ret;
+}
+
+void statistics::Statistics::reset() {
+  for (int i = 0; i < NR_SHARDS; i++) {
+    Shard &shard = this->shards[i];
+    for (auto &t : shard.tickers)
+      t.store(0, std::memory_order_relaxed);
+    for (int h = 0; h < NR_HISTOGRAMS; h++) {
+      for (auto &b : shard.buckets[h])
+        b.store(0, std::memory_order_relaxed);
+      shard.sums[h].store(0, std::memory_order_relaxed);
+      shard.maxs[h].store(0, std::memory_order_relaxed);
+    }
+  }
+}
+
+std::string statistics::Statistics::toString() const {
+  std::ostringstream ss;
+  for (int t = 0; t < NR_TICKERS; t++)
+    ss << "minilsm." << ticker_names[t] << " COUNT : "
+       << this->get(static_cast<Ticker>(t)) << "\n";
+  ss << std::fixed << std::setprecision(1);
+  for (int h = 0; h < NR_HISTOGRAMS; h++) {
+    auto snap = this->snapshot(static_cast<Histogram>(h));
+    ss << "minilsm." << histogram_names[h] << " P50 : " << snap.p50
+       << " P95 : " << snap.p95 << " P99 : " << snap.p99
+       << " P99.9 : " << snap.p999 << " MAX : " << snap.max
+       << " COUNT : " << snap.count << " SUM : " << snap.sum << "\n";
+  }
+  return ss.str();
+}
+
+std::string statistics::Statistics::toJson() const {
+  std::ostringstream ss;
+  ss << "{\"tickers\":{";
+  for (int t = 0; t < NR_TICKERS; t++)
+    ss << (t ? "," : "") << "\"" << ticker_names[t]
+       << "\":" << this->get(static_cast<Ticker>(t));
+  ss << "},\"histograms\":{";
+  for (int h = 0; h < NR_HISTOGRAMS; h++) {
+    auto snap = this->snapshot(static_cast<Histogram>(h));
+    ss << (h ? "," : "") << "\"" << histogram_names[h] << "\":{"
+       << "\"count\":" << snap.count << ",\"sum\":" << snap.sum
+       << ",\"p50\":" << snap.p50 << ",\"p95\":" << snap.p95
+       << ",\"p99\":" << snap.p99 << ",\"p999\":" << snap.p999
+       << ",\"max\":" << snap.max << "}";
+  }
+  ss << "}}";
+  return ss.str();
+}
+
+void statistics::set_perf_level(PerfLevel level) { perf_level = level; }
+
+statistics::PerfLevel statistics::get_perf_level() { return perf_level; }
+
+statistics::PerfContext &statistics::get_perf_context() { return perf_context; }
+
+#define PERF_FIELDS(X)                                                         \
+  X(get_memtable_nanos)                                                        \
+  X(get_filter_nanos)                                                          \
+  X(get_index_nanos)                                                           \
+  X(get_read_nanos)                                                            \
+  X(memtable_hit_count)                                                        \
+  X(bloom_useful_count)                                                        \
+  X(bloom_positive_count)                                                      \
+  X(blocks_probed_count)                                                       \
+  X(block_read_count)                                                          \
+  X(block_read_bytes)
+
+void statistics::PerfContext::reset() { *this = PerfContext{}; }
+
+std::string statistics::PerfContext::toString() const {
+  std::ostringstream ss;
+#define X(field) ss << #field " = " << this->field << ", ";
+  PERF_FIELDS(X)
+#undef X
+  auto ret = ss.str();
+  return ret.substr(0, ret.size() - 2);
+}
+
+std::string statistics::PerfContext::toJson() const {
+  std::ostringstream ss;
+  const char *sep = "{";
+#define X(field)                                                               \
+  ss << sep << "\"" #field "\":" << this->field;                               \
+  sep = ",";
+  PERF_FIELDS(X)
+#undef X
+  ss << "}";
+  return ss.str();
+}
@@ -0,0 +1,99 @@
+// Testing that memtable values live in the arena unless they are short
+// enough to be kept inline: size accounting across overwrites and
+// tombstones on every backend, in-place reuse of shorter values, and the
+// flush a store takes when overwrites bloat the arena.
+
+#include <kvstore.h>
+
+#include <iostream>
+
+int main(){
+    int failed = 0;
+
+    {
+        memory::Arena arena;
+        char *a = arena.allocate(10);
+        char *b = arena.allocate(10);
+        if(b != a + 10 || arena.memoryUsage() != 4096)
+            failed++;
+        arena.allocate(8192);
+        if(arena.memoryUsage() != 4096 + 8192 || arena.allocate(10) != b + 10)
+            failed++;
+        arena.reset();
+        if(arena.memoryUsage() != 0)
+            failed++;
+    }
+
+    {
+        static_assert(sizeof(memory::InlineSlice) == 16, "an inline slice takes 16 bytes");
+        std::string longer(100, 'x');
+        memory::InlineSlice small(std::string("fifteen bytes!!")), large(longer), empty;
+        if(!small.isInline() || small.toString() != "fifteen bytes!!" ||
+           large.isInline() || large.data() != longer.data() || large.size() != 100 ||
+           !empty.isInline() || empty.size() != 0)
+            failed++;
+    }
+
+    const memtable::MemTable_Backend_Type backends[] = {
+        memtable::MEMTABLE_USE_AVLTREE, memtable::MEMTABLE_USE_RBTREE,
+        memtable::MEMTABLE_USE_SKIPLIST, memtable::MEMTABLE_USE_BPTREE,
+        memtable::MEMTABLE_USE_HASH_SKIPLIST};
+    for(auto backend : backends){
+        auto table = memtable::make<uint64_t>(backend);
+        const size_t entry = sizeof(uint64_t) + sizeof(size_t);
+        table->insert(1, "abcdef");
+        if(table->size() != entry + 6)
+            failed++;
+        // A tombstone is a flag on disk, so it costs only the key.
+        table->remove(1);
+        if(table->size() != entry || table->search(1) != memtable_generic::deleted)
+            failed++;
+        table->insert(1, "abcd");
+        if(table->size() != entry + 4 || table->search(1) != "abcd")
+            failed++;
+        // Short values stay in their entries.
+        if(table->allocated() != 0)
+            failed++;
+
+        // Values no longer than the old one are written over its bytes.
+        table->insert(2, std::string(100, 'x'));
+        size_t allocated = table->allocated();
+        for(int i = 0; i < 1000; i++)
+            table->insert(2, std::string(100, 'a' + i % 26));
+        table->insert(2, "short");
+        if(table->allocated() != allocated || table->search(2) != "short" ||
+           table->size() != 2 * entry + 4 + 5)
+            failed++;
+
+        auto cursor = table->cursor();
+        if(!cursor->valid() || cursor->entry().first != 1 || cursor->entry().second != "abcd")
+            failed++;
+        table->reset();
+        if(table->allocated() != 0 || table->size() != 0 || table->cursor()->valid())
+            failed++;
+    }
+
+    {
+        kvstore::Options options;
+        options.write_buffer_size = 64 * 1024;
+        kvstore::KVStore store("/tmp/lsm_arena", options);
+        store.reset();
+        // Ever longer values for one key leave the older copies behind.
+        std::string value;
+        for(int i = 0; i < 4000; i++){
+            value = std::string(1 + i % 1000, 'a' + i % 26);
+            store.put(42, value);
+        }
+        if(store.get_property("minilsm.flush-bytes") == "0" || store.get(42) != value)
+            failed++;
+        if(std::stoull(store.get_property("minilsm.cur-size-active-mem-table")) > options.write_buffer_size)
+            failed++;
+    }
+
+    if(failed != 0){
+        std::cout << failed << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,120 @@
+// Testing the B+-tree memtable against std::map and the red-black tree:
+// lookups, overwrites, tombstones, size accounting, cursors and scans, for
+// integer and byte-string keys.
+
+#include <memtable/memtable.h>
+
+#include <iostream>
+#include <map>
+#include <random>
+
+template <typename Key>
+static int check(memtable::BPlusTree<Key> &tree, memtable::RBTree<Key> &reference,
+                 const std::map<Key, std::string> &expected){
+    int failed = 0;
+    if(tree.size() != reference.size())
+        failed++;
+
+    auto it = expected.begin();
+    for(auto cursor = tree.cursor(); cursor->valid(); cursor->next(), it++){
+        if(it == expected.end() || cursor->entry().first != it->first ||
+           cursor->entry().second != it->second){
+            failed++;
+            break;
+        }
+    }
+    if(it != expected.end())
+        failed++;
+
+    for(const auto &kv : expected){
+        if(tree.search(kv.first) != kv.second)
+            failed++;
+    }
+    return failed;
+}
+
+int main(){
+    int failed = 0;
+    std::mt19937_64 gen(42);
+
+    {
+        memtable::BPlusTree<uint64_t> tree;
+        memtable::RBTree<uint64_t> reference;
+        std::map<uint64_t, std::string> expected;
+        if(tree.cursor()->valid() || tree.search(1) != "")
+            failed++;
+
+        for(int i = 0; i < 20000; i++){
+            uint64_t key = gen() % 5000;
+            if(i % 7 == 0){
+                tree.remove(key);
+                reference.remove(key);
+                expected[key] = memtable_generic::deleted;
+            } else{
+                auto value = std::to_string(gen() % 1000000);
+                tree.insert(key, value);
+                reference.insert(key, value);
+                expected[key] = value;
+            }
+        }
+        // The largest key is also what pads the integer nodes.
+        tree.insert(UINT64_MAX, "max");
+        reference.insert(UINT64_MAX, "max");
+        expected[UINT64_MAX] = "max";
+        failed += check(tree, reference, expected);
+        if(tree.search(5001) != "")
+            failed++;
+
+        std::vector<std::pair<uint64_t, std::string>> scanned, wanted;
+        tree.scan(1000, 2000, scanned);
+        for(auto it = expected.lower_bound(1000); it != expected.upper_bound(2000); it++)
+            wanted.push_back(*it);
+        if(scanned != wanted)
+            failed++;
+
+        auto dumped = tree.dump();
+        if(dumped.size() != expected.size() || tree.size() != 0 || tree.cursor()->valid())
+            failed++;
+    }
+
+    {
+        // Descending inserts split on the left edge of every node.
+        memtable::BPlusTree<uint64_t> tree;
+        memtable::RBTree<uint64_t> reference;
+        std::map<uint64_t, std::string> expected;
+        for(uint64_t i = 10000; i > 0; i--){
+            tree.insert(i, std::to_string(i));
+            reference.insert(i, std::to_string(i));
+            expected[i] = std::to_string(i);
+        }
+        failed += check(tree, reference, expected);
+    }
+
+    {
+        memtable::BPlusTree<std::string> tree;
+        memtable::RBTree<std::string> reference;
+        std::map<std::string, std::string> expected;
+        for(int i = 0; i < 10000; i++){
+            auto key = "key" + std::to_string(gen() % 3000);
+            auto value = std::string(gen() % 50, 'v');
+            tree.insert(key, value);
+            reference.insert(key, value);
+            expected[key] = value;
+        }
+        failed += check(tree, reference, expected);
+
+        std::vector<std::pair<std::string, std::string>> scanned, wanted;
+        tree.scan("key1", "key2", scanned);
+        for(auto it = expected.lower_bound("key1"); it != expected.upper_bound("key2"); it++)
+            wanted.push_back(*it);
+        if(scanned != wanted)
+            failed++;
+    }
+
+    if(failed != 0){
+        std::cout << failed << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "passed" << std::endl;
+    return 0;
+}
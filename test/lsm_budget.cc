@@ -0,0 +1,104 @@
+// Testing the value cache and the memory budget: repeated reads are served
+// from the cache, the cache stays within its capacity and the budget, and
+// stores sharing a budget flush early to stay under it.
+
+#include <kvstore.h>
+
+#include <fstream>
+#include <iostream>
+
+static std::string write(const std::string &name, const std::string &text){
+    std::ofstream ofile(name);
+    ofile << text;
+    return name;
+}
+
+static uint64_t property(kvstore::KVStore &store, const std::string &name){
+    return std::stoull(store.get_property("minilsm." + name));
+}
+
+int main(){
+    const std::string dir = "/tmp/lsm_budget";
+    int failed = 0;
+
+    {
+        auto conf = write(dir + ".conf", "0 100 Tiering\n1 200 Leveling\n"
+                                         "block_cache_size 65536\n");
+        kvstore::KVStore store(dir, conf);
+        store.reset();
+        for(uint64_t i = 0; i < 2000; i++)
+            store.put(i, std::string(100, 'a' + i % 26));
+        store.flush();
+
+        auto stats = store.get_statistics();
+        for(int round = 0; round < 2; round++){
+            for(uint64_t i = 0; i < 100; i++){
+                if(store.get(i) != std::string(100, 'a' + i % 26))
+                    failed++;
+            }
+        }
+        if(stats->get(statistics::BLOCK_CACHE_HIT) != 100 ||
+           stats->get(statistics::BLOCK_CACHE_MISS) != 100)
+            failed++;
+
+        // Reading everything overflows the cache, which evicts to fit.
+        for(uint64_t i = 0; i < 2000; i++){
+            if(store.get(i) != std::string(100, 'a' + i % 26))
+                failed++;
+        }
+        if(property(store, "block-cache-usage") > 65536 ||
+           property(store, "block-cache-usage") == 0 ||
+           property(store, "block-cache-capacity") != 65536)
+            failed++;
+
+        // Every block's filter and index is charged to the budget.
+        uint64_t meta = property(store, "estimate-table-readers-mem");
+        if(meta < sstable::BLOOMFILTER_SIZE ||
+           property(store, "memory-budget-usage") !=
+               meta + property(store, "block-cache-usage"))
+            failed++;
+        std::cout << "cache " << store.get_property("minilsm.block-cache-usage")
+                  << " table readers " << meta << std::endl;
+    }
+
+    {
+        // Two stores under one limit that both memtables would exceed.
+        auto conf = write(dir + ".conf", "0 100 Tiering\n1 200 Leveling\n");
+        auto budget = std::make_shared<memory::MemoryBudget>(512 * 1024);
+        kvstore::KVStore one(dir + "-one", conf), two(dir + "-two", conf);
+        one.reset();
+        two.reset();
+        one.set_memory_budget(budget);
+        two.set_memory_budget(budget);
+        if(one.get_memory_budget() != budget)
+            failed++;
+
+        uint64_t peak = 0;
+        for(uint64_t i = 0; i < 3000; i++){
+            one.put(i, std::string(200, 'o'));
+            two.put(i, std::string(200, 't'));
+            peak = std::max(peak, budget->usage(memory::MEMTABLE));
+        }
+        uint64_t flushes =
+            one.get_statistics()->get(statistics::MEMORY_BUDGET_FLUSHES) +
+            two.get_statistics()->get(statistics::MEMORY_BUDGET_FLUSHES);
+        if(flushes == 0 || peak > 512 * 1024)
+            failed++;
+        for(uint64_t i = 0; i < 3000; i += 7){
+            if(one.get(i) != std::string(200, 'o') || two.get(i) != std::string(200, 't'))
+                failed++;
+        }
+        if(budget->usage(memory::MEMTABLE) !=
+           property(one, "cur-size-active-mem-table") +
+               property(two, "cur-size-active-mem-table"))
+            failed++;
+        std::cout << "budget flushes " << flushes << " memtable peak " << peak << std::endl;
+    }
+
+    if(failed != 0){
+        std::cout << failed << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,114 @@
+// Testing checkpoints: the copy is made of hard links, opens as a store of
+// its own with the state at the time of the checkpoint, memtable and value
+// log included, and neither store sees what the other does afterwards.
+
+#include <kvstore.h>
+
+#include <sys/stat.h>
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+
+static std::string value_of(uint64_t i, uint64_t round){
+    // Every third value is big enough for the value log.
+    return std::to_string(round) + std::string(i % 3 == 0 ? 300 : 40, 'a' + i % 26);
+}
+
+static int compare(kvstore::KVStore &store, const std::map<uint64_t, std::string> &expected, uint64_t keys){
+    int failed = 0;
+    for(uint64_t i = 0; i < keys; i++){
+        auto it = expected.find(i);
+        if(store.get(i) != (it == expected.end() ? "" : it->second))
+            failed++;
+    }
+    return failed;
+}
+
+int main(){
+    const std::string dir = "/tmp/lsm_checkpoint", copy = dir + "_copy";
+    const uint64_t keys = 4000;
+    int failed = 0;
+    std::system(("rm -rf " + copy).c_str());
+
+    kvstore::Options options;
+    options.levels = {{sstable::TIERING, 2}, {sstable::LEVELING, 4}, {sstable::LEVELING, 100}};
+    options.write_buffer_size = 16 * 1024;
+    options.vlog_threshold = 200;
+    kvstore::KVStore store(dir, options);
+    store.reset();
+
+    std::map<uint64_t, std::string> expected;
+    for(uint64_t i = 0; i < keys; i++){
+        uint64_t key = i * 7919 % keys;
+        expected[key] = value_of(key, 0);
+        store.put(key, expected[key]);
+    }
+    // Some changes are still in the memtable when the checkpoint is taken.
+    for(uint64_t i = 0; i < keys; i += 10){
+        store.del(i);
+        expected.erase(i);
+    }
+    if(!store.checkpoint(copy))
+        failed++;
+    if(store.checkpoint(copy) || store.get_property("minilsm.num-immutable-mem-table") != "0")
+        failed++;
+
+    // Every file in the manifest is there, at its size, sharing its data
+    // with the store.
+    std::ifstream manifest(copy + "/MANIFEST");
+    std::string name;
+    uint64_t size, files = 0, vlogs = 0;
+    while(manifest >> name >> size){
+        struct stat st;
+        if(stat((copy + "/" + name).c_str(), &st) != 0 || (uint64_t)st.st_size != size || st.st_nlink < 2)
+            failed++;
+        files++;
+        vlogs += name.compare(0, 5, "vlog/") == 0;
+    }
+    if(files == 0 || vlogs == 0){
+        std::cerr << files << " files, " << vlogs << " in the value log" << std::endl;
+        failed++;
+    }
+
+    // The store moves on: everything rewritten, compacted and collected.
+    for(uint64_t i = 0; i < keys; i++)
+        store.put(i, value_of(i, 1));
+    store.flush();
+    for(uint64_t i = 0; i < keys; i++){
+        if(store.get(i) != value_of(i, 1))
+            failed++;
+    }
+
+    {
+        kvstore::KVStore restored(copy, copy + "/CONF");
+        if(restored.get_property("minilsm.num-levels") != "3")
+            failed++;
+        failed += compare(restored, expected, keys);
+        std::list<std::pair<uint64_t, std::string>> list;
+        restored.scan(0, keys, list);
+        if(list.size() != expected.size())
+            failed++;
+        // Writes to the copy stay there.
+        for(uint64_t i = 0; i < keys; i += 2)
+            restored.del(i);
+        restored.flush();
+        for(uint64_t i = 0; i < keys; i += 2){
+            if(!restored.get(i).empty() || store.get(i) != value_of(i, 1))
+                failed++;
+        }
+    }
+
+    // Reopened, it still holds what the checkpoint did, less its own deletes.
+    {
+        kvstore::KVStore restored(copy, copy + "/CONF");
+        for(uint64_t i = 0; i < keys; i += 2)
+            expected.erase(i);
+        failed += compare(restored, expected, keys);
+    }
+
+    if(failed)
+        std::cerr << failed << " checks failed" << std::endl;
+    return failed != 0;
+}
@@ -0,0 +1,123 @@
+// Testing the compaction picker: levels are scored against their limits
+// and compacted until none is over, blocks that lookups keep missing in
+// are merged into the level below, and both also happen on a background
+// thread.
+
+#include <kvstore.h>
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+static double score(kvstore::KVStore &store, size_t level){
+    return std::stod(store.get_property("minilsm.compaction-score-at-level" + std::to_string(level)));
+}
+
+static size_t files(kvstore::KVStore &store, size_t level){
+    return std::stoul(store.get_property("minilsm.num-files-at-level" + std::to_string(level)));
+}
+
+// Even keys only, so odd ones inside a block's range are misses.
+static void fill(kvstore::KVStore &store, uint64_t keys){
+    for(uint64_t i = 0; i < keys; i++)
+        store.put(i * 7919 % keys * 2, std::string(100, 'a' + i % 26));
+}
+
+static int check(kvstore::KVStore &store, uint64_t keys){
+    int failed = 0;
+    for(uint64_t i = 0; i < keys; i += 7){
+        if(store.get(i * 2).size() != 100 || !store.get(i * 2 + 1).empty())
+            failed++;
+    }
+    return failed;
+}
+
+template <typename Pred>
+static bool wait_for(Pred pred){
+    for(int i = 0; i < 500 && !pred(); i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    return pred();
+}
+
+int main(){
+    const uint64_t keys = 6000;
+    int failed = 0;
+
+    kvstore::Options options;
+    options.levels = {{sstable::TIERING, 2}, {sstable::LEVELING, 4}, {sstable::LEVELING, 100}};
+    options.write_buffer_size = 16 * 1024;
+    // Filters that pass nearly everything, so most lookups of odd keys miss.
+    options.bloom_filter_size = 1;
+
+    {
+        kvstore::KVStore store("/tmp/lsm_picker_scores", options);
+        store.reset();
+        fill(store, keys);
+        store.flush();
+        if(score(store, 0) >= 1 || score(store, 1) > 1)
+            failed++;
+        if(score(store, 1) != files(store, 1) / 4.0 || score(store, 2) != 0)
+            failed++;
+        failed += check(store, keys);
+    }
+
+    options.seek_miss_limit = 50;
+    {
+        kvstore::KVStore store("/tmp/lsm_picker_seek", options);
+        store.reset();
+        fill(store, keys);
+        store.flush();
+        // Empty level 0 with keys past the others, so the flush below
+        // compacts nothing of its own.
+        for(uint64_t far = 1000000; files(store, 0) != 0; far++){
+            store.put(far, "x");
+            store.flush();
+        }
+        auto stats = store.get_statistics();
+        size_t before = files(store, 1);
+        if(before == 0)
+            failed++;
+        for(int round = 0; round < 100; round++){
+            for(uint64_t i = 0; i < keys; i += 31)
+                store.get(i * 2 + 1);
+        }
+        // Seek misses are acted on by the next flush.
+        if(stats->get(statistics::COMPACTION_SEEK_TRIGGERED) != 0)
+            failed++;
+        store.put(2000000, "x");
+        store.flush();
+        if(stats->get(statistics::COMPACTION_SEEK_TRIGGERED) == 0 || files(store, 1) >= before){
+            std::cerr << "no seek compaction" << std::endl;
+            failed++;
+        }
+        failed += check(store, keys);
+    }
+
+    options.background_compaction = true;
+    {
+        kvstore::KVStore store("/tmp/lsm_picker_background", options);
+        store.reset();
+        fill(store, keys);
+        store.flush();
+        // A leveled level is done at its limit, a tiered one before it.
+        if(!wait_for([&]{ return score(store, 0) < 1 && score(store, 1) <= 1; })){
+            std::cerr << "background compaction did not catch up" << std::endl;
+            failed++;
+        }
+        failed += check(store, keys);
+
+        // Lookups alone wake the compactor.
+        auto stats = store.get_statistics();
+        for(int round = 0; round < 100; round++){
+            for(uint64_t i = 0; i < keys; i += 31)
+                store.get(i * 2 + 1);
+        }
+        if(!wait_for([&]{ return stats->get(statistics::COMPACTION_SEEK_TRIGGERED) != 0; }))
+            failed++;
+        failed += check(store, keys);
+    }
+
+    if(failed)
+        std::cerr << failed << " checks failed" << std::endl;
+    return failed != 0;
+}
@@ -0,0 +1,91 @@
+// Testing dynamic level sizing: leveled levels take limits a fanout apart,
+// worked up from the last level, levels are added below it as it grows,
+// and the added levels and their data survive a reopen.
+
+#include <kvstore.h>
+
+#include <iostream>
+
+static size_t level_prop(kvstore::KVStore &store, const std::string &what, size_t level){
+    return std::stoul(store.get_property("minilsm." + what + "-at-level" + std::to_string(level)));
+}
+
+int main(){
+    const std::string dir = "/tmp/lsm_dynamic_levels";
+    const size_t fanout = 3;
+    const uint64_t keys = 30000;
+    int failed = 0;
+
+    kvstore::Options options;
+    options.levels = {{sstable::TIERING, 2}, {sstable::LEVELING, 2}, {sstable::LEVELING, 4}};
+    options.write_buffer_size = 16 * 1024;
+    options.dynamic_levels = true;
+    options.level_fanout = fanout;
+    {
+        kvstore::KVStore store(dir, options);
+        store.reset();
+        if(store.get_property("minilsm.num-levels") != "3" || level_prop(store, "limit", 2) != 2 * fanout * fanout)
+            failed++;
+
+        // Scattered keys, so compactions rewrite rather than move blocks.
+        for(uint64_t i = 0; i < keys; i++)
+            store.put(i * 7919 % keys, std::string(100, 'a' + i % 26));
+        store.flush();
+
+        size_t levels = std::stoul(store.get_property("minilsm.num-levels"));
+        size_t last = levels - 1;
+        if(levels <= 3){
+            std::cerr << "no level added" << std::endl;
+            failed++;
+        }
+        // The last level is under the size that adds another one.
+        size_t last_limit = 2;
+        for(size_t i = 0; i < last; i++)
+            last_limit *= fanout;
+        if(level_prop(store, "limit", last) != last_limit ||
+           level_prop(store, "num-files", last) >= last_limit)
+            failed++;
+        // Each level above is sized from the one below, not from the conf.
+        // Limits are set as a compaction starts, from the last level as it
+        // was then.
+        size_t target = level_prop(store, "num-files", last);
+        for(size_t i = last - 1; i >= 1; i--){
+            target = (target + fanout - 1) / fanout;
+            size_t limit = level_prop(store, "limit", i);
+            if(limit > std::max<size_t>(2, target) || limit < std::max<size_t>(2, target / fanout) ||
+               level_prop(store, "num-files", i) > limit ||
+               store.get_property("minilsm.policy-at-level" + std::to_string(i)) != "Leveling")
+                failed++;
+        }
+        for(uint64_t i = 0; i < keys; i += 97){
+            if(store.get(i).size() != 100)
+                failed++;
+        }
+    }
+
+    {
+        kvstore::KVStore store(dir, options);
+        if(std::stoul(store.get_property("minilsm.num-levels")) <= 3)
+            failed++;
+        for(uint64_t i = 0; i < keys; i += 97){
+            if(store.get(i).size() != 100)
+                failed++;
+        }
+    }
+
+    {
+        // Without dynamic sizing the conf's levels are all there is.
+        options.dynamic_levels = false;
+        kvstore::KVStore store(dir + "_static", options);
+        store.reset();
+        for(uint64_t i = 0; i < keys; i++)
+            store.put(i * 7919 % keys, std::string(100, 'a' + i % 26));
+        store.flush();
+        if(store.get_property("minilsm.num-levels") != "3" || level_prop(store, "limit", 1) != 2)
+            failed++;
+    }
+
+    if(failed)
+        std::cerr << failed << " checks failed" << std::endl;
+    return failed != 0;
+}
@@ -0,0 +1,87 @@
+// Testing the flush pool: a store whose full memtables queue behind the
+// active one for several flusher threads reads the same as one flushing
+// inline, while blocks are in flight and after, and keeps the newest
+// version of keys overwritten across many memtables.
+
+#include <kvstore.h>
+
+#include <iostream>
+
+static std::string value_of(uint64_t i, uint64_t round){
+    return std::to_string(i) + "-" + std::to_string(round) + std::string(200 + i % 300, 'v');
+}
+
+int main(){
+    int failed = 0;
+
+    kvstore::Options options;
+    options.write_buffer_size = 64 * 1024;
+    kvstore::KVStore inline_store("/tmp/lsm_flushpool_inline", options);
+    options.max_immutable_memtables = 4;
+    options.flush_threads = 3;
+    // Memtables sealed early by the budget are small enough to merge.
+    options.memory_limit = 512 * 1024;
+    kvstore::KVStore pool("/tmp/lsm_flushpool", options);
+    inline_store.reset();
+    pool.reset();
+    for(auto store : {&inline_store, &pool})
+        store->set_merge_operator(std::make_shared<merge::UInt64AddOperator>());
+
+    const uint64_t keys = 2000;
+    for(uint64_t round = 0; round < 8; round++){
+        for(uint64_t i = 0; i < keys; i++){
+            uint64_t key = (i * 7919 + round * 13) % keys;
+            for(auto store : {&inline_store, &pool}){
+                if(key % 11 == 0)
+                    store->del(key);
+                else if(key % 5 == 0)
+                    store->merge(key + keys, "1");
+                else
+                    store->put(key, value_of(key, round));
+            }
+            // Reads see memtables still waiting for a flusher.
+            if(i % 97 == 0 && pool.get(key) != inline_store.get(key))
+                failed++;
+        }
+    }
+    if(pool.get_property("minilsm.flush-bytes") == "0")
+        failed++;
+
+    pool.flush();
+    inline_store.flush();
+    if(pool.get_property("minilsm.num-immutable-mem-table") != "0" ||
+       pool.get_property("minilsm.cur-size-all-mem-tables") != "0")
+        failed++;
+
+    std::list<std::pair<uint64_t, std::string>> expected, got;
+    inline_store.scan(0, 2 * keys, expected);
+    pool.scan(0, 2 * keys, got);
+    if(expected != got || expected.empty()){
+        std::cerr << "scan: " << got.size() << " entries, expected " << expected.size() << std::endl;
+        failed++;
+    }
+    for(uint64_t i = 0; i < 2 * keys; i++){
+        if(pool.get(i) != inline_store.get(i))
+            failed++;
+    }
+
+    // The last of many overwrites wins, whichever flusher wrote it.
+    for(uint64_t round = 0; round < 50; round++){
+        for(uint64_t i = 0; i < 400; i++)
+            pool.put(i, value_of(i, 100 + round));
+    }
+    for(uint64_t i = 0; i < 400; i++){
+        if(pool.get(i) != value_of(i, 149))
+            failed++;
+    }
+    pool.flush();
+    for(uint64_t i = 0; i < 400; i++){
+        kvstore::PinnableSlice value;
+        if(!pool.get_pinned(i, value) || value != value_of(i, 149))
+            failed++;
+    }
+
+    if(failed)
+        std::cerr << failed << " checks failed" << std::endl;
+    return failed != 0;
+}
@@ -0,0 +1,101 @@
+// Testing the hashed skip list against std::map: lookups through the
+// index, overwrites, tombstones, size accounting, ordered cursors and
+// scans, and that dump and reset clear the index.
+
+#include <memtable/memtable.h>
+
+#include <iostream>
+#include <map>
+#include <random>
+
+template <typename Key>
+static int check(memtable::HashSkipList<Key> &list, memtable::RBTree<Key> &reference,
+                 const std::map<Key, std::string> &expected){
+    int failed = 0;
+    if(list.size() != reference.size())
+        failed++;
+
+    auto it = expected.begin();
+    for(auto cursor = list.cursor(); cursor->valid(); cursor->next(), it++){
+        if(it == expected.end() || cursor->entry().first != it->first ||
+           cursor->entry().second != it->second){
+            failed++;
+            break;
+        }
+    }
+    if(it != expected.end())
+        failed++;
+
+    for(const auto &kv : expected){
+        if(list.search(kv.first) != kv.second)
+            failed++;
+    }
+    return failed;
+}
+
+int main(){
+    int failed = 0;
+    std::mt19937_64 gen(42);
+
+    {
+        memtable::HashSkipList<uint64_t> list;
+        memtable::RBTree<uint64_t> reference;
+        std::map<uint64_t, std::string> expected;
+        for(int i = 0; i < 20000; i++){
+            uint64_t key = gen() % 5000;
+            if(i % 7 == 0){
+                list.remove(key);
+                reference.remove(key);
+                expected[key] = memtable_generic::deleted;
+            } else{
+                auto value = std::to_string(gen() % 1000000);
+                list.insert(key, value);
+                reference.insert(key, value);
+                expected[key] = value;
+            }
+        }
+        failed += check(list, reference, expected);
+        if(list.search(5001) != "")
+            failed++;
+
+        std::vector<std::pair<uint64_t, std::string>> scanned, wanted;
+        list.scan(1000, 2000, scanned);
+        for(auto it = expected.lower_bound(1000); it != expected.upper_bound(2000); it++)
+            wanted.push_back(*it);
+        if(scanned != wanted)
+            failed++;
+
+        // The index must not outlive the nodes it points at.
+        auto dumped = list.dump();
+        if(dumped.size() != expected.size() || list.size() != 0 ||
+           list.cursor()->valid() || list.search(dumped[0].first) != "")
+            failed++;
+        list.insert(dumped[0].first, "again");
+        if(list.search(dumped[0].first) != "again")
+            failed++;
+        list.reset();
+        if(list.search(dumped[0].first) != "" || list.size() != 0)
+            failed++;
+    }
+
+    {
+        memtable::HashSkipList<std::string> list;
+        memtable::RBTree<std::string> reference;
+        std::map<std::string, std::string> expected;
+        for(int i = 0; i < 10000; i++){
+            auto key = "key" + std::to_string(gen() % 3000);
+            auto value = std::string(gen() % 50, 'v');
+            list.insert(key, value);
+            reference.insert(key, value);
+            expected[key] = value;
+        }
+        failed += check(list, reference, expected);
+    }
+
+    if(failed != 0){
+        std::cout << failed << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,118 @@
+// Testing whether block files written by SSTableWriter are ingested on the
+// right level, read as newer than what the store held, and survive reopen.
+
+#include <kvstore.h>
+#include <sstable/writer.h>
+
+#include <fstream>
+#include <iostream>
+#include <map>
+
+static std::string write(const std::string &name, const std::string &text){
+    std::ofstream ofile(name);
+    ofile << text;
+    return name;
+}
+
+static uint64_t property(kvstore::KVStore &store, const std::string &name){
+    return std::stoull(store.get_property("minilsm." + name));
+}
+
+int main(){
+    const std::string dir = "/tmp/lsm_ingest";
+    auto conf = write(dir + ".conf", "0 4 Tiering\n1 8 Leveling\n2 100 Leveling\n");
+    std::map<uint64_t, std::string> expected;
+    int failed = 0;
+
+    auto check = [&expected](kvstore::KVStore &store){
+        int failed = 0;
+        for(const auto &kv : expected){
+            if(store.get(kv.first) != kv.second)
+                failed++;
+        }
+        return failed;
+    };
+
+    {
+        kvstore::KVStore store(dir, conf);
+        store.reset();
+        for(uint64_t i = 0; i < 1000; i++){
+            expected[i] = std::string(100, 'a');
+            store.put(i, expected[i]);
+        }
+        store.flush();
+
+        // Keys must ascend, and an empty writer writes nothing.
+        {
+            sstable::SSTableWriter<uint64_t> writer(dir + "-empty.sst");
+            if(!writer.put(5, "x") || writer.put(5, "y") || writer.put(4, "y"))
+                failed++;
+            sstable::SSTableWriter<uint64_t> empty(dir + "-nothing.sst");
+            if(empty.finish())
+                failed++;
+        }
+
+        // Nothing holds these keys, so the file goes to the last level.
+        {
+            sstable::SSTableWriter<uint64_t> writer(dir + "-far.sst");
+            for(uint64_t i = 100000; i < 101000; i++){
+                expected[i] = std::string(100, 'f');
+                writer.put(i, expected[i]);
+            }
+            if(!writer.finish() || !store.ingest_files({dir + "-far.sst"}))
+                failed++;
+        }
+        if(property(store, "num-files-at-level2") != 1 ||
+           property(store, "compact-write-bytes") != 0)
+            failed++;
+
+        // These overlap level 0 and replace what is there.
+        {
+            sstable::SSTableWriter<uint64_t> writer(dir + "-near.sst");
+            for(uint64_t i = 500; i < 600; i++){
+                expected[i] = std::string(100, 'n');
+                writer.put(i, expected[i]);
+            }
+            writer.del(600);
+            expected[600] = "";
+            if(!writer.finish() || !store.ingest_files({dir + "-near.sst"}))
+                failed++;
+        }
+        if(property(store, "num-files-at-level0") != 2)
+            failed++;
+        failed += check(store);
+
+        // Files overlapping each other, and files that are not blocks,
+        // are refused and left where they are.
+        {
+            sstable::SSTableWriter<uint64_t> one(dir + "-one.sst"), two(dir + "-two.sst");
+            one.put(200000, "1");
+            one.put(200010, "1");
+            two.put(200005, "2");
+            one.finish();
+            two.finish();
+            if(store.ingest_files({dir + "-one.sst", dir + "-two.sst"}))
+                failed++;
+            write(dir + "-junk.sst", "not a block");
+            if(store.ingest_files({dir + "-junk.sst"}) ||
+               store.ingest_files({dir + "-missing.sst"}))
+                failed++;
+            std::ifstream left(dir + "-one.sst");
+            if(!left || store.get(200000) != "")
+                failed++;
+        }
+        std::cout << store.get_property("minilsm.levelstats");
+    }
+
+    {
+        kvstore::KVStore store(dir, conf);
+        failed += check(store);
+    }
+
+    if(failed != 0){
+        std::cout << failed << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,116 @@
+// Testing whether merge operands fold into the right value from the
+// memtable, from blocks, across compactions and after reopening.
+
+#include <kvstore.h>
+
+#include <fstream>
+#include <iostream>
+
+int main(){
+    std::string conf = "/tmp/lsm_merge.conf";
+    std::ofstream ofile(conf);
+    ofile << "0 2 Tiering\n1 100 Leveling\n";
+    ofile.close();
+
+    auto add = std::make_shared<merge::UInt64AddOperator>();
+    int failed = 0;
+    {
+        kvstore::KVStore store("/tmp/lsm_merge", conf);
+        store.reset();
+        if(store.merge(1, "5"))
+            failed++;
+        store.set_merge_operator(add);
+        auto stats = store.get_statistics();
+
+        // Operands with no value anywhere.
+        for(int i = 0; i < 3; i++)
+            store.merge(1, "5");
+        // A value in the memtable takes the operand right away.
+        store.put(2, "10");
+        store.merge(2, "5");
+        if(store.get(1) != "15" || store.get(2) != "15")
+            failed++;
+
+        // Operands in the memtable over a value in a block.
+        store.put(3, "100");
+        store.put(5, "7");
+        store.flush();
+        for(int i = 0; i < 10; i++)
+            store.merge(3, "1");
+        store.del(5);
+        store.merge(5, "3");
+        if(store.get(3) != "110" || store.get(5) != "3")
+            failed++;
+
+        // Operands in a block over a value in an older block.
+        store.put(6, "1000");
+        store.flush();
+        store.merge(6, "1");
+        store.merge(6, "2");
+        store.flush();
+        if(store.get_property("minilsm.num-files-at-level0") != "1" || store.get(6) != "1003")
+            failed++;
+        auto values = store.multi_get({1, 3, 6, 7});
+        if(values[0] != "15" || values[1] != "110" || values[2] != "1003" || values[3] != "")
+            failed++;
+
+        // Many updates through flushes and compactions.
+        for(uint64_t round = 0; round < 50; round++){
+            for(uint64_t key = 100; key < 200; key++)
+                store.merge(key, std::to_string(key));
+            if(round % 10 == 9)
+                store.flush();
+        }
+        for(uint64_t key = 100; key < 200; key += 7){
+            if(store.get(key) != std::to_string(50 * key))
+                failed++;
+        }
+        std::list<std::pair<uint64_t, std::string>> list;
+        store.scan(1, 6, list);
+        if(list.size() != 5 || list.back().second != "1003")
+            failed++;
+        if(stats->get(statistics::NUMBER_MERGES) != 5017 ||
+           stats->get(statistics::MERGE_OPERANDS_FOLDED) == 0)
+            failed++;
+        store.flush();
+    }
+
+    {
+        kvstore::KVStore store("/tmp/lsm_merge", conf);
+        store.set_merge_operator(add);
+        store.merge(150, "1");
+        store.flush();
+        if(store.get(150) != "7501" || store.get(3) != "110" || store.get(1) != "15")
+            failed++;
+    }
+
+    {
+        kvstore::StringKVStore store("/tmp/lsm_merge_strings", conf);
+        store.reset();
+        store.set_merge_operator(std::make_shared<merge::StringAppendOperator>(","));
+        store.put("list", "a");
+        store.flush();
+        store.merge("list", "b");
+        store.flush();
+        store.merge("list", "c");
+        if(store.get("list") != "a,b,c")
+            failed++;
+
+        // A value that looks like operands is still just a value, in the
+        // memtable and on disk, and operands apply to it as to any other.
+        const std::string lookalike = "~MERGE~hello";
+        store.put("plain", lookalike);
+        if(store.get("plain") != lookalike)
+            failed++;
+        store.flush();
+        if(store.get("plain") != lookalike)
+            failed++;
+        store.merge("plain", "x");
+        store.flush();
+        if(store.get("plain") != lookalike + ",x")
+            failed++;
+    }
+
+    std::cout << (failed == 0 ? "passed" : "failed") << std::endl;
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,79 @@
+// Testing whether multi_get agrees with get on every I/O backend, with
+// and without direct I/O, and that direct writes leave reads buffered
+// unless direct reads are asked for.
+
+#include <kvstore.h>
+
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <unistd.h>
+
+int check(const std::string &backend, const std::string &direct, const std::string &reads = "off"){
+    std::string conf = "/tmp/lsm_multiget_" + backend + ".conf";
+    std::ofstream ofile(conf);
+    ofile << "0 100 Tiering\n1 200 Leveling\n";
+    ofile << "io_backend " << backend << "\ndirect_io " << direct << "\n";
+    ofile << "direct_reads " << reads << "\n";
+    ofile.close();
+
+    kvstore::KVStore store("/tmp/lsm_multiget", conf);
+    store.reset();
+
+    const uint64_t max = 4096;
+    for(uint64_t i = 0; i < max; i++){
+        store.put(i, std::string(i % 700 + 1, 'a' + i % 26));
+        if(i % 1000 == 999)
+            store.flush();
+    }
+    for(uint64_t i = 0; i < max; i += 3)
+        store.del(i);
+
+    std::vector<uint64_t> keys;
+    for(uint64_t i = 0; i < max + 100; i += 7)
+        keys.push_back(i);
+
+    int failed = 0;
+    auto values = store.multi_get(keys);
+    for(size_t i = 0; i < keys.size(); i++){
+        auto key = keys[i];
+        std::string expected;
+        if(key < max && key % 3 != 0)
+            expected = std::string(key % 700 + 1, 'a' + key % 26);
+        if(values[i] != expected || values[i] != store.get(key))
+            failed++;
+    }
+    store.reset();
+
+    std::cout << backend << " (direct " << direct << ", reads " << reads << "): "
+              << (keys.size() - failed) << "/" << keys.size() << std::endl;
+    return failed;
+}
+
+int main(){
+    int failed = 0;
+    failed += check("sync", "off");
+    failed += check("pread", "off");
+    failed += check("io_uring", "off");
+    failed += check("io_uring", "on");
+    failed += check("pread", "on");
+    failed += check("io_uring", "on", "on");
+    failed += check("pread", "on", "on");
+
+    {
+        const std::string file = "/tmp/lsm_multiget.direct";
+        std::ofstream(file) << std::string(8192, 'x');
+        auto io = sstable::io::make_backend(sstable::io::SYNC, true, 1);
+        int fd = io->open(file);
+        if(fd < 0 || (fcntl(fd, F_GETFL) & O_DIRECT) != 0 || io->read(fd, 4096, 10) != std::string(10, 'x'))
+            failed++;
+        io->close(fd);
+        io->setDirectReads(true);
+        fd = io->open(file);
+        if(fd < 0 || io->read(fd, 4097, 10) != std::string(10, 'x'))
+            failed++;
+        io->close(fd);
+        unlink(file.c_str());
+    }
+    return failed == 0 ? 0 : 1;
+}
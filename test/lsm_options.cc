@@ -0,0 +1,133 @@
+// Testing that Options read from a conf file or built by hand take effect:
+// every memtable backend, the memtable size and the bloom filter size,
+// including blocks reopened under a different filter size, and options
+// written back out to a conf file.
+
+#include <kvstore.h>
+
+#include <fstream>
+#include <iostream>
+#include <map>
+
+static std::string write(const std::string &name, const std::string &text){
+    std::ofstream ofile(name);
+    ofile << text;
+    return name;
+}
+
+static uint64_t property(kvstore::KVStore &store, const std::string &name){
+    return std::stoull(store.get_property("minilsm." + name));
+}
+
+int main(){
+    const std::string dir = "/tmp/lsm_options";
+    int failed = 0;
+
+    {
+        auto conf = write(dir + ".conf", "0 4 Tiering\n1 8 Leveling\n"
+                                         "memtable skiplist\n"
+                                         "write_buffer_size 65536\n"
+                                         "bloom_filter_size 1024\n"
+                                         "io_threads 2\n"
+                                         "compaction_style lazy_leveling\n");
+        auto options = kvstore::Options::fromFile(conf);
+        if(options.memtable != memtable::MEMTABLE_USE_SKIPLIST ||
+           options.write_buffer_size != 65536 || options.bloom_filter_size != 1024 ||
+           options.io_threads != 2 || options.levels.size() != 2 ||
+           options.levels[0].first != sstable::TIERING ||
+           options.levels[1].first != sstable::LEVELING)
+            failed++;
+
+        // Written back out, the same options read in again.
+        options.tombstone_compaction_ratio = 0.3;
+        options.universal.max_size_amplification = 150;
+        options.direct_reads = true;
+        if(!options.toFile(dir + "-written.conf"))
+            failed++;
+        auto written = kvstore::Options::fromFile(dir + "-written.conf");
+        if(written.memtable != options.memtable || written.levels != options.levels ||
+           written.write_buffer_size != options.write_buffer_size ||
+           written.tombstone_compaction_ratio != 0.3 ||
+           written.universal.max_size_amplification != 150 || !written.direct_reads ||
+           written.vlog_gc_ratio != options.vlog_gc_ratio)
+            failed++;
+
+        auto defaults = kvstore::Options::fromFile(dir + "-missing.conf");
+        if(defaults.memtable != memtable::MEMTABLE_USE_RBTREE ||
+           defaults.write_buffer_size != kvstore::MAX_CAPACITY ||
+           defaults.levels.size() != 4)
+            failed++;
+    }
+
+    const memtable::MemTable_Backend_Type backends[] = {
+        memtable::MEMTABLE_USE_AVLTREE, memtable::MEMTABLE_USE_RBTREE,
+        memtable::MEMTABLE_USE_SKIPLIST, memtable::MEMTABLE_USE_BPTREE,
+        memtable::MEMTABLE_USE_HASH_SKIPLIST};
+    for(auto backend : backends){
+        kvstore::Options options;
+        options.levels = {{sstable::TIERING, 4}, {sstable::LEVELING, 100}};
+        options.memtable = backend;
+        options.write_buffer_size = 64 * 1024;
+        options.bloom_filter_size = 2048;
+
+        std::map<uint64_t, std::string> expected;
+        {
+            auto fill = [&](kvstore::KVStore &store){
+                store.reset();
+                for(uint64_t i = 0; i < 10000; i++){
+                    expected[i] = std::string(100, 'a' + (i + backend) % 26);
+                    store.put(i, expected[i]);
+                }
+                for(uint64_t i = 0; i < 10000; i += 3){
+                    store.del(i);
+                    expected[i] = "";
+                }
+                if(property(store, "cur-size-active-mem-table") > options.write_buffer_size)
+                    failed++;
+                store.flush();
+            };
+            kvstore::KVStore store(dir, options);
+            fill(store);
+
+            // Blocks are cut at the memtable size and carry the small filter:
+            // the same data under the default filter costs exactly the
+            // difference per block.
+            uint64_t files = property(store, "total-files");
+            kvstore::Options defaults = options;
+            defaults.bloom_filter_size = sstable::BLOOMFILTER_SIZE;
+            kvstore::KVStore other(dir + "-default", defaults);
+            other.reset();
+            fill(other);
+            if(files < 10 || property(other, "total-files") != files ||
+               property(other, "estimate-table-readers-mem") -
+                       property(store, "estimate-table-readers-mem") !=
+                   files * (sstable::BLOOMFILTER_SIZE - 2048))
+                failed++;
+            for(const auto &kv : expected){
+                if(store.get(kv.first) != kv.second)
+                    failed++;
+            }
+            std::list<std::pair<uint64_t, std::string>> scanned;
+            store.scan(100, 199, scanned);
+            if(scanned.size() != 67)
+                failed++;
+        }
+
+        // Reopened with the default filter size, old blocks keep theirs.
+        options.bloom_filter_size = sstable::BLOOMFILTER_SIZE;
+        kvstore::KVStore store(dir, options);
+        for(const auto &kv : expected){
+            if(store.get(kv.first) != kv.second)
+                failed++;
+        }
+        std::cout << "backend " << backend << " files "
+                  << store.get_property("minilsm.total-files") << std::endl;
+    }
+
+    if(failed != 0){
+        std::cout << failed << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "passed" << std::endl;
+    return 0;
+}
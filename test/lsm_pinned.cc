@@ -0,0 +1,138 @@
+// Testing get_pinned: values viewed in the memtable and the value cache
+// match get(), stay intact across overwrites, flushes, cache eviction and
+// a reset that drops the cache while pinned, and values rebuilt on read
+// (TTL, merge) come back too.
+
+#include <kvstore.h>
+
+#include <chrono>
+#include <iostream>
+
+static std::string value_of(uint64_t i, size_t size){
+    return std::string(size, 'a' + i % 26);
+}
+
+int main(){
+    const std::string dir = "/tmp/lsm_pinned";
+    const size_t size = 16 * 1024;
+    int failed = 0;
+
+    kvstore::Options options;
+    options.block_cache_size = 1024 * 1024;
+    kvstore::KVStore store(dir, options);
+    store.reset();
+    auto stats = store.get_statistics();
+
+    {
+        kvstore::PinnableSlice value;
+        if(store.get_pinned(1, value) || !value.empty())
+            failed++;
+
+        // A memtable value stays as it was while pinned, even though an
+        // overwrite of the same size would otherwise reuse its bytes.
+        store.put(1, value_of(1, size));
+        if(!store.get_pinned(1, value) || !value.isPinned() || value != value_of(1, size))
+            failed++;
+        store.put(1, value_of(2, size));
+        store.flush();
+        if(value != value_of(1, size))
+            failed++;
+        if(!store.get_pinned(1, value) || value != value_of(2, size))
+            failed++;
+
+        // Short values live in the memtable entries and are copied out.
+        store.put(2, "tiny");
+        if(!store.get_pinned(2, value) || value.isPinned() || value != "tiny")
+            failed++;
+        store.put(2, "tidy");
+        if(value != "tiny")
+            failed++;
+    }
+
+    for(uint64_t i = 0; i < 200; i++)
+        store.put(i, value_of(i, size));
+    store.flush();
+
+    {
+        // The first read takes over the read buffer, the second views the cache.
+        kvstore::PinnableSlice first, second;
+        if(!store.get_pinned(7, first) || first.isPinned() || first != value_of(7, size))
+            failed++;
+        uint64_t hits = stats->get(statistics::BLOCK_CACHE_HIT);
+        if(!store.get_pinned(7, second) || !second.isPinned() || second != value_of(7, size) ||
+           stats->get(statistics::BLOCK_CACHE_HIT) != hits + 1)
+            failed++;
+
+        // Reading everything evicts the pinned entry; its bytes stay.
+        for(uint64_t i = 0; i < 200; i++){
+            kvstore::PinnableSlice value;
+            if(!store.get_pinned(i, value) || value != store.get(i))
+                failed++;
+        }
+        if(second != value_of(7, size))
+            failed++;
+    }
+
+    {
+        kvstore::PinnableSlice value;
+        store.put(500, "short-lived", 1000);
+        store.del(3);
+        store.set_merge_operator(std::make_shared<merge::UInt64AddOperator>());
+        store.put(600, "40");
+        store.flush();
+        store.merge(600, "2");
+        if(!store.get_pinned(500, value) || value != "short-lived")
+            failed++;
+        if(store.get_pinned(3, value) || !value.empty())
+            failed++;
+        if(!store.get_pinned(600, value) || value != "42")
+            failed++;
+        store.flush();
+        if(!store.get_pinned(500, value) || value != "short-lived" ||
+           !store.get_pinned(600, value) || value != "42")
+            failed++;
+    }
+
+    {
+        // Cached values are handed out without a copy.
+        const int rounds = 20000;
+        auto start = std::chrono::steady_clock::now();
+        size_t bytes = 0;
+        for(int i = 0; i < rounds; i++)
+            bytes += store.get(100 + i % 10).size();
+        auto copied = std::chrono::steady_clock::now() - start;
+        start = std::chrono::steady_clock::now();
+        for(int i = 0; i < rounds; i++){
+            kvstore::PinnableSlice value;
+            store.get_pinned(100 + i % 10, value);
+            bytes += value.size();
+        }
+        auto pinned = std::chrono::steady_clock::now() - start;
+        std::cout << "get " << std::chrono::duration_cast<std::chrono::microseconds>(copied).count()
+                  << "us, get_pinned " << std::chrono::duration_cast<std::chrono::microseconds>(pinned).count()
+                  << "us for " << bytes << " bytes" << std::endl;
+    }
+
+    {
+        // A reset replaces the cache; the pinned entry and the cache it
+        // came from stay until the slice lets go.
+        store.put(700, value_of(7, size));
+        store.flush();
+        kvstore::PinnableSlice first, second;
+        if(!store.get_pinned(700, first) || !store.get_pinned(700, second) || !second.isPinned())
+            failed++;
+        store.reset();
+        if(second != value_of(7, size))
+            failed++;
+        second.reset();
+        if(store.get_pinned(700, first) || !first.empty())
+            failed++;
+    }
+
+    if(failed != 0){
+        std::cout << failed << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "passed" << std::endl;
+    return 0;
+}
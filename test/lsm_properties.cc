@@ -0,0 +1,72 @@
+// Testing whether level properties follow flushes, deletes and compactions.
+
+#include <kvstore.h>
+
+#include <fstream>
+#include <iostream>
+
+uint64_t number(kvstore::KVStore &store, const std::string &name){
+    auto value = store.get_property("minilsm." + name);
+    return value.empty() ? (uint64_t)-1 : std::stoull(value);
+}
+
+int main(){
+    std::string conf = "/tmp/lsm_properties.conf";
+    std::ofstream ofile(conf);
+    ofile << "0 2 Tiering\n1 100 Leveling\n";
+    ofile.close();
+
+    kvstore::KVStore store("/tmp/lsm_properties", conf);
+    store.reset();
+    int failed = 0;
+
+    // One block of 100 keys with 10 tombstones on level 0.
+    for(uint64_t i = 0; i < 100; i++)
+        store.put(i, std::string(100, 'v'));
+    for(uint64_t i = 0; i < 100; i += 10)
+        store.del(i);
+    store.flush();
+    if(number(store, "num-files-at-level0") != 1 || number(store, "keys-at-level0") != 100)
+        failed++;
+    if(number(store, "tombstones-at-level0") != 10 ||
+       store.get_property("minilsm.tombstone-ratio-at-level0") != "0.100")
+        failed++;
+    uint64_t flushed = number(store, "bytes-at-level0");
+    if(flushed == 0 || number(store, "flush-bytes") != flushed)
+        failed++;
+
+    // A second, overlapping flush fills level 0 and merges both blocks
+    // into level 1, where the tombstones are dropped.
+    for(uint64_t i = 50; i < 150; i++)
+        store.put(i, std::string(100, 'v'));
+    store.flush();
+    std::cout << store.get_property("minilsm.levelstats");
+    std::cout << store.get_property("minilsm.files-at-level1");
+    if(number(store, "num-files-at-level0") != 0 || number(store, "bytes-at-level0") != 0)
+        failed++;
+    if(number(store, "keys-at-level1") != 145 || number(store, "tombstones-at-level1") != 0)
+        failed++;
+    uint64_t written = number(store, "compact-write-bytes-at-level1");
+    if(written != number(store, "bytes-at-level1") ||
+       number(store, "compact-read-bytes-at-level1") != number(store, "flush-bytes"))
+        failed++;
+    if(store.get_property("minilsm.write-amplification") == "" ||
+       store.get_property("minilsm.files-at-level1").find("keys=145") == std::string::npos)
+        failed++;
+    if(store.get_property("minilsm.bytes-at-level7") != "" ||
+       store.get_property("minilsm.no-such-property") != "")
+        failed++;
+
+    // Reopening rebuilds the level totals from the block headers.
+    {
+        kvstore::KVStore reopened("/tmp/lsm_properties", conf);
+        if(number(reopened, "keys-at-level1") != 145 ||
+           number(reopened, "bytes-at-level1") != written)
+            failed++;
+    }
+
+    store.reset();
+    if(number(store, "total-files") != 0)
+        failed++;
+    return failed == 0 ? 0 : 1;
+}
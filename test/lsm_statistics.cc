@@ -0,0 +1,52 @@
+// Testing whether statistics and perf context account for every lookup.
+
+#include <kvstore.h>
+
+#include <iostream>
+
+int main(){
+    kvstore::KVStore store("/tmp/lsm_statistics");
+    store.reset();
+    int failed = 0;
+
+    for(uint64_t i = 0; i < 2048; i++)
+        store.put(i * 2, std::string(1024, 'v'));
+    store.flush();
+    store.put(1, "recent");
+
+    auto stats = store.get_statistics();
+    if(stats == nullptr)
+        return 1;
+    stats->reset();
+
+    statistics::set_perf_level(statistics::PERF_TIME);
+    statistics::get_perf_context().reset();
+    for(uint64_t i = 0; i < 1000; i++)
+        store.get(i);
+    auto &perf = statistics::get_perf_context();
+
+    // 500 even keys come from one block read each, key 1 from the memtable.
+    if(stats->get(statistics::NUMBER_KEYS_READ) != 1000)
+        failed++;
+    if(stats->get(statistics::MEMTABLE_HIT) != 1 || perf.memtable_hit_count != 1)
+        failed++;
+    if(stats->get(statistics::BLOCK_READ_COUNT) != 500 || perf.block_read_count != 500)
+        failed++;
+    if(stats->get(statistics::BLOCK_READ_BYTES) != 500 * 1024)
+        failed++;
+    if(stats->get(statistics::BLOOM_FILTER_USEFUL) + stats->get(statistics::BLOOM_FILTER_POSITIVE) != 999)
+        failed++;
+    if(stats->get(statistics::BLOOM_FILTER_POSITIVE) - stats->get(statistics::BLOOM_FILTER_FALSE_POSITIVE) != 500)
+        failed++;
+    if(stats->snapshot(statistics::GET_MICROS).count != 1000)
+        failed++;
+    if(perf.get_read_nanos == 0 || perf.get_memtable_nanos == 0)
+        failed++;
+    if(store.dump_statistics(true).find("\"block.read.count\":500") == std::string::npos)
+        failed++;
+
+    std::cout << store.dump_statistics();
+    std::cout << perf.toString() << std::endl;
+    store.reset();
+    return failed == 0 ? 0 : 1;
+}
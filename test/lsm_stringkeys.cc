@@ -0,0 +1,105 @@
+// Testing whether byte-string keys keep their order through memtable,
+// blocks, compaction and reopening, with both the default and a custom
+// comparator.
+
+#include <kvstore.h>
+
+#include <fstream>
+#include <iostream>
+#include <list>
+#include <map>
+#include <random>
+
+// (tenant, entity, ts) packed big-endian so bytewise order is tuple order.
+std::string composite(uint32_t tenant, uint32_t entity, uint64_t ts){
+    std::string key;
+    for(int i = 3; i >= 0; i--) key.push_back((char)(tenant >> (8 * i)));
+    for(int i = 3; i >= 0; i--) key.push_back((char)(entity >> (8 * i)));
+    for(int i = 7; i >= 0; i--) key.push_back((char)(ts >> (8 * i)));
+    return key;
+}
+
+class ReverseComparator : public keys::KeyComparator {
+public:
+    int compare(const std::string &a, const std::string &b) const override {
+        return b.compare(a);
+    }
+    const char *name() const override { return "test.ReverseComparator"; }
+};
+
+template <typename Ref>
+int check(kvstore::StringKVStore &store, const Ref &ref,
+          const std::string &lo, const std::string &hi){
+    int failed = 0;
+    for(auto &kv : ref){
+        if(store.get(kv.first) != kv.second)
+            failed++;
+    }
+    std::list<std::pair<std::string, std::string>> list;
+    store.scan(lo, hi, list);
+    auto it = ref.lower_bound(lo);
+    for(auto &kv : list){
+        if(it == ref.end() || kv.first != it->first || kv.second != it->second)
+            failed++;
+        else
+            it++;
+    }
+    if(it != ref.end() && !ref.key_comp()(hi, it->first))
+        failed++;
+    return failed;
+}
+
+int main(){
+    std::string conf = "/tmp/lsm_stringkeys.conf";
+    std::ofstream ofile(conf);
+    ofile << "0 2 Tiering\n1 4 Leveling\n2 100 Leveling\n";
+    ofile.close();
+
+    int failed = 0;
+    std::mt19937_64 rng(7);
+    {
+        kvstore::StringKVStore store("/tmp/lsm_stringkeys", conf);
+        store.reset();
+        std::map<std::string, std::string> ref;
+        for(int i = 0; i < 60000; i++){
+            auto key = composite(rng() % 4, rng() % 64, rng() % 1000);
+            auto value = std::string(rng() % 300 + 1, 'a' + i % 26);
+            store.put(key, value);
+            ref[key] = value;
+        }
+        for(int i = 0; i < 5000; i++){
+            auto it = ref.lower_bound(composite(rng() % 4, rng() % 64, 0));
+            if(it != ref.end()){
+                store.del(it->first);
+                ref.erase(it);
+            }
+        }
+        failed += check(store, ref, composite(1, 10, 0), composite(2, 20, 500));
+        store.flush();
+        std::cout << store.get_property("minilsm.levelstats");
+
+        kvstore::StringKVStore reopened("/tmp/lsm_stringkeys", conf);
+        failed += check(reopened, ref, composite(0, 0, 0), composite(3, 63, 999));
+        if(reopened.get(composite(9, 9, 9)) != "")
+            failed++;
+        reopened.reset();
+    }
+
+    {
+        ReverseComparator reverse;
+        keys::Comparator cmp(&reverse);
+        kvstore::StringKVStore store("/tmp/lsm_stringkeys", conf, cmp);
+        store.reset();
+        std::map<std::string, std::string, keys::Comparator> ref(cmp);
+        for(int i = 0; i < 40000; i++){
+            auto key = "user" + std::to_string(rng() % 20000);
+            store.put(key, key + "-value");
+            ref[key] = key + "-value";
+        }
+        failed += check(store, ref, "user9", "user1");
+        store.reset();
+    }
+
+    std::cout << (failed == 0 ? "string keys passed" : "string keys FAILED") << std::endl;
+    return failed == 0 ? 0 : 1;
+}
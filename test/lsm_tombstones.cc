@@ -0,0 +1,110 @@
+// Testing tombstones in compaction: a delete merged into a level above an
+// older version of its key keeps hiding it, and blocks mostly holding
+// tombstones are pushed down until the tombstones can be dropped, even
+// when the rest of their level is clean.
+
+#include <kvstore.h>
+
+#include <iostream>
+
+static size_t prop(kvstore::KVStore &store, const std::string &name){
+    return std::stoul(store.get_property("minilsm." + name));
+}
+
+// Scattered keys, so compactions rewrite rather than move blocks.
+static void fill(kvstore::KVStore &store, uint64_t keys){
+    for(uint64_t i = 0; i < keys; i++)
+        store.put(i * 7919 % keys, std::string(100, 'a' + i % 26));
+    store.flush();
+}
+
+// Delete a range in two overlapping runs, which level 0 then merges into
+// level 1 rather than moving them down as they are.
+static void delete_and_settle(kvstore::KVStore &store, uint64_t deleted){
+    for(uint64_t odd = 0; odd < 2; odd++){
+        for(uint64_t i = odd; i < deleted; i += 2)
+            store.del(i);
+        store.flush();
+    }
+}
+
+static int check(kvstore::KVStore &store, uint64_t keys, uint64_t deleted){
+    int failed = 0;
+    for(uint64_t i = 0; i < keys; i++){
+        if(store.get(i).empty() != (i < deleted))
+            failed++;
+    }
+    std::list<std::pair<uint64_t, std::string>> list;
+    store.scan(0, keys, list);
+    if(list.size() != keys - deleted)
+        failed++;
+    return failed;
+}
+
+int main(){
+    const uint64_t keys = 3000, deleted = 1500;
+    int failed = 0;
+
+    kvstore::Options options;
+    options.levels = {{sstable::TIERING, 2}, {sstable::LEVELING, 8}, {sstable::LEVELING, 100}};
+    options.write_buffer_size = 16 * 1024;
+
+    {
+        kvstore::KVStore store("/tmp/lsm_tombstones_hide", options);
+        store.reset();
+        fill(store, keys);
+        if(prop(store, "num-files-at-level2") == 0)
+            failed++;
+        delete_and_settle(store, deleted);
+        // The deletes were rewritten into level 1 and still hide level 2.
+        if(prop(store, "tombstones-at-level1") != deleted)
+            failed++;
+        failed += check(store, keys, deleted);
+    }
+
+    options.tombstone_compaction_ratio = 0.5;
+    {
+        kvstore::KVStore store("/tmp/lsm_tombstones_ratio", options);
+        store.reset();
+        auto stats = store.get_statistics();
+        fill(store, keys);
+        delete_and_settle(store, deleted);
+        failed += check(store, keys, deleted);
+        // Each block past the ratio went down and took its deletes along.
+        if(stats->get(statistics::COMPACTION_TOMBSTONE_TRIGGERED) == 0 ||
+           prop(store, "total-tombstones") != 0){
+            std::cerr << prop(store, "total-tombstones") << " tombstones left" << std::endl;
+            failed++;
+        }
+    }
+
+    {
+        // One dense block among clean ones, left behind while the ratio
+        // was off and with no compaction due once it is on.
+        const uint64_t few = 100;
+        options.tombstone_compaction_ratio = 0;
+        {
+            kvstore::KVStore store("/tmp/lsm_tombstones_dense", options);
+            store.reset();
+            fill(store, keys);
+            delete_and_settle(store, few);
+            if(prop(store, "tombstones-at-level1") != few ||
+               prop(store, "tombstones-at-level1") * 2 >= prop(store, "keys-at-level1"))
+                failed++;
+        }
+        options.tombstone_compaction_ratio = 0.5;
+        options.levels[1].second = 20;
+        kvstore::KVStore store("/tmp/lsm_tombstones_dense", options);
+        auto stats = store.get_statistics();
+        store.put(keys + 1, "x");
+        store.flush();
+        if(stats->get(statistics::COMPACTION_TOMBSTONE_TRIGGERED) == 0 ||
+           prop(store, "tombstones-at-level1") != 0)
+            failed++;
+        failed += check(store, keys, few);
+    }
+
+    if(failed)
+        std::cerr << failed << " checks failed" << std::endl;
+    return failed != 0;
+}
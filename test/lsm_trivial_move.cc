@@ -0,0 +1,81 @@
+// Testing whether blocks that overlap nothing below them move down a
+// level without being rewritten, and whether overlapping ones still merge.
+
+#include <kvstore.h>
+
+#include <fstream>
+#include <iostream>
+#include <map>
+
+static std::string write(const std::string &name, const std::string &text){
+    std::ofstream ofile(name);
+    ofile << text;
+    return name;
+}
+
+static uint64_t property(kvstore::KVStore &store, const std::string &name){
+    return std::stoull(store.get_property("minilsm." + name));
+}
+
+int main(){
+    const std::string dir = "/tmp/lsm_trivial_move";
+    auto conf = write(dir + ".conf", "0 4 Tiering\n1 8 Leveling\n2 100 Leveling\n");
+    std::map<uint64_t, std::string> expected;
+    int failed = 0;
+
+    auto check = [&expected](kvstore::KVStore &store){
+        int failed = 0;
+        for(const auto &kv : expected){
+            if(store.get(kv.first) != kv.second)
+                failed++;
+        }
+        return failed;
+    };
+
+    {
+        kvstore::KVStore store(dir, conf);
+        store.reset();
+
+        // Sequential ingest: every block lands beside the others.
+        for(uint64_t i = 0; i < 40 * 500; i++){
+            expected[i] = std::string(100, 'a' + i % 26);
+            store.put(i, expected[i]);
+            if(i % 500 == 499)
+                store.flush();
+        }
+        if(property(store, "compact-read-bytes") != 0 ||
+           property(store, "compact-write-bytes") != 0)
+            failed++;
+        if(property(store, "moved-bytes") == 0 ||
+           property(store, "num-files-at-level2") == 0)
+            failed++;
+        if(store.get_property("minilsm.write-amplification") != "1.000")
+            failed++;
+        failed += check(store);
+
+        // Overwrites across the whole range have to be merged.
+        for(uint64_t i = 0; i < 4 * 500; i++){
+            uint64_t key = i * 10;
+            expected[key] = std::string(100, 'z');
+            store.put(key, expected[key]);
+            if(i % 500 == 499)
+                store.flush();
+        }
+        if(property(store, "compact-read-bytes") == 0)
+            failed++;
+        failed += check(store);
+        std::cout << store.get_property("minilsm.levelstats");
+    }
+
+    {
+        kvstore::KVStore store(dir, conf);
+        failed += check(store);
+    }
+
+    if(failed != 0){
+        std::cout << failed << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,105 @@
+// Testing whether entries written with a TTL disappear once expired, and
+// whether flushes and compactions drop them.
+
+#include <kvstore.h>
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+int main(){
+    std::string conf = "/tmp/lsm_ttl.conf";
+    std::ofstream ofile(conf);
+    ofile << "0 3 Tiering\n1 100 Leveling\nvlog_threshold 1024\n";
+    ofile.close();
+
+    kvstore::KVStore store("/tmp/lsm_ttl", conf);
+    store.reset();
+    auto stats = store.get_statistics();
+    int failed = 0;
+
+    // Block A: permanent keys, and key 300 whose newer version expires.
+    for(uint64_t i = 100; i < 200; i++)
+        store.put(i, "permanent");
+    store.put(300, "old");
+    store.flush();
+
+    // Block B: expiring keys only, some of them in the value log.
+    for(uint64_t i = 0; i < 100; i++)
+        store.put(i, "session", 1);
+    for(uint64_t i = 200; i < 210; i++)
+        store.put(i, std::string(2048, 's'), 1);
+    store.put(300, "new", 1);
+    store.flush();
+
+    // Expiring keys still in the memtable.
+    store.put(400, "recent", 1);
+    if(store.get(0) != "session" || store.get(205) != std::string(2048, 's') ||
+       store.get(300) != "new" || store.get(400) != "recent")
+        failed++;
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(2100));
+
+    // Expired entries hide older versions too.
+    if(store.get(0) != "" || store.get(205) != "" || store.get(300) != "" ||
+       store.get(400) != "" || store.get(150) != "permanent")
+        failed++;
+    auto values = store.multi_get({0, 150, 205, 300, 400});
+    if(values[0] != "" || values[1] != "permanent" || values[2] != "" ||
+       values[3] != "" || values[4] != "")
+        failed++;
+    std::list<std::pair<uint64_t, std::string>> list;
+    store.scan(0, 1000, list);
+    if(list.size() != 100 || list.front().first != 100)
+        failed++;
+
+    // This flush writes out only the expired key 400. Nothing older can
+    // hold it, so its block is deleted unread. Block B has expired too,
+    // but it still hides "old" for key 300, so it stays.
+    store.flush();
+    if(stats->get(statistics::EXPIRED_BLOCKS_DROPPED) != 1 ||
+       store.get_property("minilsm.num-files-at-level0") != "2")
+        failed++;
+
+    // The next block sends level 0 down. The expired keys go, along with
+    // the version of 300 they hid, and their value log file is collected.
+    store.put(500, "permanent");
+    store.flush();
+    if(stats->get(statistics::COMPACTION_KEY_DROP_EXPIRED) != 111)
+        failed++;
+    if(store.get(300) != "" || store.get(0) != "" || store.get(500) != "permanent")
+        failed++;
+    if(store.get_property("minilsm.keys-at-level1") != "101" ||
+       store.get_property("minilsm.tombstones-at-level1") != "0")
+        failed++;
+    if(stats->get(statistics::VLOG_GC_COUNT) != 1 ||
+       store.get_property("minilsm.vlog-files") != "0")
+        failed++;
+
+    // A block of expired keys with nothing under it is deleted unread.
+    for(uint64_t i = 1000; i < 1100; i++)
+        store.put(i, "session", 1);
+    store.flush();
+    std::this_thread::sleep_for(std::chrono::milliseconds(2100));
+    store.put(2000, "permanent");
+    store.flush();
+    if(stats->get(statistics::EXPIRED_BLOCKS_DROPPED) != 2 ||
+       store.get_property("minilsm.num-files-at-level0") != "1")
+        failed++;
+
+    // A value that looks like an expiry is still just a value, in the
+    // memtable and on disk, with a TTL of its own or without.
+    const std::string lookalike = "~EXPIRES~abcdefgh-payload";
+    store.put(3000, lookalike);
+    store.put(3001, lookalike, 100);
+    if(store.get(3000) != lookalike || store.get(3001) != lookalike)
+        failed++;
+    store.flush();
+    if(store.get(3000) != lookalike || store.get(3001) != lookalike)
+        failed++;
+
+    std::cout << store.get_property("minilsm.levelstats");
+    std::cout << (failed == 0 ? "passed" : "failed") << std::endl;
+    return failed == 0 ? 0 : 1;
+}
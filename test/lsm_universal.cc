@@ -0,0 +1,100 @@
+// Testing whether Universal levels merge runs by size ratio, space
+// amplification and run count, and whether lazy leveling rewrites the
+// level policies.
+
+#include <kvstore.h>
+
+#include <fstream>
+#include <iostream>
+#include <map>
+
+struct Tree {
+    std::string dir;
+    kvstore::KVStore store;
+    std::map<uint64_t, std::string> expected;
+
+    Tree(const std::string &dir, const std::string &conf)
+        : dir(dir), store(dir, write(dir + ".conf", conf)) {
+        store.reset();
+    }
+
+    static std::string write(const std::string &name, const std::string &text){
+        std::ofstream ofile(name);
+        ofile << text;
+        return name;
+    }
+
+    // `n` keys spread over the same range every time, so runs overlap.
+    void flush(uint64_t n, char tag){
+        for(uint64_t i = 0; i < n; i++){
+            uint64_t key = i * (6000 / n);
+            expected[key] = std::string(100, tag);
+            store.put(key, expected[key]);
+        }
+        store.flush();
+    }
+
+    size_t runs(){
+        return std::stoul(store.get_property("minilsm.num-runs-at-level1"));
+    }
+
+    int check(){
+        int failed = 0;
+        for(const auto &kv : expected){
+            if(store.get(kv.first) != kv.second)
+                failed++;
+        }
+        return failed;
+    }
+};
+
+int main(){
+    int failed = 0;
+
+    {
+        Tree tree("/tmp/lsm_universal_ratio",
+                  "0 1 Tiering\n1 3 Universal\nuniversal_max_size_amplification 50\n");
+        tree.flush(1000, 'a');
+        tree.flush(100, 'b');
+        if(tree.runs() != 2)
+            failed++;
+        // Two similar runs on top of a big one: only those two merge.
+        tree.flush(100, 'c');
+        if(tree.runs() != 2)
+            failed++;
+        // The newer runs now add up to more than half the oldest one.
+        tree.flush(300, 'd');
+        if(tree.runs() != 1)
+            failed++;
+        failed += tree.check();
+        std::cout << tree.store.get_property("minilsm.levelstats");
+    }
+
+    {
+        // Shrinking runs never satisfy the size ratio, so the run count
+        // forces the newest two together.
+        Tree tree("/tmp/lsm_universal_count",
+                  "0 1 Tiering\n1 3 Universal\nuniversal_max_size_amplification 10000\n");
+        tree.flush(1000, 'a');
+        tree.flush(500, 'b');
+        tree.flush(300, 'c');
+        if(tree.runs() != 2 || tree.store.get_property("minilsm.policy-at-level1") != "Universal")
+            failed++;
+        failed += tree.check();
+    }
+
+    {
+        Tree tree("/tmp/lsm_universal_lazy",
+                  "0 1 Leveling\n1 2 Leveling\n2 100 Tiering\ncompaction_style lazy_leveling\n");
+        if(tree.store.get_property("minilsm.policy-at-level0") != "Tiering" ||
+           tree.store.get_property("minilsm.policy-at-level1") != "Tiering" ||
+           tree.store.get_property("minilsm.policy-at-level2") != "Leveling")
+            failed++;
+        for(char tag = 'a'; tag < 'f'; tag++)
+            tree.flush(200, tag);
+        failed += tree.check();
+    }
+
+    std::cout << (failed == 0 ? "passed" : "failed") << std::endl;
+    return failed == 0 ? 0 : 1;
+}
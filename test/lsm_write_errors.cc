@@ -0,0 +1,127 @@
+// Testing failed block writes, forced with a file size limit: a flush that
+// fails keeps the memtable, a compaction that fails puts its inputs back,
+// and neither leaves a partial block or value log file behind. Once writes
+// work again, the store catches up and reopens with everything.
+
+#include <kvstore.h>
+#include <sstable/writer.h>
+
+#include <dirent.h>
+#include <sys/resource.h>
+
+#include <csignal>
+#include <iostream>
+#include <map>
+
+static void limit_file_size(rlim_t bytes){
+    struct rlimit lim;
+    getrlimit(RLIMIT_FSIZE, &lim);
+    lim.rlim_cur = bytes;
+    setrlimit(RLIMIT_FSIZE, &lim);
+}
+
+static size_t count_files(const std::string &dir, const std::string &prefix){
+    size_t ret = 0;
+    DIR *d = opendir(dir.c_str());
+    if(d == nullptr)
+        return 0;
+    while(auto entry = readdir(d))
+        ret += std::string(entry->d_name).compare(0, prefix.size(), prefix) == 0;
+    closedir(d);
+    return ret;
+}
+
+static size_t property(kvstore::KVStore &store, const std::string &name){
+    return std::stoul(store.get_property("minilsm." + name));
+}
+
+static int check(kvstore::KVStore &store, const std::map<uint64_t, std::string> &expected){
+    int failed = 0;
+    for(const auto &kv : expected){
+        if(store.get(kv.first) != kv.second)
+            failed++;
+    }
+    return failed;
+}
+
+// Blocks and value log files on disk are exactly those the store holds.
+static int check_files(kvstore::KVStore &store, const std::string &dir){
+    int failed = 0;
+    for(size_t i = 0; i < 2; i++){
+        auto level = std::to_string(i);
+        if(count_files(dir + "/level-" + level, "block") != property(store, "num-files-at-level" + level))
+            failed++;
+    }
+    if(count_files(dir + "/vlog", "vlog-") != property(store, "vlog-files"))
+        failed++;
+    return failed;
+}
+
+int main(){
+    const std::string dir = "/tmp/lsm_write_errors";
+    int failed = 0;
+    // Over the limit, writes fail with EFBIG instead of raising SIGXFSZ.
+    std::signal(SIGXFSZ, SIG_IGN);
+
+    kvstore::Options options;
+    options.levels = {{sstable::TIERING, 2}, {sstable::LEVELING, 100}};
+    options.write_buffer_size = 16 * 1024;
+    options.vlog_threshold = 200;
+    std::map<uint64_t, std::string> expected;
+    auto put = [&](kvstore::KVStore &store, uint64_t key, size_t size, char c){
+        expected[key] = std::string(size, c);
+        store.put(key, expected[key]);
+    };
+
+    {
+        kvstore::KVStore store(dir, options);
+        store.reset();
+        for(uint64_t i = 0; i < 40; i++)
+            put(store, i, i % 2 ? 300 : 50, 'a');
+        store.flush();
+        sstable::SSTableWriter<uint64_t> writer(dir + "/ingest.sst");
+        for(uint64_t i = 0; i < 100; i += 3)
+            writer.put(i, std::string(50, 'b'));
+
+        limit_file_size(4096);
+        if(writer.finish())
+            failed++;
+        for(uint64_t i = 100; i < 200; i++)
+            put(store, i, i % 2 ? 300 : 50, 'c');
+        store.flush();
+        if(property(store, "cur-size-active-mem-table") == 0 || property(store, "num-files-at-level0") != 1)
+            failed++;
+        failed += check(store, expected);
+        failed += check_files(store, dir);
+        limit_file_size(RLIM_INFINITY);
+
+        // The ingested file fills level 0 and its compaction fails.
+        if(!writer.finish())
+            failed++;
+        limit_file_size(4096);
+        if(!store.ingest_files({dir + "/ingest.sst"}))
+            failed++;
+        for(uint64_t i = 0; i < 100; i += 3)
+            expected[i] = std::string(50, 'b');
+        if(property(store, "num-files-at-level0") != 2 || property(store, "num-files-at-level1") != 0)
+            failed++;
+        failed += check(store, expected);
+        failed += check_files(store, dir);
+
+        limit_file_size(RLIM_INFINITY);
+        store.flush();
+        if(property(store, "cur-size-active-mem-table") != 0 || property(store, "num-files-at-level1") == 0)
+            failed++;
+        failed += check(store, expected);
+        failed += check_files(store, dir);
+    }
+
+    {
+        kvstore::KVStore store(dir, options);
+        failed += check(store, expected);
+    }
+
+    if(failed)
+        std::cerr << failed << " checks failed" << std::endl;
+    return failed != 0;
+}